@@ -1,21 +1,758 @@
   /*
-  * Reads 4 analog inputs (0-5V) for recording_dur seconds
-  * Streams data to PC while recording
-  * 
+  * Reads up to 4 analog inputs (0-5V) for recording_dur milliseconds
+  * Streams data to PC while recording (CSV text on START, binary frames on START_BIN)
+  * STREAM / STREAM_BIN do the same but keep going until STOP
+  *
+  * Sampling is interrupt driven: Timer1 starts a conversion sequence every
+  * sample_period_us, the ADC complete interrupt walks through
+  * analogInputs[] and pushes finished samples into a ring buffer.
+  * loop() only drains that buffer to Serial, so the sample timing does not
+  * depend on how long printing takes.
+  *
+  * With CONFIG OVERSAMPLE=n each tick converts every scanned input 4^n
+  * times back to back, sums them and shifts right by n, giving (10+n)-bit
+  * samples at the same output rate.
+  *
+  * CONFIG OUTPUT=1 / 2 sends the samples through a fixed-point low-pass
+  * (cascaded biquads, see below) instead of / as well as the raw values.
   */
+  #include "butterworth.h"
+  
   // change to 1 to print debug messages on Serial Monitor
   bool debug = false;
-
+  
+  // 1 = format CSV voltages with integer millivolt math into a static buffer,
+  // 0 = the float * (5.0 / 1023.0) + String(voltage, 3) path. Both print the
+  // same text; the integer path avoids soft-float and heap allocation.
+  #ifndef FIXED_POINT_VOLTS
+  #define FIXED_POINT_VOLTS 1
+  #endif
+  
   const int analogInputs[] = {A0, A1, A2, A3};
   
   
-  // set up the global varialbes
-  unsigned long start_time;
-  const unsigned long recording_dur = 5000; // 25 seconds in milliseconds (ENSURE python code is greater than this)
-  unsigned long last_sample_time = 0;
-  const unsigned long min_samp_interval = 2; // Sample every 2ms (adjust for stability)
+  // set up the global varialbes, all of them can be changed with CONFIG
+  unsigned long recording_dur = 5000; // milliseconds, 0 = until STOP
+  unsigned long sample_period_us = 2000; // Sample every 2ms (adjust for stability)
+  byte channel_mask = 0x0F; // bit i scans analogInputs[i]
+  byte oversample_bits = 0; // 0-3, each sample sums 4^n conversions per input
+  byte output_mode = 0; // output_raw, output_filtered or output_both
   bool recording = false;
-  int sample_count = 0;
+  volatile unsigned long sample_count = 0;
+  unsigned long sample_limit = 0; // samples in recording_dur, 0 = no limit
+  
+  // Inputs scanned this recording (indexes into analogInputs[]), from channel_mask
+  byte active_channels[4];
+  byte active_count = 4;
+  
+  // Binary streaming mode (START_BIN). Each sample is one fixed size frame
+  // (14 bytes with all four inputs) instead of a ~35 byte CSV line, all
+  // fields little-endian:
+  //   [0]  0xA5, [1] 0x5A+b    sync word, b = oversample_bits
+  //   [2]  uint16              sample index (wraps, host unwraps it)
+  //   [4]  uint32              elapsed time in us
+  //   [8]  n bytes             (10+b)-bit codes of the header's columns,
+  //                            packed LSB first (5 bytes for 4 inputs at b=0)
+  //   [8+n] uint8              XOR of bytes 2..7+n
+  // The text header sent before the frames names the columns (scanned
+  // inputs, raw and/or filtered). Control lines (RECORDING_COMPLETE etc.)
+  // are still sent as text.
+  const byte frame_sync_0 = 0xA5;
+  const byte frame_sync_1 = 0x5A;
+  const byte max_frame_size = 22; // 8 columns at 13 bits
+  byte frame_size = max_frame_size;
+  bool binary_mode = false;
+  byte frame[max_frame_size];
+  
+  // One acquired sample, filled in by the ISRs
+  struct Sample {
+    unsigned long index;
+    unsigned long time;
+    unsigned int codes[4];
+  };
+  
+  // Single producer (ISRs) / single consumer (loop) ring buffer. Each side
+  // only writes its own index and both indexes are single bytes, so no
+  // locking is needed on the AVR.
+  const byte ring_size = 32; // must be a power of 2
+  Sample ring[ring_size];
+  volatile byte ring_head = 0;   // next slot the ISRs fill
+  volatile byte ring_tail = 0;   // next slot loop() sends
+  
+  volatile unsigned long sample_clock_us = 0; // us since START, advanced by Timer1
+  volatile byte adc_slot = 0;                // active_channels[] entry converting
+  volatile byte adc_rounds_left = 0;         // passes over active_channels[] to go
+  byte oversample_rounds = 1;                // 4^oversample_bits
+  volatile bool adc_busy = false;            // conversion sequence in progress
+  volatile bool acquisition_done = false;
+  volatile unsigned long samples_dropped = 0; // ticks lost to a full buffer
+  
+  // Streaming (STREAM / STREAM_BIN) runs until STOP and sends a
+  // SEQ:<sample index>,DROPPED:<n> line every marker_interval_us of sample
+  // clock, so the host can tell samples the Arduino dropped from bytes lost
+  // on the link
+  const unsigned long marker_interval_us = 1000000UL;
+  bool streaming = false;
+  unsigned long last_marker_us = 0;
+  
+  // On-device low-pass: a cascade of biquads (second order sections) in
+  // direct form I, run in loop() on each sample as it is sent. The
+  // coefficients are Q28 rather than Q31 because at low cutoffs a1 is close
+  // to -2, and each section accumulates in 64 bits. Samples carry
+  // filter_frac_bits of fraction through the cascade: rounding at a
+  // section's output is fed back through 1/(1 + a1 + a2), over 1000x at
+  // 2 Hz / 500 Hz, so a few fraction bits are not enough. 13-bit codes plus
+  // 16 fraction bits still fit a long with room for overshoot.
+  //
+  // The compiled in table is the 4th order Butterworth at 2 Hz that
+  // filter_and_save_data() defaults to, for 500 Hz sampling (PERIOD_US=2000),
+  // designed at compile time by butterworth.h: sections in scipy's order
+  // with each one scaled to unity DC gain. Other cutoffs, orders or sample
+  // rates are uploaded with the SOS command.
+  struct Biquad {
+    long b0, b1, b2, a1, a2;
+  };
+  const byte coef_bits = 28;
+  const byte filter_frac_bits = 16;
+  const byte max_sections = 3; // up to 6th order
+  
+  const byte default_order = 4;
+  constexpr double default_cutoff_hz = 2.0;
+  constexpr double default_sample_hz = 500.0;
+  
+  constexpr long to_q28(double v) {
+    return (long)(v * (1L << coef_bits) + (v < 0 ? -0.5 : 0.5));
+  }
+  // Rounded to Q28 with b1 taking up the rounding, so b0 + b1 + b2 is
+  // exactly 1 + a1 + a2 and the DC gain stays exactly 1
+  constexpr Biquad to_biquad(const butterworth::Section &s) {
+    return Biquad{to_q28(s.b0),
+                  (1L << coef_bits) + to_q28(s.a1) + to_q28(s.a2) - to_q28(s.b0) - to_q28(s.b2),
+                  to_q28(s.b2), to_q28(s.a1), to_q28(s.a2)};
+  }
+  
+  constexpr butterworth::Lowpass<default_order> default_design =
+    butterworth::lowpass<default_order>(default_cutoff_hz, default_sample_hz);
+  const byte default_sections = butterworth::Lowpass<default_order>::sections;
+  static_assert(default_sections <= max_sections, "default filter too long");
+  // One Biquad per section of default_design, however many that is
+  struct DefaultSos {
+    Biquad sos[default_sections];
+  };
+  template <int... I>
+  constexpr DefaultSos to_default_sos(butterworth::indexes<I...>) {
+    return DefaultSos{{to_biquad(default_design.sos[I])...}};
+  }
+  const DefaultSos default_sos = to_default_sos(butterworth::make_indexes<default_sections>::type());
+  Biquad sos[max_sections];
+  byte sos_count = 0;
+  long filter_state[4][max_sections][4]; // x[n-1], x[n-2], y[n-1], y[n-2] per input
+  bool filter_primed = false;
+  
+  const byte output_raw = 0;
+  const byte output_filtered = 1;
+  const byte output_both = 2;
+  
+  // Codes sent for the current sample: raw, filtered, or raw then filtered
+  unsigned int output_codes[8];
+  byte output_count = 4;
+  
+  // Point the ADC at analogInputs[channel] (AVcc reference) and start it
+  void start_conversion(byte channel) {
+    ADMUX = (1 << REFS0) | ((analogInputs[channel] - A0) & 0x07);
+    ADCSRA |= (1 << ADSC);
+  }
+  
+  byte count_channels(byte mask) {
+    byte count = 0;
+    for (byte i = 0; i < 4; i++) {
+      if (mask & (1 << i)) count++;
+    }
+    return count;
+  }
+  
+  // Timer1 in CTC mode. clk/8 (0.5us ticks) covers periods up to 32.768 ms,
+  // longer ones use clk/64 (4us ticks, up to 262.144 ms) and are rounded
+  // down to a multiple of 4us. The shortest period leaves ~20us per scanned
+  // conversion (oversampling multiplies the conversions per input by 4^n)
+  // and ISR. sample_period_us is updated to the period the hardware will
+  // actually run at, so timestamps stay exact.
+  void round_sample_period() {
+    unsigned long min_period = (20UL * count_channels(channel_mask) << (2 * oversample_bits)) + 20;
+    if (sample_period_us < min_period) {
+      sample_period_us = min_period;
+    }
+    if (sample_period_us > 262144UL) {
+      sample_period_us = 262144UL;
+    }
+    if (sample_period_us > 32768UL) {
+      sample_period_us &= ~3UL;
+    }
+  }
+  
+  void configure_sample_clock() {
+    round_sample_period();
+    
+    TCCR1A = 0;
+    if (sample_period_us <= 32768UL) {
+      OCR1A = sample_period_us * 2 - 1;
+      TCCR1B = (1 << WGM12) | (1 << CS11);
+    }
+    else {
+      OCR1A = sample_period_us / 4 - 1;
+      TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+    }
+  }
+  
+  void start_acquisition() {
+    // Which inputs to scan, and how big a binary frame is for them
+    active_count = 0;
+    for (byte i = 0; i < 4; i++) {
+      if (channel_mask & (1 << i)) {
+        active_channels[active_count++] = i;
+      }
+    }
+    output_count = output_mode == output_both ? 2 * active_count : active_count;
+    frame_size = 9 + ((10 + oversample_bits) * output_count + 7) / 8;
+    oversample_rounds = 1 << (2 * oversample_bits);
+    filter_primed = false;
+    
+    noInterrupts();
+    ring_head = 0;
+    ring_tail = 0;
+    sample_clock_us = 0;
+    sample_count = 0;
+    samples_dropped = 0;
+    adc_busy = false;
+    acquisition_done = false;
+    
+    configure_sample_clock();
+    if (streaming) {
+      sample_limit = 0;
+    }
+    else {
+      sample_limit = (unsigned long)((unsigned long long)recording_dur * 1000 / sample_period_us);
+    }
+    TCNT1 = 0;
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 = (1 << OCIE1A);
+    interrupts();
+  }
+  
+  void stop_acquisition() {
+    TIMSK1 &= ~(1 << OCIE1A);
+    TCCR1B = 0;
+    acquisition_done = true;
+  }
+  
+  // Sample clock: one tick per sample_period_us
+  ISR(TIMER1_COMPA_vect) {
+    if (sample_limit && sample_count >= sample_limit) {
+      stop_acquisition();
+      return;
+    }
+    
+    sample_count++;
+    sample_clock_us += sample_period_us;
+    
+    // The previous sequence is still converting or loop() fell behind;
+    // the tick is lost but sample_count still moves so the host sees a gap
+    if (adc_busy || ((ring_head + 1) & (ring_size - 1)) == ring_tail) {
+      samples_dropped++;
+      return;
+    }
+    
+    Sample &sample = ring[ring_head];
+    sample.index = sample_count;
+    sample.time = sample_clock_us;
+    for (byte i = 0; i < active_count; i++) {
+      sample.codes[i] = 0;
+    }
+    adc_busy = true;
+    adc_slot = 0;
+    adc_rounds_left = oversample_rounds;
+    start_conversion(active_channels[0]);
+  }
+  
+  // Conversion finished: add it in and move on to the next input. The
+  // inputs are interleaved so each one is averaged over the same window.
+  // At most 64 * 1023 per input, so the sums fit in the 16-bit codes.
+  ISR(ADC_vect) {
+    Sample &sample = ring[ring_head];
+    sample.codes[adc_slot] += ADC;
+    adc_slot++;
+    
+    if (adc_slot == active_count) {
+      adc_slot = 0;
+      adc_rounds_left--;
+    }
+    if (adc_rounds_left) {
+      start_conversion(active_channels[adc_slot]);
+      return;
+    }
+    
+    // All inputs read, decimate (sum of 4^n >> n) and publish the sample
+    if (oversample_bits) {
+      for (byte i = 0; i < active_count; i++) {
+        sample.codes[i] >>= oversample_bits;
+      }
+    }
+    adc_busy = false;
+    ring_head = (ring_head + 1) & (ring_size - 1);
+  }
+  
+  void load_default_sos() {
+    memcpy(sos, default_sos.sos, sizeof(default_sos.sos));
+    sos_count = default_sections;
+  }
+  
+  // Start every section of input's filter in its steady state for code,
+  // so a recording doesn't begin with the filter climbing up from 0 V
+  void prime_filter(byte input, unsigned int code) {
+    long x = (long)code << filter_frac_bits;
+    for (byte k = 0; k < sos_count; k++) {
+      const Biquad &c = sos[k];
+      long long den = (1LL << coef_bits) + c.a1 + c.a2;
+      long y = den ? (long)((long long)x * (c.b0 + c.b1 + c.b2) / den) : x;
+      long *z = filter_state[input][k];
+      z[0] = x;
+      z[1] = x;
+      z[2] = y;
+      z[3] = y;
+      x = y;
+    }
+  }
+  
+  // Run one code through input's biquad cascade, returns the filtered code
+  unsigned int filter_code(byte input, unsigned int code) {
+    long x = (long)code << filter_frac_bits;
+    for (byte k = 0; k < sos_count; k++) {
+      const Biquad &c = sos[k];
+      long *z = filter_state[input][k];
+      long long acc = (long long)c.b0 * x + (long long)c.b1 * z[0] + (long long)c.b2 * z[1]
+                      - (long long)c.a1 * z[2] - (long long)c.a2 * z[3];
+      long y = (long)((acc + (1LL << (coef_bits - 1))) >> coef_bits);
+      z[1] = z[0];
+      z[0] = x;
+      z[3] = z[2];
+      z[2] = y;
+      x = y;
+    }
+    
+    // Back to code units, clamped to what the ADC could have read
+    long out = (x + (1L << (filter_frac_bits - 1))) >> filter_frac_bits;
+    long max_code = 1023L << oversample_bits;
+    if (out < 0) {
+      out = 0;
+    }
+    if (out > max_code) {
+      out = max_code;
+    }
+    return out;
+  }
+  
+  // Fill output_codes[] for sample according to output_mode
+  void prepare_output(const Sample &sample) {
+    byte n = 0;
+    if (output_mode != output_filtered) {
+      for (byte i = 0; i < active_count; i++) {
+        output_codes[n++] = sample.codes[i];
+      }
+    }
+    if (output_mode != output_raw) {
+      if (!filter_primed) {
+        for (byte i = 0; i < active_count; i++) {
+          prime_filter(i, sample.codes[i]);
+        }
+        filter_primed = true;
+      }
+      for (byte i = 0; i < active_count; i++) {
+        output_codes[n++] = filter_code(i, sample.codes[i]);
+      }
+    }
+  }
+  
+  // Send one sample as a binary frame (see layout above)
+  void send_frame(const Sample &sample) {
+    frame[0] = frame_sync_0;
+    frame[1] = frame_sync_1 + oversample_bits;
+    frame[2] = sample.index & 0xFF;
+    frame[3] = (sample.index >> 8) & 0xFF;
+    frame[4] = sample.time & 0xFF;
+    frame[5] = (sample.time >> 8) & 0xFF;
+    frame[6] = (sample.time >> 16) & 0xFF;
+    frame[7] = (sample.time >> 24) & 0xFF;
+    
+    // 10+b bits per input, LSB first (4 inputs = 40 bits = 5 bytes at b=0)
+    byte code_bits = 10 + oversample_bits;
+    byte pos = 8;
+    unsigned long bits = 0;
+    byte bit_count = 0;
+    for (byte i = 0; i < output_count; i++) {
+      bits |= (unsigned long)output_codes[i] << bit_count;
+      bit_count += code_bits;
+      while (bit_count >= 8) {
+        frame[pos++] = bits & 0xFF;
+        bits >>= 8;
+        bit_count -= 8;
+      }
+    }
+    if (bit_count) {
+      frame[pos++] = bits & 0xFF;
+    }
+    
+    byte check = 0;
+    for (int i = 2; i < frame_size - 1; i++) {
+      check ^= frame[i];
+    }
+    frame[frame_size - 1] = check;
+    
+    Serial.write(frame, frame_size);
+  }
+  
+  #if FIXED_POINT_VOLTS
+  // Longest line: 4294967295,4294967295 and 8 x ,5.0000 then \r\n
+  char line_buf[80];
+  
+  // raw * 5000 / 1023 rounded to the nearest mV as a multiply and shift.
+  // Exact for every 10-bit code, and the true value is never a .5 tie, so
+  // the digits match String(raw * (5.0 / 1023.0), 3).
+  unsigned int code_to_millivolts(unsigned int raw) {
+    return ((unsigned long)raw * 1281251UL + 131072UL) >> 18;
+  }
+  
+  // Oversampled (10+n)-bit code to 0.1 mV, i.e. raw * 50000 / (1023 << n)
+  // rounded. Multiplier and bias are tuned to be exact for every code at
+  // n = 1..3, so the digits match String(volts, 4).
+  unsigned int code_to_tenth_millivolts(unsigned int raw) {
+    return ((unsigned long)raw * 400391UL + (4099UL << oversample_bits)) >> (13 + oversample_bits);
+  }
+  
+  // Write value in decimal at p, returns the new end
+  char *append_uint(char *p, unsigned long value) {
+    char digits[10];
+    byte n = 0;
+    do {
+      digits[n++] = '0' + value % 10;
+      value /= 10;
+    } while (value);
+    while (n) {
+      *p++ = digits[--n];
+    }
+    return p;
+  }
+  
+  // Send one sample as a CSV line
+  void send_line(const Sample &sample) {
+    char *p = line_buf;
+    p = append_uint(p, sample.index);
+    *p++ = ',';
+    p = append_uint(p, sample.time);
+    
+    for (byte i = 0; i < output_count; i++) {
+      *p++ = ',';
+      if (oversample_bits) {
+        // 4 decimals, the extra bits are below a millivolt
+        unsigned int tenths = code_to_tenth_millivolts(output_codes[i]);
+        *p++ = '0' + tenths / 10000;
+        *p++ = '.';
+        tenths %= 10000;
+        *p++ = '0' + tenths / 1000;
+        *p++ = '0' + (tenths / 100) % 10;
+        *p++ = '0' + (tenths / 10) % 10;
+        *p++ = '0' + tenths % 10;
+      }
+      else {
+        unsigned int mv = code_to_millivolts(output_codes[i]);
+        *p++ = '0' + mv / 1000;
+        *p++ = '.';
+        mv %= 1000;
+        *p++ = '0' + mv / 100;
+        *p++ = '0' + (mv / 10) % 10;
+        *p++ = '0' + mv % 10;
+      }
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    
+    // Send the complete line at once
+    Serial.write((const byte *)line_buf, p - line_buf);
+  }
+  #else
+  // Send one sample as a CSV line
+  void send_line(const Sample &sample) {
+    // Start building the output string
+    String data_string = String(sample.index) + "," + String(sample.time);
+    
+    for (byte i = 0; i < output_count; i++) {
+      float voltage = output_codes[i] * (5.0 / 1023.0) / (1 << oversample_bits);
+      data_string += "," + String(voltage, oversample_bits ? 4 : 3);
+    }
+    
+    // Send the complete data string at once
+    Serial.println(data_string);
+  }
+  #endif
+  
+  // CONFIG [PERIOD_US=n] [DURATION_MS=n] [CHANNELS=mask] [OVERSAMPLE=n] [OUTPUT=n]
+  // Any subset of keys, values in decimal or 0x hex. DURATION_MS=0 records
+  // until STOP, CHANNELS is a bit mask over analogInputs[], OVERSAMPLE is
+  // 0-3 extra bits, OUTPUT is 0 raw, 1 filtered, 2 both. The period is
+  // rounded to what the timer and ADC can do. Replies with the effective
+  // settings:
+  //   CONFIG:PERIOD_US=2000,DURATION_MS=5000,CHANNELS=15,OVERSAMPLE=0,OUTPUT=0
+  // or CONFIG_ERROR:<reason> with nothing changed.
+  void handle_config(const char *args) {
+    if (recording) {
+      Serial.println("CONFIG_ERROR:recording");
+      return;
+    }
+    
+    unsigned long period = sample_period_us;
+    unsigned long duration = recording_dur;
+    unsigned long mask = channel_mask;
+    unsigned long oversample = oversample_bits;
+    unsigned long output = output_mode;
+    
+    while (*args) {
+      if (*args == ' ') {
+        args++;
+        continue;
+      }
+      
+      const char *eq = strchr(args, '=');
+      char *end;
+      unsigned long value = eq ? strtoul(eq + 1, &end, 0) : 0;
+      if (!eq || end == eq + 1 || (*end && *end != ' ')) {
+        Serial.println("CONFIG_ERROR:syntax");
+        return;
+      }
+      
+      size_t key_len = eq - args;
+      if (key_len == 9 && !strncmp(args, "PERIOD_US", key_len)) {
+        period = value;
+      }
+      else if (key_len == 11 && !strncmp(args, "DURATION_MS", key_len)) {
+        duration = value;
+      }
+      else if (key_len == 8 && !strncmp(args, "CHANNELS", key_len)) {
+        mask = value;
+      }
+      else if (key_len == 10 && !strncmp(args, "OVERSAMPLE", key_len)) {
+        oversample = value;
+      }
+      else if (key_len == 6 && !strncmp(args, "OUTPUT", key_len)) {
+        output = value;
+      }
+      else {
+        Serial.println("CONFIG_ERROR:unknown key");
+        return;
+      }
+      args = end;
+    }
+    
+    if (mask == 0 || mask > 0x0F) {
+      Serial.println("CONFIG_ERROR:channels");
+      return;
+    }
+    if (oversample > 3) {
+      Serial.println("CONFIG_ERROR:oversample");
+      return;
+    }
+    if (output > output_both) {
+      Serial.println("CONFIG_ERROR:output");
+      return;
+    }
+    
+    sample_period_us = period;
+    recording_dur = duration;
+    channel_mask = mask;
+    oversample_bits = oversample;
+    output_mode = output;
+    round_sample_period();
+    
+    Serial.print("CONFIG:PERIOD_US=");
+    Serial.print(sample_period_us);
+    Serial.print(",DURATION_MS=");
+    Serial.print(recording_dur);
+    Serial.print(",CHANNELS=");
+    Serial.print(channel_mask);
+    Serial.print(",OVERSAMPLE=");
+    Serial.print(oversample_bits);
+    Serial.print(",OUTPUT=");
+    Serial.println(output_mode);
+  }
+  
+  // SOS <k> <b0> <b1> <b2> <a1> <a2>
+  // Load section k of the low-pass (Q28 integers, a0 = 1 implied, signs as
+  // in scipy: y = b0*x0 + b1*x1 + b2*x2 - a1*y1 - a2*y2). The cascade is cut
+  // to sections 0..k, so upload them in order. SOS DEFAULT goes back to the
+  // compiled in table. Replies SOS:SECTIONS=n or SOS_ERROR:<reason>.
+  void handle_sos(const char *args) {
+    if (recording) {
+      Serial.println("SOS_ERROR:recording");
+      return;
+    }
+    
+    while (*args == ' ') {
+      args++;
+    }
+    if (!strcmp(args, "DEFAULT")) {
+      load_default_sos();
+    }
+    else {
+      char *end;
+      unsigned long k = strtoul(args, &end, 10);
+      long values[5];
+      bool ok = end != args;
+      for (byte i = 0; ok && i < 5; i++) {
+        args = end;
+        values[i] = strtol(args, &end, 10);
+        ok = end != args;
+      }
+      if (!ok || *end) {
+        Serial.println("SOS_ERROR:syntax");
+        return;
+      }
+      if (k >= max_sections) {
+        Serial.println("SOS_ERROR:section");
+        return;
+      }
+      
+      // Stability triangle: |a2| < 1 and |a1| < 1 + a2
+      long one = 1L << coef_bits;
+      long a1 = values[3];
+      long a2 = values[4];
+      if (a2 >= one || a2 <= -one || a1 >= one + a2 || -a1 >= one + a2) {
+        Serial.println("SOS_ERROR:unstable");
+        return;
+      }
+      
+      sos[k].b0 = values[0];
+      sos[k].b1 = values[1];
+      sos[k].b2 = values[2];
+      sos[k].a1 = a1;
+      sos[k].a2 = a2;
+      sos_count = k + 1;
+    }
+    
+    Serial.print("SOS:SECTIONS=");
+    Serial.println(sos_count);
+  }
+  
+  // Incoming command line, filled a byte at a time by poll_command()
+  const byte command_buf_size = 64;
+  char command_buf[command_buf_size];
+  byte command_len = 0;
+  bool command_overflow = false; // line too long, skip to the next '\n'
+  
+  // Move whatever Serial has buffered into command_buf without waiting.
+  // Returns true once a full line is there (trimmed, NUL terminated); the
+  // bytes after it stay in Serial for the next call.
+  bool poll_command() {
+    while (Serial.available() > 0) {
+      char c = Serial.read();
+      
+      if (c == '\n') {
+        bool complete = !command_overflow;
+        command_overflow = false;
+        
+        // Trim trailing \r / spaces, then leading spaces
+        while (command_len > 0 && (command_buf[command_len - 1] == '\r' || command_buf[command_len - 1] == ' ')) {
+          command_len--;
+        }
+        command_buf[command_len] = '\0';
+        command_len = 0;
+        
+        if (complete) {
+          byte start = 0;
+          while (command_buf[start] == ' ') {
+            start++;
+          }
+          if (start) {
+            memmove(command_buf, command_buf + start, strlen(command_buf + start) + 1);
+          }
+          if (command_buf[0]) {
+            return true;
+          }
+        }
+      }
+      else if (command_len < command_buf_size - 1) {
+        command_buf[command_len++] = c;
+      }
+      else {
+        command_overflow = true;
+      }
+    }
+    return false;
+  }
+  
+  void send_marker(unsigned long index) {
+    noInterrupts();
+    unsigned long dropped = samples_dropped;
+    interrupts();
+    
+    Serial.print("SEQ:");
+    Serial.print(index);
+    Serial.print(",DROPPED:");
+    Serial.println(dropped);
+  }
+  
+  void handle_command(const char *command) {
+    if(debug) {
+      Serial.print("received command: ");
+      Serial.println(command);
+    }
+    
+    if (!strcmp(command, "START") || !strcmp(command, "START_BIN") ||
+        !strcmp(command, "STREAM") || !strcmp(command, "STREAM_BIN")) {
+      // Restarting mid-run would rewire the channels and the ring under
+      // the ADC interrupt chain that's still going; STOP first
+      if (recording) {
+        Serial.println("START_ERROR:recording");
+        return;
+      }
+      binary_mode = !strcmp(command, "START_BIN") || !strcmp(command, "STREAM_BIN");
+      streaming = !strncmp(command, "STREAM", 6);
+      last_marker_us = 0;
+      
+      // Start recording
+      recording = true;
+      start_acquisition();
+      
+      // Send header once, naming only the scanned inputs. Filtered columns
+      // are A<n>(V)_iir so the host can tell them from its own filtfilt.
+      Serial.print("Sample,Time(us)");
+      for (byte i = 0; i < output_count; i++) {
+        byte input = active_channels[i % active_count];
+        Serial.print(",A");
+        Serial.print(analogInputs[input] - A0);
+        Serial.print("(V)");
+        if (output_mode == output_filtered || i >= active_count) {
+          Serial.print("_iir");
+        }
+      }
+      Serial.println();
+      
+      // Send confirmation
+      Serial.println("RECORDING_STARTED");
+    }
+    else if (!strcmp(command, "STOP")) {
+      // Ends the recording early (or an unbounded one), loop() then
+      // drains the buffer and sends RECORDING_COMPLETE as usual
+      if (recording) {
+        noInterrupts();
+        stop_acquisition();
+        interrupts();
+      }
+    }
+    else if (!strncmp(command, "CONFIG", 6) && (command[6] == ' ' || command[6] == '\0')) {
+      handle_config(command + 6);
+    }
+    else if (!strncmp(command, "SOS", 3) && command[3] == ' ') {
+      handle_sos(command + 3);
+    }
+  }
   
   void setup() {
     // serial communication at 115200 bps
@@ -29,10 +766,16 @@
     // Optimize ADC for faster sampling
     // Set ADC prescaler to 16 (default is 128)
     //
-    // Bit: 7:enable; 6: initiate a convertion 5: 
+    // Bit: 7:enable; 6: initiate a convertion 5:
     //
     ADCSRA = (ADCSRA & 0xF8) | 0x04;
     
+    // Conversions are chained from ADC_vect
+    ADCSRA |= (1 << ADIE);
+    
+    // Compiled in low-pass until one is uploaded with SOS
+    load_default_sos();
+    
     // Wait for serial connection to establish
     delay(1000);
     
@@ -41,74 +784,43 @@
   }
   
   void loop() {
-    // Check if we received a command
-    if (Serial.available() > 0) {
-      String command = Serial.readStringUntil('\n');
-      command.trim();
-      
-      if (command == "START") {
-        if(debug) Serial.println("received START command");
-
-        // Clear any remaining data in serial buffer
-        while (Serial.available()) {
-          Serial.read();
-        }
-        
-        // Reset sample counter
-        sample_count = 0;
-        
-        // Send header once
-        Serial.println("Sample,Time(ms),A0(V),A1(V),A2(V),A3(V)");
-        
-        // Start recording
-        recording = true;
-        start_time = millis();
-        last_sample_time = start_time;
-        
-        // Send confirmation
-        Serial.println("RECORDING_STARTED");
-      }
+    // Check if we received a command (never waits for the rest of a line)
+    if (poll_command()) {
+      handle_command(command_buf);
     }
     
-    // If we're recording, collect and send data immediately
+    // If we're recording, send what the ISRs have collected so far. Only up
+    // to the head seen now, so a fast producer can't keep us from commands.
     if (recording) {
-      if(debug) Serial.println("Recording!");
-      unsigned long currentTime = millis();
-      unsigned long elapsed_time = currentTime - start_time;
-      
-      // Check if we're still within the recording period
-      if (elapsed_time <= recording_dur) {
-        if(debug) Serial.println("elapsed time << duration");
-        // Only sample at the specified interval
-        if (currentTime - last_sample_time >= min_samp_interval) {
-          last_sample_time = currentTime;
-          
-          // Increment sample counter
-          sample_count++;
-          
-          // Start building the output string
-          String data_string = String(sample_count) + "," + String(elapsed_time);
-          
-          // Multiplex through the four inputs sequentially
-          for (int i = 0; i < 4; i++) {
-            if(debug) Serial.println("reading input: " + String(i));
-            int raw_value = analogRead(analogInputs[i]);
-            float voltage = raw_value * (5.0 / 1023.0);
-            data_string += "," + String(voltage, 3);
-          }
-          
-          // Send the complete data string at once
-          Serial.println(data_string);
+      byte head = ring_head;
+      while (ring_tail != head) {
+        const Sample &sample = ring[ring_tail];
+        prepare_output(sample);
+        if (binary_mode) {
+          send_frame(sample);
+        }
+        else {
+          send_line(sample);
+        }
+        
+        // Unsigned difference, so this survives the us clock wrapping
+        if (streaming && sample.time - last_marker_us >= marker_interval_us) {
+          last_marker_us = sample.time;
+          send_marker(sample.index);
         }
+        ring_tail = (ring_tail + 1) & (ring_size - 1);
       }
-      else {
+      
+      if (acquisition_done && !adc_busy && ring_tail == ring_head) {
         // End of recording
         recording = false;
         
         // Send notification that recording is complete
         Serial.println("RECORDING_COMPLETE");
         Serial.print("SAMPLES_COLLECTED:");
-        Serial.println(sample_count);
+        Serial.println(sample_count - samples_dropped);
+        Serial.print("SAMPLES_DROPPED:");
+        Serial.println(samples_dropped);
         Serial.println("END_OF_DATA");
       }
     }
@@ -0,0 +1,100 @@
+/*
+ * Butterworth low-pass design as constexpr functions, shared by the
+ * firmware (arduino_code.cpp bakes its default filter in at compile time)
+ * and the host tools (host/iir.cpp designs at runtime with the same code).
+ * C++11, so it builds with the Arduino toolchain: every function is a
+ * single return, loops are recursion.
+ *
+ * Same as scipy.signal.butter(order, cutoff, fs=fs, output='sos'): the
+ * analog prototype on the prewarped cutoff, bilinear transform, zeros at
+ * z = -1, sections in scipy's order (the real pole first for odd orders,
+ * then the pole pairs from furthest to nearest the unit circle). The only
+ * difference is the gain: scipy puts it all in the first section, here
+ * every section has unity DC gain, which is what fixed point needs.
+ *
+ * The coefficients are written in terms of t = tan(pi * cutoff / fs) so
+ * that 1 + a1 + a2 (tiny at low cutoffs) never comes from a subtraction.
+ * On AVR double is 32 bits, so there they're good to ~1e-7.
+ *
+ *   constexpr butterworth::Lowpass<4> lp = butterworth::lowpass<4>(2.0, 500.0);
+ *   lp.sos[0].b0 ...
+ */
+#ifndef BUTTERWORTH_H
+#define BUTTERWORTH_H
+
+namespace butterworth {
+
+// a0 is 1
+struct Section {
+  double b0, b1, b2, a1, a2;
+};
+
+template <int Order>
+struct Lowpass {
+  static_assert(Order >= 1, "Butterworth order must be at least 1");
+  static constexpr int sections = (Order + 1) / 2;
+  Section sos[sections];
+};
+
+// 0 .. N - 1 as a parameter pack, C++11 having no std::index_sequence:
+// make_indexes<Lowpass<Order>::sections>::type() expands per section
+template <int... I>
+struct indexes {};
+template <int N, int... I>
+struct make_indexes : make_indexes<N - 1, N - 1, I...> {};
+template <int... I>
+struct make_indexes<0, I...> {
+  typedef indexes<I...> type;
+};
+
+namespace detail {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Taylor series, enough terms for double precision on |x| <= pi
+constexpr double sin_terms(double x2, double term, int n, double sum) {
+  return n > 41 ? sum : sin_terms(x2, -term * x2 / ((n + 1) * (n + 2)), n + 2, sum + term);
+}
+constexpr double sin(double x) { return sin_terms(x * x, x, 1, 0); }
+constexpr double cos(double x) { return sin_terms(x * x, 1, 0, 0); }
+
+// cos(theta) of analog prototype pole k, theta in (pi/2, pi] for the upper
+// half plane ones (k <= (order - 1) / 2), taken as -cos(theta - pi)
+constexpr double pole_cos(int order, int k) { return -cos(pi * (2 * k + order + 1) / (2 * order) - pi); }
+
+constexpr Section first_order(double t) { return Section{t / (1 + t), t / (1 + t), 0, -(1 - t) / (1 + t), 0}; }
+
+// Pole pair at cos(theta) = c: z = (1 + s) / (1 - s) with s = t e^(j theta)
+constexpr Section pair(double t, double c, double d) {
+  return Section{t * t / d, 2 * t * t / d, t * t / d, -2 * (1 - t * t) / d, (1 + 2 * t * c + t * t) / d};
+}
+constexpr Section pair(double t, double c) { return pair(t, c, 1 - 2 * t * c + t * t); }
+
+}  // namespace detail
+
+// Prewarped cutoff, tan(pi * cutoff_hz / fs); cutoff_hz must be below fs / 2
+constexpr double prewarp(double cutoff_hz, double fs) {
+  return detail::sin(detail::pi * cutoff_hz / fs) / detail::cos(detail::pi * cutoff_hz / fs);
+}
+
+// Section index (0 .. (order + 1) / 2 - 1) of an order's design
+constexpr Section section(int order, int index, double t) {
+  return order % 2 && index == 0 ? detail::first_order(t)
+                                 : detail::pair(t, detail::pole_cos(order, order / 2 - 1 - (index - order % 2)));
+}
+
+namespace detail {
+template <int Order, int... I>
+constexpr Lowpass<Order> lowpass(double t, indexes<I...>) {
+  return Lowpass<Order>{{section(Order, I, t)...}};
+}
+}  // namespace detail
+
+template <int Order>
+constexpr Lowpass<Order> lowpass(double cutoff_hz, double fs) {
+  return detail::lowpass<Order>(prewarp(cutoff_hz, fs), typename make_indexes<Lowpass<Order>::sections>::type());
+}
+
+}  // namespace butterworth
+
+#endif  // BUTTERWORTH_H
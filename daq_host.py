@@ -0,0 +1,393 @@
+"""
+Python side of the native helpers in host/build/libdaqhost.so (built with
+make -C host). The scripts check available() and fall back to their pure
+Python code when the library hasn't been built. read_daqc() is plain
+numpy and works either way.
+"""
+import ctypes
+import os
+import struct
+import subprocess
+import numpy as np
+import pandas as pd
+
+LIB_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'host', 'build', 'libdaqhost.so')
+SPECTRUM_PATH = os.path.join(os.path.dirname(LIB_PATH), 'daq_spectrum')
+BATCH_PATH = os.path.join(os.path.dirname(LIB_PATH), 'daq_batch')
+
+_lib = None
+
+def _load():
+    """Load the library once and declare the functions used from it"""
+    global _lib
+    if _lib is None and os.path.exists(LIB_PATH):
+        lib = ctypes.CDLL(LIB_PATH, use_errno=True)
+
+        lib.daq_csv_open.restype = ctypes.c_void_p
+        lib.daq_csv_open.argtypes = [ctypes.c_char_p]
+        for name in ('daq_csv_rows', 'daq_csv_rejected'):
+            getattr(lib, name).restype = ctypes.c_long
+            getattr(lib, name).argtypes = [ctypes.c_void_p]
+        lib.daq_csv_columns.restype = ctypes.c_int
+        lib.daq_csv_columns.argtypes = [ctypes.c_void_p]
+        lib.daq_csv_column_name.restype = ctypes.c_char_p
+        lib.daq_csv_column_name.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.daq_csv_column.restype = ctypes.POINTER(ctypes.c_double)
+        lib.daq_csv_column.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.daq_csv_close.restype = None
+        lib.daq_csv_close.argtypes = [ctypes.c_void_p]
+
+        doubles = ctypes.POINTER(ctypes.c_double)
+        lib.daq_sosfiltfilt.restype = ctypes.c_int
+        lib.daq_sosfiltfilt.argtypes = [doubles, ctypes.c_int, doubles, doubles, ctypes.c_int, ctypes.c_long]
+        lib.daq_sosfiltfilt_padlen.restype = ctypes.c_long
+        lib.daq_sosfiltfilt_padlen.argtypes = [doubles, ctypes.c_int]
+
+        lib.daq_resample_count.restype = ctypes.c_long
+        lib.daq_resample_count.argtypes = [doubles, ctypes.c_long, ctypes.c_double]
+        lib.daq_resample.restype = ctypes.c_long
+        lib.daq_resample.argtypes = [doubles, doubles, ctypes.c_int, ctypes.c_long, ctypes.c_double, ctypes.c_int,
+                                     doubles, doubles]
+
+        ints = ctypes.POINTER(ctypes.c_int)
+        lib.daq_sweep_lowpass.restype = None
+        lib.daq_sweep_lowpass.argtypes = [doubles, ctypes.c_int, ctypes.c_long, ctypes.c_double, doubles,
+                                          ctypes.c_int, ints, ctypes.c_int, ctypes.c_int,
+                                          doubles, doubles, doubles, doubles, doubles]
+
+        lib.daq_lod_open.restype = ctypes.c_void_p
+        lib.daq_lod_open.argtypes = [doubles, ctypes.c_long]
+        lib.daq_lod_add_channel.restype = ctypes.c_int
+        lib.daq_lod_add_channel.argtypes = [ctypes.c_void_p, doubles]
+        lib.daq_lod_max_points.restype = ctypes.c_long
+        lib.daq_lod_max_points.argtypes = [ctypes.c_long]
+        lib.daq_lod_query.restype = ctypes.c_long
+        lib.daq_lod_query.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_double, ctypes.c_double,
+                                      ctypes.c_long, doubles, doubles, doubles]
+        lib.daq_lod_close.restype = None
+        lib.daq_lod_close.argtypes = [ctypes.c_void_p]
+
+        _lib = lib
+    return _lib
+
+def available():
+    """True if libdaqhost.so has been built"""
+    return _load() is not None
+
+def read_csv(filename):
+    """
+    Read a capture CSV in one native pass, instead of clean_data_file()
+    followed by pd.read_csv() and pd.to_numeric() per column
+
+    Parameters:
+    filename (str): Capture file, raw (with control lines and line noise) or cleaned
+
+    Returns:
+    tuple: (pandas.DataFrame of the valid rows with the header's columns,
+            number of rejected lines)
+    """
+    lib = _load()
+    handle = lib.daq_csv_open(os.fsencode(filename))
+    if not handle:
+        errno = ctypes.get_errno()
+        raise OSError(errno, os.strerror(errno), filename)
+
+    try:
+        rows = lib.daq_csv_rows(handle)
+        data = {}
+        for i in range(lib.daq_csv_columns(handle)):
+            name = lib.daq_csv_column_name(handle, i).decode()
+            if rows:
+                data[name] = np.ctypeslib.as_array(lib.daq_csv_column(handle, i), shape=(rows,)).copy()
+            else:
+                data[name] = np.zeros(0)
+        rejected = lib.daq_csv_rejected(handle)
+    finally:
+        lib.daq_csv_close(handle)
+
+    return pd.DataFrame(data), rejected
+
+def read_daqc(filename):
+    """
+    Read a .daqc capture (host/daqc.h) as written by daq_capture. The file
+    is memory mapped and each chunk's code columns are scaled straight into
+    the result, no parsing. A capture that was cut short (no index) is read
+    up to its last complete chunk.
+
+    Parameters:
+    filename (str): The .daqc file
+
+    Returns:
+    pandas.DataFrame: Sample, Time(us) and one column per channel in volts
+                      (code * full_scale / code_max, so the exact values
+                      the CSV prints rounded to 3 or 4 decimals); the
+                      configured period in attrs['period_us'] if recorded
+    """
+    raw = np.memmap(filename, dtype=np.uint8, mode='r')
+    if raw.size < 32 or bytes(raw[:4]) != b'DAQC' or struct.unpack_from('<H', raw, 4)[0] != 1:
+        raise ValueError(f"{filename}: not a version 1 .daqc file")
+    header_size, channels, code_bits, period_us, full_scale, code_max, chunk_rows = \
+        struct.unpack_from('<HHHIdII', raw, 6)
+    names = []
+    at = 32
+    for _ in range(channels):
+        length = int(raw[at])
+        names.append(bytes(raw[at + 1:at + 1 + length]).decode())
+        at += 1 + length
+
+    def chunk_at(offset):
+        """(rows, first_sample, first_time_us, data offset) or None past the last complete chunk"""
+        if offset + 24 > raw.size or bytes(raw[offset:offset + 4]) != b'CHNK':
+            return None
+        rows, first_sample, first_time = struct.unpack_from('<IQQ', raw, offset + 4)
+        if offset + 24 + rows * (8 + 2 * channels) > raw.size:
+            return None
+        return rows, first_sample, first_time, offset + 24
+
+    chunks = []
+    if raw.size >= header_size + 16 and bytes(raw[-8:]) == b'DAQCEND\0':
+        index_offset = struct.unpack_from('<Q', raw, raw.size - 16)[0]
+        if bytes(raw[index_offset:index_offset + 4]) == b'IDX ':
+            count = struct.unpack_from('<I', raw, index_offset + 4)[0]
+            offsets = np.frombuffer(raw, dtype='<u8', count=2 * count, offset=index_offset + 8)[::2]
+            chunks = [chunk_at(int(offset)) for offset in offsets]
+            if None in chunks:
+                chunks = []
+    if not chunks:
+        offset = header_size
+        chunk = chunk_at(offset)
+        while chunk is not None:
+            chunks.append(chunk)
+            offset += (24 + chunk[0] * (8 + 2 * channels) + 7) & ~7
+            chunk = chunk_at(offset)
+
+    total = sum(chunk[0] for chunk in chunks)
+    sample = np.empty(total, dtype=np.int64)
+    time_us = np.empty(total, dtype=np.int64)
+    volts = np.empty((channels, total))
+    scale = full_scale / code_max
+    at = 0
+    for rows, first_sample, first_time, data in chunks:
+        columns = np.frombuffer(raw, dtype='<u4', count=2 * rows, offset=data)
+        sample[at:at + rows] = columns[:rows]
+        sample[at:at + rows] += first_sample
+        time_us[at:at + rows] = columns[rows:]
+        time_us[at:at + rows] += first_time
+        codes = np.frombuffer(raw, dtype='<i2', count=channels * rows, offset=data + 8 * rows)
+        np.multiply(codes.reshape(channels, rows), scale, out=volts[:, at:at + rows])
+        at += rows
+
+    df = pd.DataFrame({'Sample': sample, 'Time(us)': time_us})
+    for i, name in enumerate(names):
+        df[name] = volts[i]
+    # The sample period the recording was configured with, when known
+    if period_us:
+        df.attrs['period_us'] = period_us
+    return df
+
+def sosfiltfilt(sos, data):
+    """
+    Zero-phase filter like scipy.signal.sosfiltfilt(sos, data, axis=0), with
+    all the channels filtered in one native pass
+
+    Parameters:
+    sos (numpy.ndarray): Second order sections, as from signal.butter(..., output='sos')
+    data (numpy.ndarray): One channel, or one column per channel
+
+    Returns:
+    numpy.ndarray: The filtered data, same shape as data
+    """
+    lib = _load()
+    doubles = ctypes.POINTER(ctypes.c_double)
+    sos = np.ascontiguousarray(sos, dtype=np.float64)
+    # Channel after channel in memory, as the library wants them
+    x = np.ascontiguousarray(np.asarray(data, dtype=np.float64).T)
+    out = np.empty_like(x)
+    channels = 1 if x.ndim == 1 else x.shape[0]
+
+    if lib.daq_sosfiltfilt(sos.ctypes.data_as(doubles), len(sos), x.ctypes.data_as(doubles),
+                           out.ctypes.data_as(doubles), channels, x.shape[-1]) < 0:
+        padlen = lib.daq_sosfiltfilt_padlen(sos.ctypes.data_as(doubles), len(sos))
+        raise ValueError(f"The length of the input vector x must be greater than padlen, which is {padlen}.")
+    return out.T
+
+RESAMPLE_METHODS = ('linear', 'cubic', 'sinc')
+
+def resample(time, data, period, method='cubic'):
+    """
+    Resample jittered or gappy samples onto the exact grid time[0] + k * period
+    (host/resample.h), so a filter designed for 1 / period sees that rate
+
+    Parameters:
+    time (numpy.ndarray): Sample times, increasing
+    data (numpy.ndarray): One channel, or one column per channel
+    period (float): Output sample period, in time's unit
+    method (str): 'linear', 'cubic' (Catmull-Rom) or 'sinc' (windowed, band limited)
+
+    Returns:
+    tuple: (grid times, resampled data shaped like data with one row per grid time)
+    """
+    lib = _load()
+    doubles = ctypes.POINTER(ctypes.c_double)
+    t = np.ascontiguousarray(time, dtype=np.float64)
+    x = np.ascontiguousarray(np.asarray(data, dtype=np.float64).T)
+    channels = 1 if x.ndim == 1 else x.shape[0]
+    count = lib.daq_resample_count(t.ctypes.data_as(doubles), len(t), period)
+    grid = np.empty(count)
+    out = np.empty((channels, count))
+
+    n = lib.daq_resample(t.ctypes.data_as(doubles), x.ctypes.data_as(doubles), channels, len(t), period,
+                         RESAMPLE_METHODS.index(method), grid.ctypes.data_as(doubles), out.ctypes.data_as(doubles))
+    out = out[:, :n]
+    return grid[:n], out[0] if x.ndim == 1 else out.T
+
+def sweep_lowpass(data, fs, cutoffs, orders, names=None, threads=0):
+    """
+    Zero-phase Butterworth low-pass at every cutoff x order on all channels,
+    on a pool of threads (host/sweep.h), ranked: best first is the one whose
+    residual (what it removed) is closest to each channel's noise floor
+
+    Parameters:
+    data (numpy.ndarray): One channel, or one column per channel
+    fs (float): The sampling frequency in Hz
+    cutoffs (list): Cutoff frequencies in Hz
+    orders (list): Filter orders
+    names (list): Channel names for the residual columns
+    threads (int): Worker threads, 0 for one per core
+
+    Returns:
+    pandas.DataFrame: One row per configuration that can be applied
+    """
+    lib = _load()
+    doubles = ctypes.POINTER(ctypes.c_double)
+    x = np.ascontiguousarray(np.atleast_2d(np.asarray(data, dtype=np.float64).T))
+    channels, samples = x.shape
+    names = names or [f'Channel {c}' for c in range(channels)]
+    cutoffs = np.ascontiguousarray(cutoffs, dtype=np.float64)
+    orders = np.ascontiguousarray(orders, dtype=np.intc)
+    configs = len(cutoffs) * len(orders)
+    lag, overshoot, causal_overshoot = np.empty(configs), np.empty(configs), np.empty(configs)
+    residual = np.empty((configs, channels))
+    noise = np.empty(channels)
+
+    lib.daq_sweep_lowpass(x.ctypes.data_as(doubles), channels, samples, fs,
+                          cutoffs.ctypes.data_as(doubles), len(cutoffs),
+                          orders.ctypes.data_as(ctypes.POINTER(ctypes.c_int)), len(orders), threads,
+                          lag.ctypes.data_as(doubles), overshoot.ctypes.data_as(doubles),
+                          causal_overshoot.ctypes.data_as(doubles), residual.ctypes.data_as(doubles),
+                          noise.ctypes.data_as(doubles))
+
+    # How far off the noise floor, either way: 0.5x and 2x are as bad
+    ratio = residual / noise
+    table = pd.DataFrame({
+        'Cutoff (Hz)': np.repeat(cutoffs, len(orders)),
+        'Order': np.tile(orders, len(cutoffs)),
+        'Residual/noise': ratio.mean(axis=1),
+        'Overshoot (%)': overshoot,
+        'Causal lag (ms)': lag,
+        'Causal overshoot (%)': causal_overshoot,
+    })
+    for c, name in enumerate(names):
+        table[f'{name} residual (V)'] = residual[:, c]
+    table['Score'] = np.abs(np.log(ratio)).mean(axis=1)
+    table = table.dropna(subset=['Score']).sort_values(['Score', 'Causal lag (ms)'])
+    return table.reset_index(drop=True)
+
+def spectrum(filename, nperseg=1024, average=1):
+    """
+    Welch PSD and spectrogram of every channel of a capture, computed by
+    host/build/daq_spectrum (which streams the file, so any length works)
+
+    Parameters:
+    filename (str): A .daqc or CSV capture
+    nperseg (int): Segment length, a power of two; frequency resolution is fs / nperseg
+    average (int): Segments averaged into each spectrogram row
+
+    Returns:
+    tuple: (PSD DataFrame with Frequency(Hz) and a V^2/Hz column per channel,
+            spectrogram row times in s, spectrogram [rows, channels, bins] memory mapped)
+    """
+    subprocess.run([SPECTRUM_PATH, '--nperseg', str(nperseg), '--average', str(average), filename], check=True)
+    prefix = os.path.splitext(filename)[0]
+    psd = pd.read_csv(prefix + '_psd.csv')
+    times = np.load(prefix + '_spectrogram_time.npy')
+    spectrogram = np.load(prefix + '_spectrogram.npy', mmap_mode='r')
+    return psd, times, spectrogram
+
+def batch(directory, cutoff_freq=1.5, filter_order=4, force=False):
+    """
+    Filter every capture in a directory on all cores with host/build/daq_batch,
+    as filter_and_save_data() does one (FILE_filtered.csv next to each).
+    Files already done with the same settings are skipped.
+
+    Parameters:
+    directory (str): Where the arduino_daq_data_* .csv / .daqc captures are
+    cutoff_freq (float): The cutoff frequency in Hz
+    filter_order (int): The filter order
+    force (bool): Reprocess files that are up to date too
+
+    Returns:
+    pandas.DataFrame: batch_summary.csv, a row per file and channel (None if
+                      nothing was processed); files that failed aren't in it
+    """
+    args = [BATCH_PATH, '--cutoff', str(cutoff_freq), '--order', str(filter_order), directory]
+    if force:
+        args.insert(1, '--force')
+    # Exit status 1 only says some files failed, they were reported
+    subprocess.run(args)
+    summary = os.path.join(directory, 'batch_summary.csv')
+    return pd.read_csv(summary) if os.path.exists(summary) else None
+
+class MinMaxPyramid:
+    """
+    Min/max envelopes of a capture's channels at every level of detail
+    (host/lod.h), so a plot draws a few thousand points per line however
+    long the capture is
+
+    Parameters:
+    time (array): Sample times, non-decreasing
+    channels (dict): Column name -> values, same length as time
+    """
+    def __init__(self, time, channels):
+        lib = _load()
+        doubles = ctypes.POINTER(ctypes.c_double)
+        # The library works on these arrays in place, keep them alive
+        self._time = np.ascontiguousarray(time, dtype=np.float64)
+        self._columns = {}
+        self._handle = lib.daq_lod_open(self._time.ctypes.data_as(doubles), len(self._time))
+        for name, values in channels.items():
+            values = np.ascontiguousarray(values, dtype=np.float64)
+            self._columns[name] = (lib.daq_lod_add_channel(self._handle, values.ctypes.data_as(doubles)), values)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.daq_lod_close(self._handle)
+            self._handle = None
+
+    def __contains__(self, name):
+        return name in self._columns
+
+    def query(self, name, t0, t1, width):
+        """
+        Envelope of a channel over the window [t0, t1] for a plot width pixels wide
+
+        Returns:
+        tuple: (bucket start times, minimums, maximums) arrays, at most
+               4 * width + 2 long; raw samples (min == max) for short windows
+        """
+        lib = _load()
+        doubles = ctypes.POINTER(ctypes.c_double)
+        room = lib.daq_lod_max_points(max(int(width), 1))
+        time, low, high = np.empty(room), np.empty(room), np.empty(room)
+        count = lib.daq_lod_query(self._handle, self._columns[name][0], t0, t1, max(int(width), 1),
+                                  time.ctypes.data_as(doubles), low.ctypes.data_as(doubles),
+                                  high.ctypes.data_as(doubles))
+        return time[:count], low[:count], high[:count]
+
+    def polyline(self, name, t0, t1, width):
+        """
+        query() as x, y for plt.plot: a vertical min-max stroke per bucket,
+        which draws the same as plotting every sample
+        """
+        time, low, high = self.query(name, t0, t1, width)
+        return np.repeat(time, 2), np.column_stack((low, high)).ravel()
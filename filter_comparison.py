@@ -5,6 +5,7 @@ from scipy import signal
 import os
 import tkinter as tk
 from tkinter import filedialog
+import daq_host
 
 def apply_lowpass_filter(data, cutoff_freq, fs, order=4):
     """
@@ -38,7 +39,8 @@ def load_csv_file(filepath=None):
     filepath (str, optional): Path to the CSV file. If None, opens a file dialog.
     
     Returns:
-    pandas.DataFrame: The loaded data
+    tuple: (pandas.DataFrame, str) the loaded data and the file it came from,
+    (None, None) if nothing was loaded
     """
     if filepath is None:
         # Use Tkinter file dialog to select file
@@ -49,7 +51,7 @@ def load_csv_file(filepath=None):
             filetypes=[("CSV files", "*.csv"), ("All files", "*.*")]
         )
         if not filepath:  # User cancelled
-            return None
+            return None, None
     
     try:
         # Try standard header names first
@@ -67,13 +69,79 @@ def load_csv_file(filepath=None):
         # Drop rows with NaN values
         df = df.dropna()
         
-        return df
+        # Newer firmware timestamps in microseconds, keep a ms column for plotting
+        if 'Time(us)' in df.columns:
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+        
+        return df, filepath
     
     except Exception as e:
         print(f"Error loading CSV file: {e}")
+        return None, None
+
+def sampling_frequency(df):
+    """
+    Sampling frequency of a capture from its timestamps
+    
+    Parameters:
+    df (pandas.DataFrame): DataFrame containing the data
+    
+    Returns:
+    float: The sampling frequency in Hz
+    """
+    if 'Time(us)' in df.columns:
+        # Hardware sample clock: most steps are exactly one period (the
+        # median of the positive ones, so drops and garbled rows don't count)
+        time_diffs = np.diff(df['Time(us)'])
+        return 1e6 / np.median(time_diffs[time_diffs > 0])
+    time_col = 'Time(ms)' if 'Time(ms)' in df.columns else df.columns[1]
+    time_diffs = np.diff(df[time_col])
+    median_time_diff = np.median(time_diffs)  # in milliseconds
+    return 1000.0 / median_time_diff  # Convert to Hz
+
+def sweep_filters(df, cutoffs, orders, filepath=None):
+    """
+    Try every cutoff and order on all voltage channels at once (native,
+    multithreaded) and print the configurations ranked, best first
+    
+    Parameters:
+    df (pandas.DataFrame): DataFrame containing the data
+    cutoffs (list): Cutoff frequencies in Hz
+    orders (list): Filter orders
+    filepath (str, optional): The capture's path, names the saved table
+    
+    Returns:
+    pandas.DataFrame: The ranked table, or None
+    """
+    if df is None or df.empty:
+        print("No valid data to process")
         return None
+    if not daq_host.available():
+        print("The sweep needs the native library, build it with: make -C host")
+        return None
+    
+    voltage_cols = [col for col in df.columns if col.startswith('A') and col.endswith('(V)')]
+    if not voltage_cols:
+        print("No voltage columns found in the CSV file")
+        return None
+    
+    fs = sampling_frequency(df)
+    print(f"Sweeping {len(cutoffs)} cutoffs x {len(orders)} orders over {len(voltage_cols)} channels "
+          f"at {fs:.1f} Hz...")
+    table = daq_host.sweep_lowpass(df[voltage_cols].values, fs, cutoffs, orders, names=voltage_cols)
+    
+    # Residual/noise near 1: removes the noise and leaves the signal; below,
+    # noise is left in; above, signal is being removed too
+    with pd.option_context('display.max_rows', None, 'display.width', 200):
+        print(table.to_string(index=False, float_format=lambda v: f"{v:.4g}"))
+    
+    input_filename = os.path.basename(filepath) if filepath else "unknown"
+    table_filename = f"filter_sweep_{input_filename.split('.')[0]}.csv"
+    table.to_csv(table_filename, index=False)
+    print(f"Table saved as {table_filename}")
+    return table
 
-def compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2):
+def compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2, filepath=None):
     """
     Compare different filter settings on the same dataset
     
@@ -83,6 +151,7 @@ def compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2):
     cutoff_freq2 (float): Second cutoff frequency in Hz
     order1 (int): First filter order
     order2 (int): Second filter order
+    filepath (str, optional): The capture's path, names the saved plot
     """
     # Check if DataFrame is valid
     if df is None or df.empty:
@@ -101,10 +170,7 @@ def compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2):
     # Get the time column
     time_col = 'Time(ms)' if 'Time(ms)' in df.columns else df.columns[1]
     
-    # Calculate the sampling frequency
-    time_diffs = np.diff(df[time_col])
-    median_time_diff = np.median(time_diffs)  # in milliseconds
-    fs = 1000.0 / median_time_diff  # Convert to Hz
+    fs = sampling_frequency(df)
     print(f"Estimated sampling frequency: {fs:.1f} Hz")
     
     # Get the raw data
@@ -161,7 +227,7 @@ def compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2):
     fig.text(0.02, 0.02, data_info, fontsize=10, bbox=dict(facecolor='white', alpha=0.8))
     
     # Save the plot
-    input_filename = os.path.basename(filepath) if 'filepath' in locals() else "unknown"
+    input_filename = os.path.basename(filepath) if filepath else "unknown"
     plot_filename = f"filter_comparison_{input_filename.split('.')[0]}.png"
     plt.savefig(plot_filename, dpi=300, bbox_inches='tight')
     print(f"Plot saved as {plot_filename}")
@@ -176,17 +242,29 @@ if __name__ == "__main__":
     
     # Let the user select a CSV file
     print("Please select a CSV file to analyze...")
-    df = load_csv_file()
+    df, filepath = load_csv_file()
     
     if df is not None:
+        # Optionally rank a whole grid first, then compare the best two
+        defaults = ["1.0", "2.0", "2", "4"]
+        if input("Sweep a grid of cutoffs and orders first? (y/n): ").lower() == 'y':
+            cutoffs = [float(v) for v in (input("Cutoffs in Hz (0.5,1,1.5,2,3,5,10): ") or
+                                          "0.5,1,1.5,2,3,5,10").split(',')]
+            orders = [int(v) for v in (input("Orders (1,2,3,4,5,6,8): ") or "1,2,3,4,5,6,8").split(',')]
+            table = sweep_filters(df, cutoffs, orders, filepath=filepath)
+            if table is not None and len(table) > 1:
+                best = table.iloc[:2]
+                defaults = [str(best['Cutoff (Hz)'][0]), str(best['Cutoff (Hz)'][1]),
+                            str(best['Order'][0]), str(best['Order'][1])]
+        
         # Get filter parameters from user
         print("\nEnter filter parameters:")
-        cutoff_freq1 = float(input("First cutoff frequency (Hz): ") or "1.0")
-        cutoff_freq2 = float(input("Second cutoff frequency (Hz): ") or "2.0")
-        order1 = int(input("First filter order: ") or "2")
-        order2 = int(input("Second filter order: ") or "4")
+        cutoff_freq1 = float(input(f"First cutoff frequency (Hz) [{defaults[0]}]: ") or defaults[0])
+        cutoff_freq2 = float(input(f"Second cutoff frequency (Hz) [{defaults[1]}]: ") or defaults[1])
+        order1 = int(input(f"First filter order [{defaults[2]}]: ") or defaults[2])
+        order2 = int(input(f"Second filter order [{defaults[3]}]: ") or defaults[3])
         
         # Compare the filters
-        compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2)
+        compare_filters(df, cutoff_freq1, cutoff_freq2, order1, order2, filepath=filepath)
     else:
         print("No CSV file selected or error loading file.")
\ No newline at end of file
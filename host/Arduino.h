@@ -0,0 +1,204 @@
+/*
+ * Host-side stand-in for the Arduino core, just enough for arduino_code.cpp
+ * to build and run as a native Linux program.
+ *
+ * The sketch is compiled unmodified with `-include Arduino.h`. Time is
+ * virtual (16 MHz CPU cycles) and only moves when the harness calls
+ * sim::advance_us(), when the sketch calls delay(), or when Serial output
+ * has to wait for the modelled UART. Timer1 compare matches and ADC
+ * conversions are emulated from the register values the sketch writes and
+ * call the sketch's ISR() handlers at the right virtual time.
+ */
+#ifndef ARDUINO_HOST_SHIM_H
+#define ARDUINO_HOST_SHIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LOW 0x0
+#define HIGH 0x1
+
+// Uno pin numbers for the analog inputs
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+// ATmega328P registers used by the sketch
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADMUX;
+extern volatile uint16_t ADC;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t TIFR1;
+extern volatile uint8_t TIMSK1;
+
+// ADCSRA
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+// ADMUX
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+// TCCR1B
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+// TIMSK1 / TIFR1
+#define OCIE1A 1
+#define OCF1A 1
+
+// Interrupt vectors the shim knows how to raise. Weak so a sketch that
+// doesn't define one still links.
+#define ISR(vector) void vector()
+void TIMER1_COMPA_vect() __attribute__((weak));
+void ADC_vect() __attribute__((weak));
+
+void noInterrupts();
+void interrupts();
+
+// Provided by the sketch
+void setup();
+void loop();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+int analogRead(uint8_t pin);
+
+class String {
+ public:
+  String(const char *s = "") : s_(s) {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int value, unsigned char base = 10);
+  String(unsigned int value, unsigned char base = 10);
+  String(long value, unsigned char base = 10);
+  String(unsigned long value, unsigned char base = 10);
+  String(float value, unsigned char decimals = 2);
+  String(double value, unsigned char decimals = 2);
+
+  unsigned int length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  void trim();
+  bool startsWith(const String &prefix) const { return s_.compare(0, prefix.s_.size(), prefix.s_) == 0; }
+  int toInt() const { return atoi_(); }
+
+  String &operator+=(const String &rhs) { s_ += rhs.s_; return *this; }
+  String &operator+=(const char *rhs) { s_ += rhs; return *this; }
+  String &operator+=(char rhs) { s_ += rhs; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.s_); }
+  bool operator==(const String &rhs) const { return s_ == rhs.s_; }
+  bool operator==(const char *rhs) const { return s_ == rhs; }
+  bool operator!=(const String &rhs) const { return s_ != rhs.s_; }
+  bool operator!=(const char *rhs) const { return s_ != rhs; }
+
+ private:
+  int atoi_() const;
+  std::string s_;
+};
+
+#define DEC 10
+#define HEX 16
+
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int peek();
+  String readStringUntil(char terminator);
+  void setTimeout(unsigned long ms) { timeout_ms_ = ms; }
+
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *buf, size_t len);
+  size_t print(const char *s);
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print(String((long)v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String((unsigned long)v, base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(const T &v) { return print(v) + println(); }
+  template <typename T>
+  size_t println(const T &v, int arg) { return print(v, arg) + println(); }
+
+  operator bool() const { return true; }
+
+ private:
+  unsigned long timeout_ms_ = 1000;
+};
+
+extern HardwareSerial Serial;
+
+// Harness side: everything the sketch can't see
+namespace sim {
+
+// Power-on state: registers as the Arduino core leaves them, clock at 0,
+// serial buffers empty, default analog sources
+void reset();
+
+// Run virtual time forward, raising ISRs as they come due
+void advance_us(double us);
+uint64_t now_cycles();
+double now_seconds();
+
+// Analog source for input `channel` (0 = A0), returns volts at time t
+void set_analog_source(int channel, std::function<double(double t)> source);
+
+// Bytes the host "types" into the sketch's serial port
+void serial_input(const std::string &data);
+
+// Bytes the sketch printed. By default they are collected in an internal
+// buffer; set_serial_sink() redirects them (e.g. to a pty).
+const std::string &serial_output();
+void clear_serial_output();
+void set_serial_sink(std::function<void(const uint8_t *, size_t)> sink);
+uint64_t serial_bytes_written();
+
+// When false Serial writes never block on the modelled UART (default true)
+void set_uart_model(bool enabled);
+
+// Model the UART at baud whatever Serial.begin() asks for, 0 = follow
+// Serial.begin() (default). Kept across reset().
+void set_uart_baud(unsigned long baud);
+
+}  // namespace sim
+
+#endif  // ARDUINO_HOST_SHIM_H
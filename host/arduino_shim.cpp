@@ -0,0 +1,311 @@
+/*
+ * Host-side Arduino core, see Arduino.h for the model.
+ */
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+
+volatile uint8_t ADCSRA;
+volatile uint8_t ADMUX;
+volatile uint16_t ADC;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint8_t TIFR1;
+volatile uint8_t TIMSK1;
+
+HardwareSerial Serial;
+
+namespace {
+
+const uint64_t cpu_hz = 16000000;
+const uint64_t no_event = UINT64_MAX;
+const size_t uart_tx_buffer = 64;  // same as the AVR core
+
+uint64_t now = 0;
+bool interrupts_enabled = true;
+bool in_isr = false;
+
+double seconds() { return (double)now / cpu_hz; }
+
+// Timer1: the compare period is re-derived whenever the sketch changes
+// TCCR1B or OCR1A
+uint8_t timer_tccr1b = 0;
+uint16_t timer_ocr1a = 0;
+uint64_t timer_next = no_event;
+
+// ADC: one conversion in flight at a time
+uint64_t adc_done = no_event;
+uint8_t adc_channel = 0;
+
+std::function<double(double)> sources[6];
+
+std::deque<uint8_t> rx;
+std::string tx_collected;
+std::function<void(const uint8_t *, size_t)> tx_sink;
+uint64_t tx_bytes = 0;
+uint64_t tx_idle_at = 0;  // cycle at which the UART has sent everything
+uint64_t byte_cycles = cpu_hz * 10 / 115200;
+bool uart_model = true;
+unsigned long forced_baud = 0;
+
+uint64_t timer1_prescale(uint8_t tccr1b) {
+  switch (tccr1b & 0x07) {
+    case 1: return 1;
+    case 2: return 8;
+    case 3: return 64;
+    case 4: return 256;
+    case 5: return 1024;
+    default: return 0;  // stopped (external clock not modelled)
+  }
+}
+
+uint64_t adc_conversion_cycles() {
+  static const uint64_t prescale[8] = {2, 2, 4, 8, 16, 32, 64, 128};
+  return 13 * prescale[ADCSRA & 0x07];
+}
+
+int sample_code(int channel) {
+  if (channel < 0 || channel >= 6 || !sources[channel]) return 0;
+  double volts = sources[channel](seconds());
+  long code = lround(volts * 1023.0 / 5.0);
+  return (int)std::min(1023L, std::max(0L, code));
+}
+
+// Pick up register writes the sketch made since the last look
+void sync_peripherals() {
+  uint64_t prescale = timer1_prescale(TCCR1B);
+  bool timer_on = prescale && (TIMSK1 & (1 << OCIE1A)) && (TCCR1B & (1 << WGM12));
+  if (!timer_on) {
+    timer_next = no_event;
+  } else if (timer_next == no_event || TCCR1B != timer_tccr1b || OCR1A != timer_ocr1a) {
+    timer_next = now + ((uint64_t)OCR1A + 1) * prescale;
+  }
+  timer_tccr1b = TCCR1B;
+  timer_ocr1a = OCR1A;
+
+  if ((ADCSRA & (1 << ADSC)) && (ADCSRA & (1 << ADEN)) && adc_done == no_event) {
+    adc_channel = ADMUX & 0x0F;
+    adc_done = now + adc_conversion_cycles();
+  }
+}
+
+void run_until(uint64_t target) {
+  for (;;) {
+    sync_peripherals();
+    uint64_t next = std::min(timer_next, adc_done);
+    if (next > target || in_isr || !interrupts_enabled) break;
+    if (next > now) now = next;  // late if interrupts were held off
+
+    in_isr = true;
+    if (next == adc_done) {
+      ADC = sample_code(adc_channel);
+      ADCSRA &= ~(1 << ADSC);
+      adc_done = no_event;
+      if ((ADCSRA & (1 << ADIE)) && ADC_vect) ADC_vect();
+    } else {
+      timer_next += ((uint64_t)OCR1A + 1) * timer1_prescale(TCCR1B);
+      if (TIMER1_COMPA_vect) TIMER1_COMPA_vect();
+    }
+    in_isr = false;
+  }
+  if (target > now) now = target;
+}
+
+}  // namespace
+
+void noInterrupts() { interrupts_enabled = false; }
+void interrupts() { interrupts_enabled = true; }
+
+unsigned long millis() { return (unsigned long)(now / (cpu_hz / 1000)); }
+unsigned long micros() { return (unsigned long)(now / (cpu_hz / 1000000)); }
+void delay(unsigned long ms) { sim::advance_us(ms * 1000.0); }
+void delayMicroseconds(unsigned int us) { sim::advance_us(us); }
+void pinMode(uint8_t, uint8_t) {}
+
+int analogRead(uint8_t pin) {
+  int channel = pin >= A0 ? pin - A0 : pin;
+  // A polled conversion still takes 13 ADC clocks
+  sim::advance_us((double)adc_conversion_cycles() * 1e6 / cpu_hz);
+  return sample_code(channel);
+}
+
+// ---- String ----
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) {
+  if (base == 10) {
+    s_ = std::to_string(value);
+  } else {
+    String u((unsigned long)value, base);
+    s_ = u.s_;
+  }
+}
+
+String::String(unsigned long value, unsigned char base) {
+  if (base < 2 || base > 36) base = 10;
+  char buf[33];
+  int pos = sizeof(buf) - 1;
+  buf[pos] = '\0';
+  do {
+    int digit = value % base;
+    buf[--pos] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+  s_ = buf + pos;
+}
+
+String::String(float value, unsigned char decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned char decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  s_ = buf;
+}
+
+void String::trim() {
+  size_t begin = s_.find_first_not_of(" \t\r\n\f\v");
+  if (begin == std::string::npos) {
+    s_.clear();
+    return;
+  }
+  size_t end = s_.find_last_not_of(" \t\r\n\f\v");
+  s_ = s_.substr(begin, end - begin + 1);
+}
+
+int String::atoi_() const { return atoi(s_.c_str()); }
+
+// ---- Serial ----
+
+void HardwareSerial::begin(unsigned long baud) {
+  if (forced_baud) baud = forced_baud;
+  if (baud) byte_cycles = cpu_hz * 10 / baud;
+}
+
+int HardwareSerial::available() { return (int)rx.size(); }
+
+int HardwareSerial::read() {
+  if (rx.empty()) return -1;
+  int c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+int HardwareSerial::peek() { return rx.empty() ? -1 : rx.front(); }
+
+String HardwareSerial::readStringUntil(char terminator) {
+  std::string out;
+  for (;;) {
+    if (rx.empty()) {
+      // Stream::timedRead() gives up after the timeout; nothing more can
+      // arrive while the sketch is blocked here, so just burn the time
+      sim::advance_us(timeout_ms_ * 1000.0);
+      break;
+    }
+    char c = (char)read();
+    if (c == terminator) break;
+    out += c;
+  }
+  return String(out);
+}
+
+size_t HardwareSerial::write(uint8_t b) { return write(&b, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (uart_model) {
+      // Block while the 64 byte TX buffer is full, ISRs keep running
+      if (tx_idle_at < now) tx_idle_at = now;
+      uint64_t limit = uart_tx_buffer * byte_cycles;
+      if (tx_idle_at - now > limit) run_until(tx_idle_at - limit);
+      tx_idle_at += byte_cycles;
+    }
+  }
+  if (tx_sink) {
+    tx_sink(buf, len);
+  } else {
+    tx_collected.append((const char *)buf, len);
+  }
+  tx_bytes += len;
+  return len;
+}
+
+size_t HardwareSerial::print(const char *s) {
+  size_t len = 0;
+  while (s[len]) len++;
+  return write((const uint8_t *)s, len);
+}
+
+// ---- harness API ----
+
+namespace sim {
+
+void reset() {
+  now = 0;
+  interrupts_enabled = true;
+  in_isr = false;
+
+  // wiring.c: ADC enabled, prescaler 128
+  ADCSRA = (1 << ADEN) | 0x07;
+  ADMUX = 0;
+  ADC = 0;
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = 0;
+  OCR1A = 0;
+  TIFR1 = 0;
+  TIMSK1 = 0;
+  timer_tccr1b = 0;
+  timer_ocr1a = 0;
+  timer_next = no_event;
+  adc_done = no_event;
+
+  // Slow sines, a quarter period apart, 0.5-4.5 V
+  for (int i = 0; i < 6; i++) {
+    sources[i] = [i](double t) { return 2.5 + 2.0 * sin(2 * M_PI * 0.5 * t + i * M_PI / 2); };
+  }
+
+  rx.clear();
+  tx_collected.clear();
+  tx_sink = nullptr;
+  tx_bytes = 0;
+  tx_idle_at = 0;
+  byte_cycles = cpu_hz * 10 / (forced_baud ? forced_baud : 115200);
+  uart_model = true;
+}
+
+void advance_us(double us) { run_until(now + (uint64_t)(us * (cpu_hz / 1000000))); }
+
+uint64_t now_cycles() { return now; }
+
+double now_seconds() { return seconds(); }
+
+void set_analog_source(int channel, std::function<double(double t)> source) {
+  if (channel >= 0 && channel < 6) sources[channel] = std::move(source);
+}
+
+void serial_input(const std::string &data) { rx.insert(rx.end(), data.begin(), data.end()); }
+
+const std::string &serial_output() { return tx_collected; }
+
+void clear_serial_output() { tx_collected.clear(); }
+
+void set_serial_sink(std::function<void(const uint8_t *, size_t)> sink) { tx_sink = std::move(sink); }
+
+uint64_t serial_bytes_written() { return tx_bytes; }
+
+void set_uart_model(bool enabled) { uart_model = enabled; }
+
+void set_uart_baud(unsigned long baud) {
+  forced_baud = baud;
+  if (baud) byte_cycles = cpu_hz * 10 / baud;
+}
+
+}  // namespace sim
@@ -0,0 +1,431 @@
+/*
+ * End-to-end benchmark: daq_sim as the board, daq_capture as the
+ * receiver, over a matrix of sample periods, channel masks and wire
+ * formats, one fresh pair of processes per case.
+ *
+ * For each case it reports sustained rows/s and bytes/s, how many rows
+ * never made it to the file (drop rate, with the board's, the link's and
+ * the host's share), and device-to-disk latency: the time from a row's
+ * sampling instant to when this program sees the row in the output
+ * file. daq_sim prints where the recording's Time(us) = 0 falls on the
+ * monotonic clock, so a row sampled at Time(us) = t is due at that plus
+ * t / speed; the file is watched every millisecond. That includes the
+ * UART, the pty, daq_capture's pipeline and its periodic flushes (which
+ * dominate). Rows count as sent once the sketch writes them into its
+ * 64 byte TX buffer, so latency is low by up to that many byte times.
+ *
+ * One JSON object per case goes to stdout, for appending to a results
+ * file and comparing across commits; a table goes to stderr.
+ *
+ *   bench_capture --label "$(git describe --always --dirty)" >> bench.jsonl
+ *
+ * usage: bench_capture [options]
+ *   --periods LIST      sample periods in us (default 1000,500,250)
+ *   --channels LIST     CHANNELS masks (default 1,15)
+ *   --formats LIST      wire formats, text and/or bin (default text,bin)
+ *   --outputs LIST      file formats, daqc and/or csv (default daqc)
+ *   --duration-ms N     recording length in board time (default 2000)
+ *   --speed X           daq_sim --speed (default 1)
+ *   --no-uart           daq_sim --no-uart, the host path without the 115200 baud limit
+ *   --label TEXT        copied into every result, e.g. the commit
+ *
+ * daq_sim and daq_capture are run from the directory this program is in.
+ */
+#include "daqc.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+namespace {
+
+struct Case {
+  long period_us;
+  long channels;  // CHANNELS mask
+  bool binary;
+  bool csv;
+};
+
+struct Result {
+  bool ok = false;
+  uint64_t rows = 0;
+  uint64_t expected = 0;
+  long device_dropped = 0;
+  long link_lost = 0;
+  long host_dropped_bytes = 0;
+  double wire_bytes = 0;
+  double seconds = 0;  // recording start to the last row on disk
+  std::vector<double> latency_ms;
+};
+
+double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void sleep_ms(double ms) {
+  struct timespec ts = {0, (long)(ms * 1e6)};
+  nanosleep(&ts, nullptr);
+}
+
+std::vector<std::string> split(const char *list) {
+  std::vector<std::string> out;
+  std::string item;
+  for (const char *p = list;; p++) {
+    if (*p == ',' || !*p) {
+      if (!item.empty()) out.push_back(item);
+      item.clear();
+      if (!*p) break;
+    } else {
+      item += *p;
+    }
+  }
+  return out;
+}
+
+int bits(long mask) {
+  int n = 0;
+  for (; mask; mask >>= 1) n += mask & 1;
+  return n;
+}
+
+// Runs argv with stdout to /dev/null and stderr to stderr_fd
+pid_t spawn(const std::vector<std::string> &args, int stderr_fd) {
+  std::vector<char *> argv;
+  for (const std::string &a : args) argv.push_back(const_cast<char *>(a.c_str()));
+  argv.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, stderr_fd, 2);
+  pid_t pid;
+  int err = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err) {
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+    return -1;
+  }
+  return pid;
+}
+
+long field_after(const std::string &text, const char *key, bool number_first = false) {
+  size_t pos = text.find(key);
+  if (pos == std::string::npos) return 0;
+  if (!number_first) return atol(text.c_str() + pos + strlen(key));
+  // "1234 samples were lost": back up over the number
+  while (pos > 0 && text[pos - 1] == ' ') pos--;
+  while (pos > 0 && isdigit((unsigned char)text[pos - 1])) pos--;
+  return atol(text.c_str() + pos);
+}
+
+std::string read_file(const std::string &path) {
+  std::string out;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return out;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, n);
+  close(fd);
+  return out;
+}
+
+// Follows the growing output file and notes when each row's Time(us)
+// first appears in it
+class Tail {
+ public:
+  Tail(const std::string &path, bool csv) : path_(path), csv_(csv) {}
+  ~Tail() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  void poll(double now) {
+    if (csv_) {
+      poll_csv(now);
+    } else {
+      poll_daqc(now);
+    }
+  }
+
+  // (time_us, seen at) per row
+  const std::vector<std::pair<uint64_t, double>> &rows() const { return rows_; }
+
+ private:
+  void poll_csv(double now) {
+    if (fd_ < 0) fd_ = open(path_.c_str(), O_RDONLY);
+    if (fd_ < 0) return;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd_, buf, sizeof(buf))) > 0) pending_.append(buf, n);
+    size_t start = 0, nl;
+    while ((nl = pending_.find('\n', start)) != std::string::npos) {
+      const char *line = pending_.c_str() + start;
+      if (isdigit((unsigned char)line[0])) {
+        const char *comma = strchr(line, ',');
+        if (comma) rows_.emplace_back(strtoull(comma + 1, nullptr, 10), now);
+      }
+      start = nl + 1;
+    }
+    pending_.erase(0, start);
+  }
+
+  void poll_daqc(double now) {
+    struct stat st;
+    if (stat(path_.c_str(), &st) < 0 || st.st_size == size_) return;
+    size_ = st.st_size;
+    daq::DaqcFile file;
+    if (!file.open(path_.c_str())) return;
+    const std::vector<daq::DaqcFile::Chunk> &chunks = file.chunks();
+    for (; chunks_seen_ < chunks.size(); chunks_seen_++) {
+      const daq::DaqcFile::Chunk &chunk = chunks[chunks_seen_];
+      for (uint32_t i = 0; i < chunk.rows; i++) rows_.emplace_back(chunk.first_time_us + chunk.time_offset[i], now);
+    }
+  }
+
+  std::string path_;
+  bool csv_;
+  int fd_ = -1;
+  std::string pending_;
+  off_t size_ = -1;
+  size_t chunks_seen_ = 0;
+  std::vector<std::pair<uint64_t, double>> rows_;
+};
+
+Result run(const Case &c, const std::string &bin_dir, long duration_ms, double speed, bool uart) {
+  Result r;
+  char dir[] = "/tmp/bench_capture.XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return r;
+  }
+  std::string link = std::string(dir) + "/tty";
+  std::string output = std::string(dir) + (c.csv ? "/out.csv" : "/out.daqc");
+  std::string log = std::string(dir) + "/capture.log";
+
+  int sim_err[2];
+  if (pipe(sim_err) < 0) return r;
+  fcntl(sim_err[0], F_SETFL, O_NONBLOCK);
+  fcntl(sim_err[0], F_SETFD, FD_CLOEXEC);
+  char speed_arg[32];
+  snprintf(speed_arg, sizeof(speed_arg), "%g", speed);
+  std::vector<std::string> sim_args = {bin_dir + "/daq_sim", "--link", link, "--speed", speed_arg};
+  if (!uart) sim_args.push_back("--no-uart");
+  pid_t sim = spawn(sim_args, sim_err[1]);
+  close(sim_err[1]);
+
+  // The link appears once the pty is set up
+  struct stat st;
+  for (int i = 0; i < 2000 && lstat(link.c_str(), &st) < 0; i++) sleep_ms(1);
+
+  int log_fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  char config[64];
+  snprintf(config, sizeof(config), "PERIOD_US=%ld CHANNELS=%ld DURATION_MS=%ld", c.period_us, c.channels,
+           duration_ms);
+  std::vector<std::string> capture_args = {bin_dir + "/daq_capture", "-o", output, "--config", config, link};
+  if (c.binary) capture_args.push_back("--bin");
+  pid_t capture = sim > 0 && log_fd >= 0 ? spawn(capture_args, log_fd) : -1;
+  if (log_fd >= 0) close(log_fd);
+
+  Tail tail(output, c.csv);
+  std::string sim_log;
+  double start = 0;  // monotonic time of Time(us) = 0
+  double deadline = now_s() + 15 + duration_ms * 1e-3 / speed;
+  int status = 0;
+  bool exited = capture < 0;
+  while (!exited) {
+    if (now_s() > deadline) {
+      fprintf(stderr, "daq_capture didn't finish, killing it\n");
+      kill(capture, SIGKILL);
+    }
+    exited = waitpid(capture, &status, WNOHANG) == capture;
+    tail.poll(now_s());
+
+    char buf[512];
+    ssize_t n;
+    while ((n = read(sim_err[0], buf, sizeof(buf))) > 0) sim_log.append(buf, n);
+    if (!start) {
+      size_t pos = sim_log.find("recording started at ");
+      if (pos != std::string::npos && sim_log.find('\n', pos) != std::string::npos) {
+        start = atof(sim_log.c_str() + pos + strlen("recording started at "));
+      }
+    }
+    if (!exited) sleep_ms(1);
+  }
+  if (sim > 0) {
+    kill(sim, SIGTERM);
+    waitpid(sim, nullptr, 0);
+  }
+  close(sim_err[0]);
+
+  std::string summary = read_file(log);
+  r.ok = capture > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && start > 0;
+  if (!r.ok) fprintf(stderr, "case failed, daq_capture said:\n%s\n", summary.c_str());
+
+  r.rows = tail.rows().size();
+  r.expected = duration_ms * 1000 / c.period_us;
+  r.device_dropped = field_after(summary, "Arduino dropped ");
+  r.link_lost = field_after(summary, "samples were lost on the serial link", true);
+  r.host_dropped_bytes = field_after(summary, "bytes, the parser fell behind", true);
+  size_t kb = summary.rfind(" KB in ");
+  if (kb != std::string::npos) {
+    size_t line = summary.rfind('\n', kb);
+    r.wire_bytes = atof(summary.c_str() + (line == std::string::npos ? 0 : line + 1)) * 1e3;
+  }
+  if (start > 0) {
+    for (const auto &row : tail.rows()) {
+      double due = start + row.first * 1e-6 / speed;
+      r.latency_ms.push_back((row.second - due) * 1e3);
+      r.seconds = std::max(r.seconds, row.second - start);
+    }
+  }
+
+  unlink(link.c_str());
+  unlink(output.c_str());
+  unlink(log.c_str());
+  rmdir(dir);
+  return r;
+}
+
+double percentile(std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = std::min(sorted.size() - 1, (size_t)(p / 100 * sorted.size()));
+  return sorted[i];
+}
+
+void json_string(const char *s) {
+  putchar('"');
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      printf("\\%c", *s);
+    } else if ((unsigned char)*s < 0x20) {
+      printf("\\u%04x", *s);
+    } else {
+      putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--periods LIST] [--channels LIST] [--formats text,bin] [--outputs daqc,csv]\n"
+          "       [--duration-ms N] [--speed X] [--no-uart] [--label TEXT]\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> periods = split("1000,500,250");
+  std::vector<std::string> masks = split("1,15");
+  std::vector<std::string> formats = split("text,bin");
+  std::vector<std::string> outputs = split("daqc");
+  long duration_ms = 2000;
+  double speed = 1;
+  bool uart = true;
+  const char *label = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--periods") && i + 1 < argc) {
+      periods = split(argv[++i]);
+    } else if (!strcmp(argv[i], "--channels") && i + 1 < argc) {
+      masks = split(argv[++i]);
+    } else if (!strcmp(argv[i], "--formats") && i + 1 < argc) {
+      formats = split(argv[++i]);
+    } else if (!strcmp(argv[i], "--outputs") && i + 1 < argc) {
+      outputs = split(argv[++i]);
+    } else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc) {
+      duration_ms = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-uart")) {
+      uart = false;
+    } else if (!strcmp(argv[i], "--label") && i + 1 < argc) {
+      label = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (speed <= 0 || duration_ms <= 0) {
+    fprintf(stderr, "--speed and --duration-ms must be positive (latency needs a real-time board)\n");
+    return 2;
+  }
+
+  std::vector<Case> cases;
+  for (const std::string &output : outputs) {
+    for (const std::string &format : formats) {
+      for (const std::string &mask : masks) {
+        for (const std::string &period : periods) {
+          if ((format != "text" && format != "bin") || (output != "daqc" && output != "csv") ||
+              atol(period.c_str()) <= 0 || atol(mask.c_str()) <= 0) {
+            usage(argv[0]);
+            return 2;
+          }
+          cases.push_back(Case{atol(period.c_str()), atol(mask.c_str()), format == "bin", output == "csv"});
+        }
+      }
+    }
+  }
+
+  char exe[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  std::string bin_dir = len > 0 ? std::string(exe, len) : std::string(argv[0]);
+  bin_dir = bin_dir.find('/') == std::string::npos ? "." : bin_dir.substr(0, bin_dir.rfind('/'));
+
+  fprintf(stderr, "%-6s %-4s %6s %3s %8s %8s %10s %7s %8s %8s %8s %8s\n", "output", "wire", "period", "ch",
+          "rows", "rows/s", "bytes/s", "drop%", "p50 ms", "p90 ms", "p99 ms", "max ms");
+  int failed = 0;
+  for (const Case &c : cases) {
+    Result r = run(c, bin_dir, duration_ms, speed, uart);
+    if (!r.ok) failed++;
+    std::sort(r.latency_ms.begin(), r.latency_ms.end());
+    double rows_per_s = r.seconds > 0 ? r.rows / r.seconds : 0;
+    double bytes_per_s = r.seconds > 0 ? r.wire_bytes / r.seconds : 0;
+    double drop = r.expected && r.rows < r.expected ? 1.0 - (double)r.rows / r.expected : 0;
+    double p50 = percentile(r.latency_ms, 50), p90 = percentile(r.latency_ms, 90);
+    double p99 = percentile(r.latency_ms, 99), max = r.latency_ms.empty() ? 0 : r.latency_ms.back();
+
+    printf("{");
+    if (label) {
+      printf("\"label\":");
+      json_string(label);
+      printf(",");
+    }
+    printf("\"output\":\"%s\",\"wire\":\"%s\",\"period_us\":%ld,\"channels\":%d,\"channel_mask\":%ld,"
+           "\"duration_ms\":%ld,\"speed\":%g,\"uart\":%s,\"ok\":%s,",
+           c.csv ? "csv" : "daqc", c.binary ? "bin" : "text", c.period_us, bits(c.channels), c.channels,
+           duration_ms, speed, uart ? "true" : "false", r.ok ? "true" : "false");
+    printf("\"rows\":%llu,\"expected_rows\":%llu,\"drop_rate\":%.6f,\"device_dropped\":%ld,\"link_lost\":%ld,"
+           "\"host_dropped_bytes\":%ld,",
+           (unsigned long long)r.rows, (unsigned long long)r.expected, drop, r.device_dropped, r.link_lost,
+           r.host_dropped_bytes);
+    printf("\"rows_per_s\":%.1f,\"bytes_per_s\":%.0f,\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,"
+           "\"max\":%.3f}}\n",
+           rows_per_s, bytes_per_s, p50, p90, p99, max);
+    fflush(stdout);
+
+    fprintf(stderr, "%-6s %-4s %6ld %3d %8llu %8.0f %10.0f %7.2f %8.1f %8.1f %8.1f %8.1f%s\n",
+            c.csv ? "csv" : "daqc", c.binary ? "bin" : "text", c.period_us, bits(c.channels),
+            (unsigned long long)r.rows, rows_per_s, bytes_per_s, drop * 100, p50, p90, p99, max,
+            r.ok ? "" : "  FAILED");
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Benchmark for arduino_code.cpp running on the host shim.
+ *
+ * Runs one full recording per streaming mode and reports how many host
+ * nanoseconds loop() costs (per call, and per sample counting only the calls
+ * that sent something) and how many bytes the sketch puts on the wire per
+ * sample. Host time is only a proxy for AVR cycles, but it moves in the
+ * same direction when the per-sample work in loop() changes.
+ *
+ * usage: bench_loop [--loop-us N] [--no-uart]
+ *   --loop-us N   virtual time charged per loop() call (default 10)
+ *   --no-uart     don't model the 115200 baud UART (Serial never blocks)
+ */
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+namespace {
+
+struct Result {
+  long samples = 0;
+  long dropped = 0;
+  size_t data_bytes = 0;
+  long loop_calls = 0;
+  double loop_ns = 0;
+  double busy_ns = 0;  // loop() calls that printed something
+  double virtual_s = 0;
+};
+
+long field_after(const std::string &out, const char *key) {
+  size_t pos = out.find(key);
+  return pos == std::string::npos ? -1 : atol(out.c_str() + pos + strlen(key));
+}
+
+Result run(const char *command, double loop_us, bool uart) {
+  Result r;
+  sim::reset();
+  sim::set_uart_model(uart);
+  setup();
+  sim::clear_serial_output();
+  sim::serial_input(std::string(command) + "\n");
+
+  const std::string &out = sim::serial_output();
+  size_t searched = 0;
+  double start_s = sim::now_seconds();
+
+  while (sim::now_seconds() - start_s < 120.0) {
+    uint64_t bytes_before = sim::serial_bytes_written();
+    auto t0 = std::chrono::steady_clock::now();
+    loop();
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    r.loop_ns += ns;
+    if (sim::serial_bytes_written() != bytes_before) r.busy_ns += ns;
+    r.loop_calls++;
+
+    if (out.find("END_OF_DATA", searched) != std::string::npos) break;
+    searched = out.size() > 16 ? out.size() - 16 : 0;
+    sim::advance_us(loop_us);
+  }
+  r.virtual_s = sim::now_seconds() - start_s;
+
+  // Data is everything between the start and end markers
+  size_t begin = out.find("RECORDING_STARTED\r\n");
+  size_t end = out.find("RECORDING_COMPLETE");
+  if (begin != std::string::npos && end != std::string::npos) {
+    begin += strlen("RECORDING_STARTED\r\n");
+    r.data_bytes = end - begin;
+  }
+  r.samples = field_after(out, "SAMPLES_COLLECTED:");
+  r.dropped = field_after(out, "SAMPLES_DROPPED:");
+  return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  double loop_us = 10;
+  bool uart = true;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--loop-us") && i + 1 < argc) {
+      loop_us = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-uart")) {
+      uart = false;
+    } else {
+      fprintf(stderr, "usage: %s [--loop-us N] [--no-uart]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const char *modes[] = {"START", "START_BIN"};
+  printf("%-10s %8s %8s %12s %10s %10s %10s %9s\n", "mode", "samples", "dropped", "bytes/sample",
+         "loops", "ns/loop", "ns/sample", "virtual_s");
+  for (const char *mode : modes) {
+    Result r = run(mode, loop_us, uart);
+    if (r.samples <= 0) {
+      printf("%-10s no samples (recording did not complete)\n", mode);
+      continue;
+    }
+    printf("%-10s %8ld %8ld %12.2f %10ld %10.1f %10.1f %9.3f\n", mode, r.samples, r.dropped,
+           (double)r.data_bytes / r.samples, r.loop_calls, r.loop_ns / r.loop_calls,
+           r.busy_ns / r.samples, r.virtual_s);
+  }
+  return 0;
+}
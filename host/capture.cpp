@@ -0,0 +1,475 @@
+/*
+ * Serial capture pieces, see capture.h.
+ */
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace daq {
+
+namespace {
+
+const uint8_t frame_sync_0 = 0xA5;
+const uint8_t frame_sync_1 = 0x5A;  // + oversample bits
+const int max_oversample = 3;
+const size_t max_text_line = 256;  // longer without '\n' is not a line
+
+speed_t baud_constant(unsigned long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    case 4000000: return B4000000;
+    default: return B0;
+  }
+}
+
+bool printable(uint8_t c) { return c >= 32 && c < 127; }
+
+// Unsigned decimal at p, returns the new end
+char *append_uint(char *p, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) *p++ = digits[--n];
+  return p;
+}
+
+// value with 6 decimals at p (no exponent, "-" when negative), returns
+// the new end
+char *append_fixed6(char *p, double value) {
+  if (value < 0) {
+    *p++ = '-';
+    value = -value;
+  }
+  if (!(value < 1e12)) value = 1e12;  // keeps the digits bounded, inputs are volts
+  uint64_t micro = (uint64_t)(value * 1e6 + 0.5);
+  p = append_uint(p, micro / 1000000);
+  *p++ = '.';
+  uint32_t frac = micro % 1000000;
+  for (int div = 100000; div; div /= 10) *p++ = '0' + frac / div % 10;
+  return p;
+}
+
+// Digits at p..end as an integer, false if empty or not all digits
+bool parse_uint(const char *p, const char *end, uint64_t *value) {
+  if (p == end || end - p > 19) return false;
+  uint64_t v = 0;
+  for (; p < end; p++) {
+    if (*p < '0' || *p > '9') return false;
+    v = v * 10 + (*p - '0');
+  }
+  *value = v;
+  return true;
+}
+
+// "d.ddd" style voltage, what both formatters on the Arduino print
+bool parse_volts(const char *p, const char *end, double *value) {
+  const char *dot = (const char *)memchr(p, '.', end - p);
+  uint64_t whole, frac;
+  if (!dot || !parse_uint(p, dot, &whole) || !parse_uint(dot + 1, end, &frac)) return false;
+  static const double scale[] = {1, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9};
+  size_t decimals = end - dot - 1;
+  if (decimals >= sizeof(scale) / sizeof(scale[0])) return false;
+  *value = whole + frac * scale[decimals];
+  return true;
+}
+
+}  // namespace
+
+int open_serial(const char *path, unsigned long baud) {
+  speed_t speed = baud_constant(baud);
+  if (speed == B0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) return -1;
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+bool write_all(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        poll(&pfd, 1, 100);
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+int format_code(char *out, unsigned code, int code_bits) {
+  char *p = out;
+  int oversample = code_bits - 10;
+  if (oversample <= 0) {
+    // Same integer math as the sketch's send_line()
+    unsigned mv = ((unsigned long)code * 1281251UL + 131072UL) >> 18;
+    *p++ = '0' + mv / 1000;
+    *p++ = '.';
+    mv %= 1000;
+    *p++ = '0' + mv / 100;
+    *p++ = '0' + (mv / 10) % 10;
+    *p++ = '0' + mv % 10;
+  } else {
+    unsigned tenths = ((unsigned long)code * 400391UL + (4099UL << oversample)) >> (13 + oversample);
+    *p++ = '0' + tenths / 10000;
+    *p++ = '.';
+    tenths %= 10000;
+    *p++ = '0' + tenths / 1000;
+    *p++ = '0' + (tenths / 100) % 10;
+    *p++ = '0' + (tenths / 10) % 10;
+    *p++ = '0' + tenths % 10;
+  }
+  return p - out;
+}
+
+// ---- StreamDecoder ----
+
+void StreamDecoder::reset() {
+  pending_.clear();
+  columns_.clear();
+  header_.clear();
+  forget_frames();
+  time_base_ = 0;
+  have_time_ = false;
+}
+
+void StreamDecoder::forget_frames() {
+  have_frame_ = false;
+  period_us_ = 0;
+  period_guess_ = 0;
+  rejected_run_ = 0;
+}
+
+void StreamDecoder::feed(const uint8_t *data, size_t len) {
+  stats_.bytes += len;
+  if (pending_.empty()) {
+    // Usual case, decode straight out of the caller's buffer
+    size_t used = decode(data, len);
+    pending_.assign(data + used, data + len);
+  } else {
+    pending_.insert(pending_.end(), data, data + len);
+    size_t used = decode(pending_.data(), pending_.size());
+    pending_.erase(pending_.begin(), pending_.begin() + used);
+  }
+}
+
+// Decode what's complete in p[0..len), returns the bytes used
+size_t StreamDecoder::decode(const uint8_t *p, size_t len) {
+  size_t pos = 0;
+  while (pos < len) {
+    if (p[pos] == frame_sync_0) {
+      if (pos + 1 == len) break;  // maybe a frame, wait for the next byte
+      size_t used;
+      if (try_frame(p + pos, len - pos, &used)) {
+        if (!used) break;  // wait for the rest of the frame
+        pos += used;
+        continue;
+      }
+    }
+
+    if (printable(p[pos])) {
+      const uint8_t *nl = (const uint8_t *)memchr(p + pos, '\n', len - pos);
+      if (!nl) {
+        if (len - pos < max_text_line) break;  // wait for the rest of the line
+      } else {
+        size_t end = nl - p;
+        size_t text_end = end > pos && p[end - 1] == '\r' ? end - 1 : end;
+        size_t i = pos;
+        while (i < text_end && printable(p[i])) i++;
+        if (i == text_end) {
+          text_line((const char *)p + pos, text_end - pos);
+          pos = end + 1;
+          continue;
+        }
+      }
+    }
+
+    // Garbage byte, skip it and resync
+    stats_.skipped_bytes++;
+    pos++;
+  }
+  return pos;
+}
+
+// A frame at p? True with *used = its size when one was decoded, or with
+// *used = 0 when it looks like a frame but isn't all here yet. False if p
+// isn't a frame.
+bool StreamDecoder::try_frame(const uint8_t *p, size_t len, size_t *used) {
+  int oversample = p[1] - frame_sync_1;
+  if (oversample < 0 || oversample > max_oversample) return false;
+
+  int count = columns_.empty() ? 4 : (int)columns_.size();
+  int code_bits = 10 + oversample;
+  size_t size = 9 + (code_bits * count + 7) / 8;
+  if (len < size) {
+    *used = 0;
+    return true;
+  }
+
+  uint8_t check = 0;
+  for (size_t i = 2; i < size - 1; i++) check ^= p[i];
+  if (check != p[size - 1]) {
+    stats_.bad_frames++;
+    return false;
+  }
+
+  uint32_t index = p[2] | (uint32_t)p[3] << 8;
+  uint32_t time_us = p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+  Row row;
+  if (!frame_step(index, time_us, &row.sample)) {
+    stats_.bad_frames++;
+    return false;
+  }
+  row.time_us = unwrap_time(time_us);
+
+  // codes packed LSB first
+  double scale = 5.0 / (1023 << oversample);
+  uint32_t mask = (1u << code_bits) - 1;
+  uint32_t bits = 0;
+  int bit_count = 0;
+  size_t byte_pos = 8;
+  for (int i = 0; i < count; i++) {
+    while (bit_count < code_bits) {
+      bits |= (uint32_t)p[byte_pos++] << bit_count;
+      bit_count += 8;
+    }
+    row.codes[i] = bits & mask;
+    row.values[i] = row.codes[i] * scale;
+    bits >>= code_bits;
+    bit_count -= code_bits;
+  }
+  row.count = count;
+  row.code_bits = code_bits;
+  row.text = nullptr;
+  row.text_len = 0;
+
+  stats_.rows++;
+  stats_.frames++;
+  if (on_row) on_row(row);
+  *used = size;
+  return true;
+}
+
+void StreamDecoder::text_line(const char *line, size_t len) {
+  if (len && line[0] >= '0' && line[0] <= '9') {
+    Row row;
+    if (parse_row(line, len, &row)) {
+      stats_.rows++;
+      if (on_row) on_row(row);
+    } else {
+      stats_.rejected_lines++;
+    }
+    return;
+  }
+
+  // The header starts each recording and names the columns
+  if (len > 11 && !memcmp(line, "Sample,Time", 11)) {
+    header_.assign(line, len);
+    columns_.clear();
+    const char *end = line + len;
+    const char *p = (const char *)memchr(line, ',', len);
+    p = p ? (const char *)memchr(p + 1, ',', end - p - 1) : nullptr;
+    while (p && (int)columns_.size() < max_columns) {
+      const char *next = (const char *)memchr(p + 1, ',', end - p - 1);
+      columns_.emplace_back(p + 1, next ? next : end);
+      p = next;
+    }
+    forget_frames();
+    have_time_ = false;
+    time_base_ = 0;
+  }
+  if (on_line) on_line(line, len);
+}
+
+// sample,time,v0,v1,... with as many values as the header named
+bool StreamDecoder::parse_row(const char *line, size_t len, Row *row) {
+  const char *end = line + len;
+  const char *comma = (const char *)memchr(line, ',', len);
+  if (!comma || !parse_uint(line, comma, &row->sample)) return false;
+
+  const char *p = comma + 1;
+  comma = (const char *)memchr(p, ',', end - p);
+  uint64_t time_us;
+  if (!comma || !parse_uint(p, comma, &time_us) || time_us > UINT32_MAX) return false;
+
+  row->text = comma + 1;
+  row->text_len = end - row->text;
+  row->code_bits = 0;
+  row->count = 0;
+  p = comma + 1;
+  for (;;) {
+    comma = (const char *)memchr(p, ',', end - p);
+    const char *field_end = comma ? comma : end;
+    if (row->count == max_columns || !parse_volts(p, field_end, &row->values[row->count])) return false;
+    row->count++;
+    if (!comma) break;
+    p = comma + 1;
+  }
+  if (!columns_.empty() && row->count != (int)columns_.size()) return false;
+
+  row->time_us = unwrap_time((uint32_t)time_us);
+  return true;
+}
+
+// Whether a frame whose checksum passed belongs to the recording, and its
+// unwrapped sample index if so. The 8-bit checksum lets 1 in 256
+// corrupted frames through, and the 16-bit index can't tell a corrupted
+// one from a wrap or a gap, in either direction. But the Arduino stamps
+// sample n at n periods on its sample clock, so once the period is known
+// a genuine frame's time step is a whole number of periods, and that
+// number (which also says how far the index moved, wraps included)
+// matches the index step modulo 65536. A frame that doesn't is refused
+// without moving anything, so the next genuine one is measured from the
+// last good frame again. Until the period is learned a small step back
+// is refused and anything else taken, and if many frames in a row are
+// refused (a clock that doesn't behave that way) the period is dropped
+// and relearned rather than throwing the rest of the stream away.
+bool StreamDecoder::frame_step(uint32_t index, uint32_t time_us, uint64_t *sample) {
+  const int relearn_after = 16;
+  if (!have_frame_) {
+    *sample = index;
+  } else {
+    uint32_t steps = (index - frame_index_) & 0xFFFF;
+    uint32_t dt = time_us - frame_time_;  // modulo 2^32, as the clock wraps
+    uint64_t advance = steps;
+    bool ok;
+    if (period_us_) {
+      advance = dt / period_us_;
+      ok = dt && dt % period_us_ == 0 && (advance & 0xFFFF) == steps;
+    } else {
+      ok = !(index < frame_index_ && frame_index_ - index <= 0x8000);
+    }
+    if (!ok && ++rejected_run_ < relearn_after) return false;
+    if (!ok) {
+      period_us_ = 0;
+      period_guess_ = 0;
+      advance = steps;
+    }
+    if (!period_us_ && steps == 1 && dt) {
+      if (dt == period_guess_) period_us_ = dt;
+      period_guess_ = dt;
+    }
+    *sample = frame_sample_ + advance;
+  }
+  rejected_run_ = 0;
+  frame_index_ = index;
+  frame_time_ = time_us;
+  frame_sample_ = *sample;
+  have_frame_ = true;
+  return true;
+}
+
+// The Arduino's us clock is 32 bits (wraps after ~71.6 minutes). A big
+// step backwards is a wrap, a small one a corrupted row and left alone.
+uint64_t StreamDecoder::unwrap_time(uint32_t time_us) {
+  if (have_time_ && time_us < last_time_ && last_time_ - time_us > 0x80000000u) {
+    time_base_ += 1ULL << 32;
+  }
+  last_time_ = time_us;
+  have_time_ = true;
+  return time_base_ + time_us;
+}
+
+// ---- CsvWriter ----
+
+CsvWriter::CsvWriter(int fd, size_t buffer_size) : fd_(fd), buf_(buffer_size) {}
+
+CsvWriter::~CsvWriter() { flush(); }
+
+void CsvWriter::reserve(size_t len) {
+  if (buf_.size() - used_ < len) flush();
+  if (buf_.size() < len) buf_.resize(len);
+}
+
+void CsvWriter::header(const std::string &line) {
+  reserve(line.size() + 1);
+  memcpy(buf_.data() + used_, line.data(), line.size());
+  used_ += line.size();
+  buf_[used_++] = '\n';
+}
+
+void CsvWriter::row(const Row &row, const double *extra, int extra_count) {
+  // 2 x 20 digits, commas, values (or the text as received) and '\n'
+  reserve(48 + (row.text ? row.text_len : row.count * 8) + extra_count * 22);
+  char *start = buf_.data() + used_;
+  char *p = start;
+  p = append_uint(p, row.sample);
+  *p++ = ',';
+  p = append_uint(p, row.time_us);
+  if (row.text) {
+    *p++ = ',';
+    memcpy(p, row.text, row.text_len);
+    p += row.text_len;
+  } else {
+    for (int i = 0; i < row.count; i++) {
+      *p++ = ',';
+      p += format_code(p, row.codes[i], row.code_bits);
+    }
+  }
+  for (int i = 0; i < extra_count; i++) {
+    *p++ = ',';
+    p = append_fixed6(p, extra[i]);
+  }
+  *p++ = '\n';
+  used_ += p - start;
+}
+
+bool CsvWriter::flush() {
+  if (used_ && ok_) {
+    ok_ = write_all(fd_, buf_.data(), used_);
+    written_ += used_;
+  }
+  used_ = 0;
+  return ok_;
+}
+
+}  // namespace daq
@@ -0,0 +1,133 @@
+/*
+ * Host-side capture of the arduino_code.cpp serial stream, the native
+ * counterpart of the readline loops in the Python receivers.
+ *
+ * open_serial() puts a tty (or pty) in raw mode. StreamDecoder takes the
+ * bytes in whatever chunks read() returns and turns them into rows and
+ * control lines: CSV text rows (START / STREAM) and binary frames
+ * (START_BIN / STREAM_BIN, layout in arduino_code.cpp) both come out as
+ * the same Row, without allocating per line. CsvWriter buffers the rows
+ * into large write()s in the same CSV the Arduino sends in text mode.
+ */
+#ifndef DAQ_CAPTURE_H
+#define DAQ_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace daq {
+
+// Raw mode (no echo, no line editing, no CR/LF mapping), 8N1, non-blocking.
+// baud is ignored by ptys. Returns the fd, or -1 with errno set.
+int open_serial(const char *path, unsigned long baud);
+
+// Write all of data to fd, waiting out EAGAIN. Returns false on error.
+bool write_all(int fd, const void *data, size_t len);
+
+const int max_columns = 8;  // 4 inputs, raw and filtered
+
+struct Row {
+  uint64_t sample;   // unwrapped sample index
+  uint64_t time_us;  // unwrapped sample clock
+  int count;         // values used
+  double values[max_columns];  // volts, in header column order
+
+  // How the values were sent, so they can be written back unchanged:
+  // text rows keep the value part of the line (from the first value to
+  // the end, no line ending), binary rows their (10+b)-bit codes
+  const char *text;
+  size_t text_len;
+  uint16_t codes[max_columns];
+  int code_bits;  // 0 for text rows
+};
+
+struct DecoderStats {
+  uint64_t bytes = 0;
+  uint64_t rows = 0;
+  uint64_t frames = 0;          // rows that arrived as binary frames
+  uint64_t rejected_lines = 0;  // text that was neither a row nor a known line
+  uint64_t bad_frames = 0;      // checksum failures, index and time that disagree
+  uint64_t skipped_bytes = 0;   // garbage skipped while resyncing
+};
+
+class StreamDecoder {
+ public:
+  // Called for every complete row, the Row (and its text) is only valid
+  // during the call
+  std::function<void(const Row &)> on_row;
+  // Called for every other complete text line (header, RECORDING_STARTED,
+  // SEQ:, CONFIG:, ...), without the line ending
+  std::function<void(const char *line, size_t len)> on_line;
+
+  void feed(const uint8_t *data, size_t len);
+
+  // Forget the previous recording (header, unwrap state, partial input)
+  void reset();
+
+  // Column names from the last header, e.g. "A0(V)", "A0(V)_iir"
+  const std::vector<std::string> &columns() const { return columns_; }
+  const std::string &header() const { return header_; }
+  const DecoderStats &stats() const { return stats_; }
+
+ private:
+  size_t decode(const uint8_t *p, size_t len);
+  bool try_frame(const uint8_t *p, size_t len, size_t *used);
+  void text_line(const char *line, size_t len);
+  bool parse_row(const char *line, size_t len, Row *row);
+  uint64_t unwrap_time(uint32_t time_us);
+  bool frame_step(uint32_t index, uint32_t time_us, uint64_t *sample);
+  void forget_frames();
+
+  std::vector<uint8_t> pending_;
+  std::vector<std::string> columns_;
+  std::string header_;
+  DecoderStats stats_;
+
+  // Binary frames: the last accepted one's 16-bit index and 32-bit time
+  // as sent and its unwrapped index, and the sample period learned from
+  // them (0 until two consecutive steps of one sample agree)
+  uint32_t frame_index_ = 0, frame_time_ = 0;
+  uint64_t frame_sample_ = 0;
+  bool have_frame_ = false;
+  uint32_t period_us_ = 0, period_guess_ = 0;
+  int rejected_run_ = 0;  // frames refused in a row since the last accepted
+  uint64_t time_base_ = 0;   // the us clock is 32 bits
+  uint32_t last_time_ = 0;
+  bool have_time_ = false;
+};
+
+// Buffered CSV output: header line, then one line per row, flushed in
+// large writes
+class CsvWriter {
+ public:
+  explicit CsvWriter(int fd, size_t buffer_size = 1 << 20);
+  ~CsvWriter();
+
+  void header(const std::string &line);
+  // extra values (e.g. filtered ones) go after the row's own, 6 decimals
+  void row(const Row &row, const double *extra = nullptr, int extra_count = 0);
+  bool flush();
+  bool ok() const { return ok_; }
+  uint64_t bytes_written() const { return written_; }
+
+ private:
+  void reserve(size_t len);
+
+  int fd_;
+  std::vector<char> buf_;
+  size_t used_ = 0;
+  uint64_t written_ = 0;
+  bool ok_ = true;
+};
+
+// Volts for a (10+bits)-bit code, formatted exactly as the Arduino prints
+// it in text mode (3 decimals, 4 when oversampled). Returns the length.
+int format_code(char *out, unsigned code, int code_bits);
+
+}  // namespace daq
+
+#endif  // DAQ_CAPTURE_H
@@ -0,0 +1,33 @@
+/*
+ * Assertions for the make check tests (test_*.cpp): a failed CHECK prints
+ * where and why and is counted, the test carries on, and main() returns
+ * check_result() so make check stops on the first test with failures.
+ */
+#ifndef DAQ_CHECK_H
+#define DAQ_CHECK_H
+
+#include <stdio.h>
+
+inline int check_failures = 0;
+
+#define CHECK(cond, ...)                                          \
+  do {                                                            \
+    if (!(cond)) {                                                \
+      fprintf(stderr, "%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__);                               \
+      fputc('\n', stderr);                                        \
+      check_failures++;                                           \
+    }                                                             \
+  } while (0)
+
+// Exit status for main(), with a one line verdict
+inline int check_result(const char *test) {
+  if (check_failures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", test, check_failures);
+    return 1;
+  }
+  printf("%s: ok\n", test);
+  return 0;
+}
+
+#endif  // DAQ_CHECK_H
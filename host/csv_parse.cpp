@@ -0,0 +1,261 @@
+/*
+ * Capture CSV reader, see csv_parse.h.
+ */
+#include "csv_parse.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace daq {
+
+namespace {
+
+// Header assumed for files that don't have one, as in clean_data_file()
+const char *const legacy_names[] = {"Sample", "Time(ms)", "A0(V)", "A1(V)", "A2(V)", "A3(V)"};
+
+const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                        1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+bool row_byte(uint8_t c) {
+  return (c >= '0' && c <= '9') || c == ',' || c == '.' || c == '-' || c == '\r' || c == '\n' || c == 'e' ||
+         c == 'E' || c == '+';
+}
+
+// For the 16 bytes at p: bit i of *newlines set where p[i] is '\n', bit i
+// of *bad where p[i] can't appear in a data row
+inline void classify16(const char *p, uint32_t *newlines, uint32_t *bad) {
+#ifdef __SSE2__
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+  // '0'..'9' as one unsigned range compare (SSE2 only has signed ones)
+  __m128i d = _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8('0')), _mm_set1_epi8((char)0x80));
+  __m128i ok = _mm_cmplt_epi8(d, _mm_set1_epi8((char)(0x80 + 10)));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('e')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('+')));
+  ok = _mm_or_si128(ok, nl);
+  *newlines = _mm_movemask_epi8(nl);
+  *bad = ~_mm_movemask_epi8(ok) & 0xFFFF;
+#else
+  uint32_t n = 0, b = 0;
+  for (int i = 0; i < 16; i++) {
+    uint8_t c = p[i];
+    if (c == '\n') n |= 1u << i;
+    if (!row_byte(c)) b |= 1u << i;
+  }
+  *newlines = n;
+  *bad = b;
+#endif
+}
+
+class Parser {
+ public:
+  Parser(const char *data, size_t len, CsvData *out) : data_(data), len_(len), out_(out) {}
+
+  void run() {
+    size_t line_start = 0;
+    bool line_bad = false;
+    size_t i = 0;
+
+    for (; i + 16 <= len_; i += 16) {
+      uint32_t newlines, bad;
+      classify16(data_ + i, &newlines, &bad);
+      while (newlines) {
+        int bit = __builtin_ctz(newlines);
+        line(line_start, i + bit, line_bad || (bad & ((1u << bit) - 1)));
+        line_start = i + bit + 1;
+        line_bad = false;
+        bad &= ~((2u << bit) - 1);
+        newlines &= newlines - 1;
+      }
+      if (bad) line_bad = true;
+    }
+
+    // Tail shorter than a block
+    for (; i < len_; i++) {
+      if (data_[i] == '\n') {
+        line(line_start, i, line_bad);
+        line_start = i + 1;
+        line_bad = false;
+      } else if (!row_byte(data_[i])) {
+        line_bad = true;
+      }
+    }
+    if (line_start < len_) line(line_start, len_, line_bad);
+  }
+
+ private:
+  void line(size_t start, size_t end, bool bad) {
+    if (end > start && data_[end - 1] == '\r') end--;
+    if (end == start) return;
+    const char *p = data_ + start;
+    size_t len = end - start;
+
+    if (bad) {
+      if (len > 11 && !memcmp(p, "Sample,Time", 11)) {
+        if (!have_header_) header(p, len);
+        return;  // repeated headers are dropped, like clean_data_file()
+      }
+      out_->rejected++;
+      return;
+    }
+
+    if (!have_header_) {
+      // No header before the first row: old capture, assume the 6 columns
+      int fields = 1;
+      for (size_t k = 0; k < len; k++) fields += p[k] == ',';
+      if (fields != 6) {
+        out_->rejected++;
+        return;
+      }
+      for (const char *name : legacy_names) out_->names.push_back(name);
+      start_columns(len);
+    }
+
+    if (!row(p, len)) out_->rejected++;
+  }
+
+  void header(const char *p, size_t len) {
+    const char *end = p + len;
+    while (p < end) {
+      const char *comma = (const char *)memchr(p, ',', end - p);
+      const char *field_end = comma ? comma : end;
+      out_->names.emplace_back(p, field_end);
+      p = field_end + 1;
+    }
+    start_columns(0);
+  }
+
+  void start_columns(size_t first_line_len) {
+    have_header_ = true;
+    ncols_ = out_->names.size();
+    out_->columns.assign(ncols_, std::vector<double>());
+    values_.assign(ncols_, 0.0);
+    // Rough row count from the file size, the vectors still grow if it's off
+    size_t estimate = len_ / (first_line_len ? first_line_len + 1 : 8 * ncols_ + 8);
+    for (auto &column : out_->columns) column.reserve(estimate);
+  }
+
+  // Two integers then values, exactly ncols_ fields. The values are d.ddd
+  // (negative ones from host filters, e.g. daq_capture --filter) on the
+  // fast path; anything else, such as a _filtered.csv's full precision
+  // or exponents from pandas, goes through number(). Only row bytes get
+  // here, so it's just the field structure left to check.
+  bool row(const char *p, size_t len) {
+    const char *end = p + len;
+    double *values = values_.data();
+    size_t field = 0;
+
+    while (field < ncols_) {
+      const char *field_start = p;
+      bool negative = field >= 2 && p < end && *p == '-';
+      p += negative;
+      uint64_t whole = 0;
+      int digits = 0;
+      for (; p < end && *p >= '0' && *p <= '9' && digits <= 15; p++, digits++) whole = whole * 10 + (*p - '0');
+
+      if (field < 2) {
+        if (!digits || digits > 15) return false;
+        values[field] = (double)whole;
+      } else {
+        int decimals = 0;
+        if (p < end && *p == '.') {
+          p++;
+          for (; p < end && *p >= '0' && *p <= '9'; p++, decimals++) whole = whole * 10 + (*p - '0');
+        }
+        if (digits && decimals && digits + decimals <= 15 && (p == end || *p == ',')) {
+          // One correctly rounded division, so values match float("2.361")
+          values[field] = (double)whole / pow10[decimals];
+          if (negative) values[field] = -values[field];
+        } else if (!number(field_start, end, &p, &values[field])) {
+          return false;
+        }
+      }
+
+      field++;
+      if (p == end) break;
+      if (*p != ',') return false;
+      p++;
+    }
+    if (field != ncols_ || p != end) return false;
+
+    for (size_t k = 0; k < ncols_; k++) out_->columns[k].push_back(values[k]);
+    out_->rows++;
+    return true;
+  }
+
+  // The field from start as strtod() reads it, which must be all of it:
+  // *next is left on the ',' or end after it
+  static bool number(const char *start, const char *end, const char **next, double *value) {
+    const char *comma = (const char *)memchr(start, ',', end - start);
+    const char *field_end = comma ? comma : end;
+    char buf[64];
+    size_t len = field_end - start;
+    if (!len || len >= sizeof buf) return false;
+    memcpy(buf, start, len);
+    buf[len] = 0;
+    char *parsed;
+    *value = strtod(buf, &parsed);
+    if (parsed != buf + len) return false;
+    *next = field_end;
+    return true;
+  }
+
+  const char *data_;
+  size_t len_;
+  CsvData *out_;
+  bool have_header_ = false;
+  size_t ncols_ = 0;
+  std::vector<double> values_;  // the row being parsed, ncols_ long
+};
+
+}  // namespace
+
+void parse_csv(const char *data, size_t len, CsvData *out) {
+  *out = CsvData();
+  Parser(data, len, out).run();
+}
+
+bool parse_csv_file(const char *path, CsvData *out) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    *out = CsvData();
+    return true;
+  }
+
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int saved = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = saved;
+    return false;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  parse_csv((const char *)map, st.st_size, out);
+  munmap(map, st.st_size);
+  return true;
+}
+
+}  // namespace daq
@@ -0,0 +1,45 @@
+/*
+ * One pass reader for DAQ capture CSVs (what the Arduino sends in text
+ * mode, what daq_capture and the Python receivers save, and the
+ * _filtered.csv files filter_and_save_data() writes), replacing the
+ * clean_data_file() / pd.read_csv() / pd.to_numeric() chain.
+ *
+ * The file is mmap'd and scanned 16 bytes at a time (SSE2, scalar
+ * fallback elsewhere) for line ends and bytes that can't be part of a
+ * row; rows are then converted straight into one array per column. The
+ * rules are clean_data_file()'s: the first "Sample,Time..." header names
+ * the columns, a row is two integers followed by numbers with one
+ * field per header column, everything else (control lines, line noise,
+ * truncated rows) is counted as rejected. The Arduino's d.ddd voltages
+ * (a leading '-' allowed, filtered columns can dip below 0) take a fast
+ * path, other numbers (pandas' full precision, exponents) go to strtod().
+ */
+#ifndef DAQ_CSV_PARSE_H
+#define DAQ_CSV_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace daq {
+
+// As many columns as the header names: a daq_multi merge of four boards
+// with OUTPUT=2 is 34
+struct CsvData {
+  std::vector<std::string> names;            // from the header
+  std::vector<std::vector<double>> columns;  // one per name, all rows long
+  uint64_t rows = 0;
+  uint64_t rejected = 0;  // non-empty lines that weren't the header or a row
+};
+
+// Parse len bytes of CSV text into out (replacing what was there)
+void parse_csv(const char *data, size_t len, CsvData *out);
+
+// mmap path and parse it. Returns false with errno set if it can't be read.
+bool parse_csv_file(const char *path, CsvData *out);
+
+}  // namespace daq
+
+#endif  // DAQ_CSV_PARSE_H
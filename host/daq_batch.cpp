@@ -0,0 +1,590 @@
+/*
+ * Batch reprocessing of a directory of captures: each arduino_daq_data_*
+ * .csv or .daqc in it is cleaned, low-passed and saved as
+ * FILE_filtered.csv, the way option 2 of serial_recive_with_lowpass.py
+ * does one file (filter_and_save_data(): rows resampled onto a uniform
+ * grid, zero-phase Butterworth, read back at the rows' times; every
+ * A<n>(V) column is filtered), then summarized.
+ *
+ * Files run concurrently on a work stealing pool (thread_pool.h), biggest
+ * first. A file's task loads and filters it, then hands the formatting of
+ * its rows to tasks of their own, a block of rows each, so a big file
+ * near the end of the batch still gets every core.
+ *
+ * DIR/batch_summary.csv has a row per file and channel: the input's size
+ * and mtime and the settings it was processed with, its rows, rejected
+ * lines and rate, and the channel's mean, std, min, max, noise floor
+ * (noise_rms(), sweep.h) and the RMS the filter took out. It also makes
+ * reruns cheap: a file whose summary rows match its size, mtime and the
+ * settings, and whose _filtered.csv is still there, is skipped. Changing
+ * the settings reprocesses everything. It's saved every 32 files or 10 s
+ * while the batch runs and again at the end.
+ *
+ * usage: daq_batch [options] [DIR]   (default: the current directory)
+ *   --cutoff HZ        low-pass cutoff (default 1.5)
+ *   --order N          filter order (default 4)
+ *   --interp NAME      resampling: linear, cubic or sinc (default cubic)
+ *   --match GLOB       inputs, repeatable (default arduino_daq_data_*.csv
+ *                      and arduino_daq_data_*.daqc; never a _filtered.csv)
+ *   --threads N        workers (default one per core)
+ *   --force            reprocess files that are up to date
+ *   -n                 list what would be done, do nothing
+ */
+#include "csv_parse.h"
+#include "daqc.h"
+#include "filtfilt.h"
+#include "iir.h"
+#include "resample.h"
+#include "sweep.h"
+#include "thread_pool.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *summary_name = "batch_summary.csv";
+const char *summary_header =
+    "File,Size,Mtime(ns),Cutoff(Hz),Order,Interp,Rows,Rejected,Fs(Hz),Channel,Mean(V),Std(V),Min(V),Max(V),"
+    "Noise(V),Residual(V)";
+// Summary fields that say what a file's rows were made from
+const int stamp_fields = 6;
+
+// Rows formatted per task
+const size_t block_rows = 1 << 15;
+
+// The summary is rewritten whole, so during a run only after this many
+// more files or this long since the last write, then once at the end
+const int summary_every_files = 32;
+const double summary_every_s = 10;
+
+struct Settings {
+  double cutoff = 1.5;
+  int order = 4;
+  std::string interp = "cubic";
+};
+
+struct Input {
+  std::string name;  // in the directory
+  std::string path;
+  uint64_t size;
+  uint64_t mtime_ns;
+};
+
+// One file on its way through: loaded and filtered by its first task,
+// then formatted block by block; whichever block finishes last writes it
+struct Job {
+  Input input;
+  std::vector<std::string> names;
+  std::vector<std::vector<double>> columns;  // as loaded, one per name
+  uint64_t rejected = 0;
+  bool time_us = false;  // Time(us) (hardware clock) rather than Time(ms)
+  size_t time_column = 0;
+  size_t rows = 0;
+  uint32_t period_us = 0;  // the .daqc's configured period, 0 if unknown
+  double fs = 0;
+  std::vector<size_t> channels;               // the columns filtered
+  std::vector<std::vector<double>> filtered;  // one per channel, at the rows' times
+  std::vector<std::string> blocks;
+  std::atomic<size_t> pending{0};
+  std::chrono::steady_clock::time_point started;
+};
+
+bool is_channel(const std::string &name) {
+  // A<n>(V), not the live filter's A<n>(V)_iir or daq_capture's _filtered
+  if (name.size() < 5 || name[0] != 'A' || name.compare(name.size() - 3, 3, "(V)")) return false;
+  return std::all_of(name.begin() + 1, name.end() - 3, [](char c) { return c >= '0' && c <= '9'; });
+}
+
+bool load(Job *job, std::string *error) {
+  const std::string &path = job->input.path;
+  if (path.size() > 5 && !path.compare(path.size() - 5, 5, ".daqc")) {
+    daq::DaqcFile file;
+    if (!file.open(path.c_str())) {
+      *error = file.error();
+      return false;
+    }
+    // As daq_host.read_daqc() loads it
+    job->period_us = file.info().period_us;
+    job->names = {"Sample", "Time(us)"};
+    job->names.insert(job->names.end(), file.info().names.begin(), file.info().names.end());
+    job->columns.assign(job->names.size(), std::vector<double>());
+    for (std::vector<double> &column : job->columns) column.reserve(file.rows());
+    for (const daq::DaqcFile::Chunk &chunk : file.chunks()) {
+      for (uint32_t i = 0; i < chunk.rows; i++) {
+        job->columns[0].push_back(chunk.first_sample + chunk.sample_offset[i]);
+        job->columns[1].push_back(chunk.first_time_us + chunk.time_offset[i]);
+        for (size_t c = 2; c < job->names.size(); c++) job->columns[c].push_back(file.volts(chunk.codes[c - 2][i]));
+      }
+    }
+  } else {
+    daq::CsvData data;
+    if (!daq::parse_csv_file(path.c_str(), &data)) {
+      *error = strerror(errno);
+      return false;
+    }
+    job->names = std::move(data.names);
+    job->columns = std::move(data.columns);
+    job->rejected = data.rejected;
+  }
+  job->rows = job->columns.empty() ? 0 : job->columns[0].size();
+  return true;
+}
+
+// filter_and_save_data()'s rate: the configured period if the file has
+// it; on the hardware clock the median of the positive steps (one period,
+// where drops and garbled rows don't move it); jittered loop() stamps
+// are averaged
+double sample_rate(const std::vector<double> &time, bool time_us, uint32_t period_us) {
+  size_t n = time.size();
+  if (time_us && period_us) return 1e6 / period_us;
+  if (n < 2) return 0;
+  if (!time_us) return 1000.0 * (n - 1) / (time[n - 1] - time[0]);
+  std::vector<double> steps;
+  steps.reserve(n - 1);
+  for (size_t i = 1; i < n; i++) {
+    if (time[i] > time[i - 1]) steps.push_back(time[i] - time[i - 1]);
+  }
+  if (steps.empty()) return 0;
+  // numpy's median: the middle one, or the mean of the middle two
+  size_t mid = steps.size() / 2;
+  std::nth_element(steps.begin(), steps.begin() + mid, steps.end());
+  double median = steps[mid];
+  if (steps.size() % 2 == 0) median = (median + *std::max_element(steps.begin(), steps.begin() + mid)) / 2;
+  return 1e6 / median;
+}
+
+bool filter(Job *job, const Settings &settings, daq::Interp interp, std::string *error) {
+  const std::vector<std::string> &names = job->names;
+  job->time_column = std::find(names.begin(), names.end(), "Time(us)") - names.begin();
+  job->time_us = job->time_column < names.size();
+  if (!job->time_us) job->time_column = std::find(names.begin(), names.end(), "Time(ms)") - names.begin();
+  if (job->time_column == names.size() || !job->rows) {
+    *error = "no rows (no Sample,Time header?)";
+    return false;
+  }
+  const std::vector<double> &time = job->columns[job->time_column];
+  job->fs = sample_rate(time, job->time_us, job->period_us);
+  if (!(job->fs > 0)) {
+    *error = "can't tell the sample rate";
+    return false;
+  }
+  for (size_t c = 0; c < job->names.size(); c++) {
+    if (is_channel(job->names[c])) job->channels.push_back(c);
+  }
+  if (job->channels.empty()) return true;
+
+  std::vector<double> sos = daq::butter_lowpass(settings.order, settings.cutoff, job->fs);
+  if (sos.empty()) {
+    *error = "cutoff must be below half the sample rate (" + std::to_string(job->fs / 2) + " Hz)";
+    return false;
+  }
+
+  // Onto the uniform grid, all channels together
+  const size_t n = job->rows, channels = job->channels.size();
+  const double to_s = job->time_us ? 1e-6 : 1e-3, period = 1.0 / job->fs;
+  std::vector<double> t(n), in(channels * n);
+  for (size_t i = 0; i < n; i++) t[i] = time[i] * to_s;
+  for (size_t c = 0; c < channels; c++) {
+    std::copy(job->columns[job->channels[c]].begin(), job->columns[job->channels[c]].end(), in.begin() + c * n);
+  }
+  size_t count = daq::resample_count(t.data(), n, period);
+  std::vector<double> grid(count), uniform(channels * count);
+  size_t m = daq::resample(t.data(), in.data(), channels, n, period, interp, grid.data(), uniform.data());
+  if (m < count) {
+    *error = "timestamps go backwards";
+    return false;
+  }
+  in = std::vector<double>();
+  if (!daq::sosfiltfilt(sos.data(), sos.size() / 6, uniform.data(), uniform.data(), channels, m)) {
+    *error = "too short for the filter (" + std::to_string(m) + " samples)";
+    return false;
+  }
+
+  // Back at the rows' times, linearly as np.interp()
+  job->filtered.assign(channels, std::vector<double>(n));
+  for (size_t i = 0; i < n; i++) {
+    double x = (t[i] - grid[0]) * job->fs;
+    size_t k = x <= 0 ? 0 : std::min((size_t)x, m > 1 ? m - 2 : 0);
+    double frac = m > 1 ? std::min(std::max(x - k, 0.0), 1.0) : 0;
+    for (size_t c = 0; c < channels; c++) {
+      const double *y = &uniform[c * m];
+      job->filtered[c][i] = m > 1 ? y[k] + frac * (y[k + 1] - y[k]) : y[0];
+    }
+  }
+  return true;
+}
+
+std::string format_number(const char *format, double value) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), format, value);
+  return buf;
+}
+
+// Rows [first, first + block_rows) as CSV text
+void format_block(Job *job, size_t block) {
+  const size_t first = block * block_rows, last = std::min(first + block_rows, job->rows);
+  std::string &out = job->blocks[block];
+  out.reserve((last - first) * (job->names.size() + job->channels.size() + 1) * 10);
+  char buf[48];
+  for (size_t i = first; i < last; i++) {
+    for (size_t c = 0; c < job->columns.size(); c++) {
+      int len = snprintf(buf, sizeof(buf), c ? ",%.12g" : "%.12g", job->columns[c][i]);
+      out.append(buf, len);
+    }
+    // filter_and_save_data() adds Time(ms) next to a Time(us)
+    if (job->time_us) {
+      int len = snprintf(buf, sizeof(buf), ",%.12g", job->columns[job->time_column][i] / 1000.0);
+      out.append(buf, len);
+    }
+    for (const std::vector<double> &column : job->filtered) {
+      int len = snprintf(buf, sizeof(buf), ",%.9g", column[i]);
+      out.append(buf, len);
+    }
+    out += '\n';
+  }
+}
+
+std::string filtered_path(const std::string &path) {
+  size_t dot = path.rfind('.');
+  return (dot == std::string::npos || path.find('/', dot) != std::string::npos ? path : path.substr(0, dot)) +
+         "_filtered.csv";
+}
+
+class Batch {
+ public:
+  Batch(const std::string &dir, const Settings &settings, daq::Interp interp, int threads)
+      : dir_(dir), settings_(settings), interp_(interp), pool_(threads) {
+    stamp_ = format_number(",%.6g", settings.cutoff) + "," + std::to_string(settings.order) + "," +
+             settings.interp;
+  }
+
+  // Reads the last run's summary; false if it exists and can't be read
+  bool load_summary() {
+    FILE *f = fopen((dir_ + "/" + summary_name).c_str(), "r");
+    if (!f) return errno == ENOENT;
+    char *line = nullptr;
+    size_t cap = 0;
+    bool header = true;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) > 0) {
+      std::string row(line, len);
+      while (!row.empty() && (row.back() == '\n' || row.back() == '\r')) row.pop_back();
+      if (header) {
+        header = false;
+        continue;
+      }
+      summary_[row.substr(0, row.find(','))].push_back(row);
+    }
+    free(line);
+    fclose(f);
+    return true;
+  }
+
+  // Whether input's summary rows were made from this version of it with
+  // these settings, and its output is still there
+  bool up_to_date(const Input &input) const {
+    auto it = summary_.find(input.name);
+    if (it == summary_.end()) return false;
+    std::string stamp = stamp_fields_of(it->second[0]);
+    struct stat st;
+    return stamp == this->stamp(input) && stat(filtered_path(input.path).c_str(), &st) == 0;
+  }
+
+  void keep_only(const std::vector<Input> &inputs) {
+    std::map<std::string, std::vector<std::string>> kept;
+    for (const Input &input : inputs) {
+      auto it = summary_.find(input.name);
+      if (it != summary_.end()) kept[input.name] = it->second;
+    }
+    summary_.swap(kept);
+  }
+
+  void submit(const Input &input) {
+    std::shared_ptr<Job> job(new Job);
+    job->input = input;
+    pool_.submit([this, job] { process(job); });
+  }
+
+  // Runs everything submitted; false if the summary couldn't be written
+  bool run() {
+    pool_.wait();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return write_summary();
+  }
+
+  int threads() const { return pool_.size(); }
+  uint64_t steals() const { return pool_.steals(); }
+  uint64_t done() const { return done_; }
+  uint64_t failed() const { return failed_; }
+  uint64_t rows() const { return rows_; }
+
+ private:
+  std::string stamp(const Input &input) const {
+    return input.name + "," + std::to_string(input.size) + "," + std::to_string(input.mtime_ns) + stamp_;
+  }
+
+  static std::string stamp_fields_of(const std::string &row) {
+    size_t end = std::string::npos;
+    for (int k = 0, from = 0; k < stamp_fields; k++, from = end + 1) {
+      end = row.find(',', from);
+      if (end == std::string::npos) break;
+    }
+    return row.substr(0, end);
+  }
+
+  void fail(const Job &job, const std::string &error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fprintf(stderr, "%s: %s\n", job.input.name.c_str(), error.c_str());
+    // Not summarized, so the next run tries it again
+    summary_.erase(job.input.name);
+    failed_++;
+  }
+
+  void process(std::shared_ptr<Job> job) {
+    job->started = std::chrono::steady_clock::now();
+    std::string error;
+    if (!load(job.get(), &error) || !filter(job.get(), settings_, interp_, &error)) {
+      fail(*job, error);
+      return;
+    }
+    size_t blocks = (job->rows + block_rows - 1) / block_rows;
+    job->blocks.resize(blocks);
+    job->pending = blocks;
+    for (size_t b = 0; b < blocks; b++) {
+      pool_.submit([this, job, b] {
+        format_block(job.get(), b);
+        if (!--job->pending) finish(job);
+      });
+    }
+  }
+
+  void finish(std::shared_ptr<Job> job) {
+    // Written aside and renamed, so an interrupted run never leaves a
+    // partial file that looks finished
+    std::string path = filtered_path(job->input.path), tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    bool ok = f != nullptr;
+    if (ok) {
+      for (size_t c = 0; c < job->names.size(); c++) fprintf(f, c ? ",%s" : "%s", job->names[c].c_str());
+      if (job->time_us) fprintf(f, ",Time(ms)");
+      for (size_t c : job->channels) fprintf(f, ",%s_filtered", job->names[c].c_str());
+      fprintf(f, "\n");
+      for (const std::string &block : job->blocks) ok = ok && fwrite(block.data(), 1, block.size(), f) == block.size();
+      ok = fclose(f) == 0 && ok;
+    }
+    if (!ok || rename(tmp.c_str(), path.c_str())) {
+      unlink(tmp.c_str());
+      fail(*job, path + ": " + strerror(errno));
+      return;
+    }
+    job->blocks = std::vector<std::string>();
+
+    std::vector<std::string> rows = summarize(*job);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->started).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    summary_[job->input.name] = rows;
+    done_++;
+    rows_ += job->rows;
+    fprintf(stderr, "%s: %zu rows at %.1f Hz%s, %.2f s\n", job->input.name.c_str(), job->rows, job->fs,
+            job->rejected ? (", " + std::to_string(job->rejected) + " invalid lines skipped").c_str() : "",
+            elapsed);
+    // Saved as files finish, so an interrupted batch keeps most of what it
+    // did; a file left out is redone by the next run
+    auto now = std::chrono::steady_clock::now();
+    if (++unsaved_ >= summary_every_files || std::chrono::duration<double>(now - saved_).count() >= summary_every_s) {
+      unsaved_ = 0;
+      saved_ = now;
+      if (!write_summary()) fprintf(stderr, "%s/%s: %s\n", dir_.c_str(), summary_name, strerror(errno));
+    }
+  }
+
+  std::vector<std::string> summarize(const Job &job) const {
+    std::string head = stamp(job.input) + "," + std::to_string(job.rows) + "," + std::to_string(job.rejected) +
+                       format_number(",%.6g", job.fs);
+    std::vector<std::string> rows;
+    if (job.channels.empty()) rows.push_back(head + ",,,,,,,");
+    for (size_t c = 0; c < job.channels.size(); c++) {
+      const std::vector<double> &x = job.columns[job.channels[c]], &y = job.filtered[c];
+      double sum = 0, lo = x[0], hi = x[0];
+      for (double v : x) {
+        sum += v;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+      }
+      double mean = sum / x.size(), var = 0, residual = 0;
+      for (size_t i = 0; i < x.size(); i++) {
+        var += (x[i] - mean) * (x[i] - mean);
+        residual += (x[i] - y[i]) * (x[i] - y[i]);
+      }
+      char buf[256];
+      snprintf(buf, sizeof(buf), ",%s,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g", job.names[job.channels[c]].c_str(), mean,
+               sqrt(var / x.size()), lo, hi, daq::noise_rms(x.data(), x.size()), sqrt(residual / x.size()));
+      rows.push_back(head + buf);
+    }
+    return rows;
+  }
+
+  // With mutex_ held
+  bool write_summary() {
+    std::string path = dir_ + "/" + summary_name, tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "%s\n", summary_header);
+    for (const auto &file : summary_) {
+      for (const std::string &row : file.second) fprintf(f, "%s\n", row.c_str());
+    }
+    if (fclose(f) || rename(tmp.c_str(), path.c_str())) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  std::string dir_;
+  Settings settings_;
+  daq::Interp interp_;
+  std::string stamp_;  // the settings' summary fields
+  std::mutex mutex_;
+  std::map<std::string, std::vector<std::string>> summary_;  // by file name, rows as written
+  uint64_t done_ = 0, failed_ = 0, rows_ = 0;
+  int unsaved_ = 0;  // files finished since the summary was last written
+  std::chrono::steady_clock::time_point saved_ = std::chrono::steady_clock::now();
+  // Last, so it's stopped before anything its tasks use goes
+  daq::WorkStealingPool pool_;
+};
+
+bool ends_with(const std::string &s, const char *tail) {
+  size_t n = strlen(tail);
+  return s.size() >= n && !s.compare(s.size() - n, n, tail);
+}
+
+// The directory's inputs, biggest first
+bool find_inputs(const std::string &dir, const std::vector<std::string> &patterns, std::vector<Input> *inputs) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return false;
+  while (struct dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (ends_with(name, "_filtered.csv") || ends_with(name, ".tmp")) continue;
+    bool match = false;
+    for (const std::string &pattern : patterns) match = match || !fnmatch(pattern.c_str(), name.c_str(), 0);
+    struct stat st;
+    std::string path = dir + "/" + name;
+    if (!match || stat(path.c_str(), &st) || !S_ISREG(st.st_mode)) continue;
+    inputs->push_back(Input{name, path, (uint64_t)st.st_size,
+                            (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec});
+  }
+  closedir(d);
+  std::sort(inputs->begin(), inputs->end(), [](const Input &a, const Input &b) {
+    return a.size != b.size ? a.size > b.size : a.name < b.name;
+  });
+  return true;
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--cutoff HZ] [--order N] [--interp linear|cubic|sinc] [--match GLOB]...\n"
+          "       [--threads N] [--force] [-n] [DIR]\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string dir = ".";
+  bool have_dir = false, force = false, dry_run = false;
+  Settings settings;
+  std::vector<std::string> patterns;
+  int threads = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--cutoff") && i + 1 < argc) {
+      settings.cutoff = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--order") && i + 1 < argc) {
+      settings.order = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--interp") && i + 1 < argc) {
+      settings.interp = argv[++i];
+    } else if (!strcmp(argv[i], "--match") && i + 1 < argc) {
+      patterns.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--force")) {
+      force = true;
+    } else if (!strcmp(argv[i], "-n")) {
+      dry_run = true;
+    } else if (argv[i][0] != '-' && !have_dir) {
+      dir = argv[i];
+      have_dir = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  daq::Interp interp;
+  if (!daq::parse_interp(settings.interp.c_str(), &interp)) {
+    fprintf(stderr, "unknown interpolation %s\n", settings.interp.c_str());
+    return 2;
+  }
+  if (!(settings.cutoff > 0) || settings.order < 1) {
+    fprintf(stderr, "--cutoff must be above 0 and --order at least 1\n");
+    return 2;
+  }
+  if (patterns.empty()) patterns = {"arduino_daq_data_*.csv", "arduino_daq_data_*.daqc"};
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<Input> inputs;
+  if (!find_inputs(dir, patterns, &inputs)) {
+    fprintf(stderr, "%s: %s\n", dir.c_str(), strerror(errno));
+    return 1;
+  }
+  Batch batch(dir, settings, interp, threads);
+  if (!batch.load_summary()) {
+    fprintf(stderr, "%s/%s: %s\n", dir.c_str(), summary_name, strerror(errno));
+    return 1;
+  }
+  batch.keep_only(inputs);
+
+  size_t current = 0, queued = 0;
+  for (const Input &input : inputs) {
+    if (!force && batch.up_to_date(input)) {
+      current++;
+    } else if (dry_run) {
+      printf("%s\n", input.name.c_str());
+      queued++;
+    } else {
+      batch.submit(input);
+      queued++;
+    }
+  }
+  if (dry_run) {
+    fprintf(stderr, "%zu to process, %zu up to date\n", queued, current);
+    return 0;
+  }
+  if (!batch.run()) {
+    fprintf(stderr, "%s/%s: %s\n", dir.c_str(), summary_name, strerror(errno));
+    return 1;
+  }
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  fprintf(stderr, "%llu processed (%llu rows), %zu up to date, %llu failed in %.2f s on %d threads, %llu tasks stolen\n",
+          (unsigned long long)batch.done(), (unsigned long long)batch.rows(), current,
+          (unsigned long long)batch.failed(), elapsed, batch.threads(), (unsigned long long)batch.steals());
+  if (queued) fprintf(stderr, "Summary in %s/%s\n", dir.c_str(), summary_name);
+  return batch.failed() ? 1 : 0;
+}
@@ -0,0 +1,628 @@
+/*
+ * Native capture for arduino_code.cpp: does what the receive loop in
+ * serial_recive_with_lowpass.py does, without Python in the data path.
+ *
+ * Waits for ARDUINO_DAQ_READY, optionally sends a CONFIG line, starts a
+ * recording and writes the rows until END_OF_DATA. With --stream the
+ * recording runs until Ctrl+C, which sends STOP and drains the rest.
+ * Progress and the summary go to stderr.
+ *
+ * Reading the port, decoding, filtering and writing each run on their
+ * own thread, connected by lock-free rings (spsc.h), so a slow disk or
+ * filter never holds up the serial reads. If the parser ever falls so
+ * far behind that its 16 MB of queue fills up, bytes are dropped and
+ * counted rather than left to overflow the OS buffer.
+ *
+ * The output is a .daqc file (daqc.h: the ADC codes in binary columns,
+ * daqc_export converts it to CSV) unless -o names a .csv, which gets the
+ * same columns the Arduino sends, Time(us) unwrapped past 32 bits.
+ *
+ * --filter adds a low-passed copy of every A<n>(V) column, filtered as the
+ * rows arrive (iir.h) rather than after the file is closed: causal by
+ * default, or with --smooth a fixed-lag forward-backward smoother that
+ * writes rows that many ms late with nearly zero phase.
+ *
+ * usage: daq_capture [options] PORT
+ *   -b BAUD            serial speed (default 115200, ignored on a pty)
+ *   -o FILE            output, .daqc or .csv (default arduino_daq_data_<date>_<time>.daqc)
+ *   --bin              binary frames (START_BIN / STREAM_BIN)
+ *   --stream           record until Ctrl+C (STREAM / STREAM_BIN)
+ *   --config "K=V ..." sent as CONFIG K=V ... before starting
+ *   --ready-timeout S  seconds to wait for ARDUINO_DAQ_READY (default 10)
+ *   --filter HZ[:ORDER]  add A<n>(V)_filtered columns, Butterworth low-pass
+ *                      (default order 4), sample rate from the timestamps
+ *   --smooth MS        with --filter: fixed-lag smoothing over MS
+ *                      (--filter needs a .csv output)
+ *   --stats            show how full each pipeline stage's queue is
+ */
+#include "capture.h"
+#include "daqc.h"
+#include "iir.h"
+#include "spsc.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+volatile sig_atomic_t interrupted = 0;
+
+void on_sigint(int) { interrupted++; }
+
+double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool starts_with(const char *line, size_t len, const char *prefix) {
+  size_t n = strlen(prefix);
+  return len >= n && !memcmp(line, prefix, n);
+}
+
+// Read whatever is there into the decoder, waiting up to timeout_ms for
+// the first byte. Returns bytes read, 0 on timeout or signal, -1 on error.
+long pump(int fd, daq::StreamDecoder &decoder, int timeout_ms) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  int ready = poll(&pfd, 1, timeout_ms);
+  if (ready < 0) return errno == EINTR ? 0 : -1;
+  if (ready == 0) return 0;
+  if (pfd.revents & (POLLERR | POLLNVAL)) return -1;
+
+  static uint8_t chunk[1 << 16];
+  long total = 0;
+  for (;;) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n > 0) {
+      decoder.feed(chunk, n);
+      total += n;
+      if ((size_t)n < sizeof(chunk)) break;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      break;
+    } else {
+      // EOF (pty closed) or error
+      return total ? total : -1;
+    }
+  }
+  return total;
+}
+
+// Read until a line starting with one of prefixes arrives, returns it
+// (empty on timeout)
+std::string wait_for_line(int fd, daq::StreamDecoder &decoder, const char *const *prefixes,
+                          double timeout_s) {
+  std::string found;
+  decoder.on_line = [&](const char *line, size_t len) {
+    if (!found.empty()) return;
+    for (const char *const *p = prefixes; *p; p++) {
+      if (starts_with(line, len, *p)) {
+        found.assign(line, len);
+        return;
+      }
+    }
+    fprintf(stderr, "Received: %.*s\n", (int)len, line);
+  };
+  double deadline = now_s() + timeout_s;
+  while (found.empty() && !interrupted && now_s() < deadline) {
+    if (pump(fd, decoder, 100) < 0) break;
+  }
+  decoder.on_line = nullptr;
+  return found;
+}
+
+bool send_line(int fd, const std::string &line) {
+  std::string out = line + "\n";
+  return daq::write_all(fd, out.data(), out.size());
+}
+
+// ---- Pipeline ----
+//
+// After START the capture runs as stages on their own threads, each
+// handing its output to the next through an SpscRing: reader (port ->
+// blocks of bytes), parser (StreamDecoder -> headers and rows), filter
+// (RowFilter, only with --filter) and writer (CSV or .daqc). The reader
+// never waits on the rest, the later stages wait for room in their ring,
+// which backs up into the byte ring.
+
+struct ByteBlock {
+  size_t len;
+  uint8_t data[1 << 14];
+};
+
+// What the parser and the filter hand on: a header, or a row with its
+// text and filtered values copied in
+struct Record {
+  bool header = false;
+  std::string line;                // header line
+  std::vector<std::string> names;  // and its columns
+  daq::Row row;
+  std::string text;
+  double extra[daq::max_columns];
+  int extra_count = 0;
+
+  void set_row(const daq::Row &r, const double *values = nullptr, int count = 0) {
+    header = false;
+    row = r;
+    if (r.text) {
+      text.assign(r.text, r.text_len);
+      row.text = text.data();
+    }
+    extra_count = count;
+    for (int i = 0; i < count; i++) extra[i] = values[i];
+  }
+};
+
+// A stage's counters, and a view of the ring it fills for --stats
+struct Stage {
+  template <typename T>
+  Stage(const char *name, const daq::SpscRing<T> &ring)
+      : name(name),
+        queued([&ring] { return ring.size(); }),
+        high_water([&ring] { return ring.high_water(); }),
+        pushed([&ring] { return ring.pushed(); }),
+        capacity(ring.capacity()) {}
+
+  const char *name;
+  std::function<size_t()> queued, high_water;
+  std::function<uint64_t()> pushed;
+  size_t capacity;
+  std::atomic<uint64_t> stalls{0};   // times it had to wait for room
+  std::atomic<uint64_t> dropped{0};  // bytes thrown away, ring full (reader)
+  std::atomic<bool> done{false};     // nothing more will be pushed
+};
+
+void idle() { std::this_thread::sleep_for(std::chrono::microseconds(200)); }
+
+// The next free slot of ring, waiting (and counting it) while it's full
+template <typename T>
+T *claim_wait(daq::SpscRing<T> &ring, Stage &stage) {
+  T *slot = ring.claim();
+  if (slot) return slot;
+  stage.stalls++;
+  while (!(slot = ring.claim())) idle();
+  return slot;
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-b BAUD] [-o FILE] [--bin] [--stream] [--config \"K=V ...\"] "
+          "[--ready-timeout S] [--filter HZ[:ORDER]] [--smooth MS] [--stats] PORT\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned long baud = 115200;
+  std::string output;
+  std::string config;
+  bool binary = false;
+  bool streaming = false;
+  double ready_timeout = 10;
+  double filter_hz = 0;
+  int filter_order = 4;
+  double smooth_ms = 0;
+  bool show_stats = false;
+  const char *port = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      baud = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--bin")) {
+      binary = true;
+    } else if (!strcmp(argv[i], "--stream")) {
+      streaming = true;
+    } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+      config = argv[++i];
+    } else if (!strcmp(argv[i], "--ready-timeout") && i + 1 < argc) {
+      ready_timeout = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%lf:%d", &filter_hz, &filter_order) < 1 || filter_hz <= 0 ||
+          filter_order < 1 || filter_order > 12) {
+        fprintf(stderr, "bad --filter %s\n", argv[i]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--smooth") && i + 1 < argc) {
+      smooth_ms = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--stats")) {
+      show_stats = true;
+    } else if (argv[i][0] != '-' && !port) {
+      port = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!port) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // No SA_RESTART, so Ctrl+C wakes poll() up
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sigint;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  int fd = daq::open_serial(port, baud);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", port, strerror(errno));
+    if (errno == EACCES) fprintf(stderr, "You might need to run: sudo usermod -a -G dialout $USER\n");
+    return 1;
+  }
+
+  daq::StreamDecoder decoder;
+
+  // Opening the port resets the Arduino, wait for setup() to finish
+  fprintf(stderr, "Waiting for Arduino to be ready...\n");
+  const char *ready[] = {"ARDUINO_DAQ_READY", nullptr};
+  if (wait_for_line(fd, decoder, ready, ready_timeout).empty()) {
+    if (interrupted) return 1;
+    fprintf(stderr, "Arduino did not respond with ready signal, continuing anyway...\n");
+  }
+
+  if (output.empty()) {
+    char name[64];
+    time_t t = time(nullptr);
+    strftime(name, sizeof(name), "arduino_daq_data_%Y%m%d_%H%M%S.daqc", localtime(&t));
+    output = name;
+  }
+  const bool daqc = output.size() < 4 || output.compare(output.size() - 4, 4, ".csv") != 0;
+  if (daqc && filter_hz > 0) {
+    fprintf(stderr, "--filter writes its columns to a .csv output only\n");
+    return 2;
+  }
+
+  // A .daqc file stores codes, so it needs the sample width; a bare CONFIG
+  // just reports the settings
+  daq::DaqcInfo info;
+  if (!config.empty() || daqc) {
+    const char *replies[] = {"CONFIG:", "CONFIG_ERROR", nullptr};
+    send_line(fd, "CONFIG " + config);
+    std::string reply = wait_for_line(fd, decoder, replies, 3);
+    if (reply.empty()) {
+      if (!config.empty()) {
+        fprintf(stderr, "Arduino did not answer CONFIG (older firmware?)\n");
+        return 1;
+      }
+      fprintf(stderr, "Arduino did not answer CONFIG (older firmware?), assuming 10-bit samples\n");
+    } else {
+      fprintf(stderr, "%s\n", reply.c_str());
+      if (reply.compare(0, 12, "CONFIG_ERROR") == 0) return 1;
+      const char *period = strstr(reply.c_str(), "PERIOD_US=");
+      const char *oversample = strstr(reply.c_str(), "OVERSAMPLE=");
+      if (period) info.period_us = strtoul(period + 10, nullptr, 10);
+      if (oversample) info.code_bits = 10 + atoi(oversample + 11);
+      info.code_max = 1023u << (info.code_bits - 10);
+    }
+  }
+  int out_fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "%s: %s\n", output.c_str(), strerror(errno));
+    return 1;
+  }
+
+  daq::CsvWriter writer(out_fd);
+  std::unique_ptr<daq::DaqcWriter> daqc_writer;  // made once the header names the columns
+  bool complete = false;
+  long collected = -1;
+  long device_dropped = -1;
+  long long link_lost = 0;
+
+  // Between the stages: blocks as read (16 MB, over 20 minutes at
+  // 115200 baud), parsed records, filtered records
+  daq::SpscRing<ByteBlock> bytes(1024);
+  daq::SpscRing<Record> parsed(16384);
+  daq::SpscRing<Record> filtered(16384);
+  const bool use_filter_stage = filter_hz > 0;
+  Stage read_stage("read", bytes), parse_stage("parse", parsed), filter_stage("filter", filtered);
+  std::vector<Stage *> stages = {&read_stage, &parse_stage};
+  if (use_filter_stage) stages.push_back(&filter_stage);
+
+  std::atomic<bool> stop_reading{false};
+  std::atomic<bool> port_lost{false};
+  std::atomic<bool> end_of_data{false};
+  std::atomic<double> last_data{now_s()};
+  std::atomic<uint64_t> rows_received{0};
+
+  // Parser: decoder callbacks turn the bytes into records
+  decoder.reset();
+  decoder.on_row = [&](const daq::Row &row) {
+    claim_wait(parsed, parse_stage)->set_row(row);
+    parsed.push();
+  };
+  decoder.on_line = [&](const char *line, size_t len) {
+    if (starts_with(line, len, "Sample,Time")) {
+      Record *record = claim_wait(parsed, parse_stage);
+      record->header = true;
+      record->line = decoder.header();
+      record->names = decoder.columns();
+      parsed.push();
+    } else if (starts_with(line, len, "RECORDING_COMPLETE")) {
+      complete = true;
+    } else if (starts_with(line, len, "SAMPLES_COLLECTED:")) {
+      collected = atol(std::string(line + 18, len - 18).c_str());
+    } else if (starts_with(line, len, "SAMPLES_DROPPED:")) {
+      device_dropped = atol(std::string(line + 16, len - 16).c_str());
+    } else if (starts_with(line, len, "END_OF_DATA")) {
+      end_of_data = true;
+    } else if (starts_with(line, len, "SEQ:")) {
+      // Every sample up to SEQ was either sent or counted in DROPPED,
+      // anything else went missing on the link
+      unsigned long long seq = 0, dropped = 0;
+      std::string marker(line, len);
+      if (sscanf(marker.c_str(), "SEQ:%llu,DROPPED:%llu", &seq, &dropped) == 2) {
+        long long lost = (long long)(seq - dropped) - (long long)decoder.stats().rows;
+        if (lost > link_lost) {
+          fprintf(stderr, "\nWarning: %lld samples lost on the serial link\n", lost - link_lost);
+          link_lost = lost;
+        }
+      }
+    } else if (!starts_with(line, len, "RECORDING_STARTED")) {
+      fprintf(stderr, "\nReceived: %.*s\n", (int)len, line);
+    }
+  };
+
+  // Filter: live low-pass of the A<n>(V) columns, set up by each header
+  daq::RowFilter filter(filter_order, filter_hz, smooth_ms);
+  bool filtering = false;
+  filter.on_row = [&](const daq::Row &row, const double *values) {
+    claim_wait(filtered, filter_stage)->set_row(row, values, filter.columns().size());
+    filtered.push();
+  };
+
+  // Writer: from the filter if there is one, else straight from the parser
+  daq::SpscRing<Record> &to_write = use_filter_stage ? filtered : parsed;
+  Stage &before_writer = use_filter_stage ? filter_stage : parse_stage;
+  bool written = false;
+
+  const char *start = streaming ? (binary ? "STREAM_BIN" : "STREAM") : (binary ? "START_BIN" : "START");
+  if (!send_line(fd, start)) {
+    fprintf(stderr, "%s: %s\n", port, strerror(errno));
+    return 1;
+  }
+  fprintf(stderr, "Recording data to %s...%s\n", output.c_str(), streaming ? " (Ctrl+C to stop)" : "");
+  double begin = now_s();
+
+  // Never waits on the others: with the byte ring full what was read is
+  // dropped (and counted), the decoder resyncs on what comes next
+  std::thread reader([&] {
+    static uint8_t spill[sizeof(ByteBlock::data)];
+    while (!stop_reading) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      int ready = poll(&pfd, 1, 100);
+      if (ready < 0 && errno != EINTR) break;
+      if (ready <= 0) continue;
+      if (pfd.revents & (POLLERR | POLLNVAL)) break;
+      // Fill the block with whatever is there (the port is non-blocking)
+      ByteBlock *block = bytes.claim();
+      uint8_t *data = block ? block->data : spill;
+      size_t len = 0;
+      ssize_t n;
+      while (len < sizeof(spill) && (n = read(fd, data + len, sizeof(spill) - len)) > 0) len += n;
+      if (len) {
+        last_data = now_s();
+        if (block) {
+          block->len = len;
+          bytes.push();
+        } else {
+          read_stage.dropped += len;
+        }
+      } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+        break;  // EOF (pty closed) or error
+      }
+    }
+    if (!stop_reading) port_lost = true;
+    read_stage.done = true;
+  });
+
+  std::thread parser([&] {
+    for (;;) {
+      ByteBlock *block = bytes.front();
+      if (!block) {
+        if (read_stage.done && !bytes.front()) break;
+        idle();
+        continue;
+      }
+      decoder.feed(block->data, block->len);
+      bytes.pop();
+      rows_received = decoder.stats().rows;
+    }
+    parse_stage.done = true;
+  });
+
+  std::thread filter_thread;
+  if (use_filter_stage) {
+    filter_thread = std::thread([&] {
+      for (;;) {
+        Record *record = parsed.front();
+        if (!record) {
+          if (parse_stage.done && !parsed.front()) break;
+          idle();
+          continue;
+        }
+        if (record->header) {
+          if (filtering) filter.finish();
+          std::vector<int> columns;
+          std::string header = record->line;
+          for (size_t i = 0; i < record->names.size(); i++) {
+            const std::string &name = record->names[i];
+            bool raw = name.size() == 5 && name[0] == 'A' && isdigit((unsigned char)name[1]) &&
+                       name.compare(2, 3, "(V)") == 0;
+            if (raw) {
+              columns.push_back(i);
+              header += "," + name + "_filtered";
+            }
+          }
+          filtering = !columns.empty();
+          filter.start(columns, starts_with(record->line.data(), record->line.size(), "Sample,Time(ms)") ? 1000 : 1);
+          Record *out = claim_wait(filtered, filter_stage);
+          out->header = true;
+          out->line = header;
+          out->names = record->names;
+          filtered.push();
+        } else if (filtering) {
+          filter.push(record->row);
+        } else {
+          claim_wait(filtered, filter_stage)->set_row(record->row);
+          filtered.push();
+        }
+        parsed.pop();
+      }
+      if (filtering) filter.finish();
+      filter_stage.done = true;
+    });
+  }
+
+  // Flushed twice a second, so a .daqc keeps all but the last moments if
+  // the capture dies
+  std::thread writer_thread([&] {
+    double last_flush = now_s();
+    for (uint64_t n = 0;; n++) {
+      Record *record = to_write.front();
+      if (!record || (n & 4095) == 0) {
+        if (now_s() - last_flush > 0.5) {
+          writer.flush();
+          if (daqc_writer) daqc_writer->flush();
+          last_flush = now_s();
+        }
+      }
+      if (!record) {
+        if (before_writer.done && !to_write.front()) break;
+        idle();
+        continue;
+      }
+      if (record->header) {
+        if (daqc) {
+          if (!daqc_writer) {
+            info.names = record->names;
+            daqc_writer.reset(new daq::DaqcWriter(out_fd, info));
+          }
+        } else {
+          writer.header(record->line);
+        }
+      } else if (daqc_writer) {
+        daqc_writer->row(record->row);
+      } else if (!daqc) {
+        writer.row(record->row, record->extra, record->extra_count);
+      }
+      to_write.pop();
+    }
+    writer.flush();
+    written = writer.ok() && (!daqc_writer || daqc_writer->finish());
+  });
+
+  // No fixed timeout: give up after idle_timeout_s without a byte, which
+  // covers any recording length
+  const double idle_timeout_s = 5;
+  double last_progress = begin;
+  bool stop_sent = false;
+  int status = 0;
+
+  while (!end_of_data) {
+    if (interrupted) {
+      if (!stop_sent) {
+        // Ask the Arduino to stop, then keep reading what it still has
+        send_line(fd, "STOP");
+        stop_sent = true;
+        last_data = now_s();
+        fprintf(stderr, "\nStopping...\n");
+      } else if (interrupted > 1) {
+        status = 1;
+        break;
+      }
+    }
+    if (port_lost) {
+      fprintf(stderr, "\n%s: connection lost\n", port);
+      status = 1;
+      break;
+    }
+
+    struct timespec ts = {0, 20 * 1000 * 1000};
+    nanosleep(&ts, nullptr);
+    double now = now_s();
+    if (now - last_data > idle_timeout_s) {
+      fprintf(stderr, "\nNo data for %.0f s, giving up\n", idle_timeout_s);
+      status = 1;
+      break;
+    }
+    if (now - last_progress > 0.5) {
+      fprintf(stderr, "Received %llu data points...", (unsigned long long)rows_received.load());
+      if (show_stats) {
+        for (Stage *stage : stages) fprintf(stderr, " %s %3.0f%%", stage->name, 100.0 * stage->queued() / stage->capacity);
+        if (read_stage.dropped) fprintf(stderr, " dropped %llu B", (unsigned long long)read_stage.dropped.load());
+      }
+      fprintf(stderr, "\r");
+      last_progress = now;
+    }
+  }
+
+  // The reader stops, the rest drain what's queued and finish in turn
+  stop_reading = true;
+  reader.join();
+  parser.join();
+  if (filter_thread.joinable()) filter_thread.join();
+  writer_thread.join();
+  close(out_fd);
+  close(fd);
+
+  const daq::DecoderStats &stats = decoder.stats();
+  double elapsed = now_s() - begin;
+  fprintf(stderr, "\nSaved %llu data points to %s\n", (unsigned long long)stats.rows, output.c_str());
+  if (complete && collected >= 0) fprintf(stderr, "Collected %ld samples\n", collected);
+  if (device_dropped > 0) fprintf(stderr, "Arduino dropped %ld samples\n", device_dropped);
+  if (link_lost > 0) fprintf(stderr, "%lld samples were lost on the serial link\n", link_lost);
+  if (filtering) {
+    if (!filter.sos().empty()) {
+      fprintf(stderr, "Low-pass %d order at %g Hz (%.1f Hz sampling)%s\n", filter_order, filter_hz,
+              filter.sample_rate(), smooth_ms > 0 ? ", smoothed" : "");
+    } else if (filter.sample_rate() > 0) {
+      fprintf(stderr, "Cutoff %g Hz isn't below half the %.1f Hz sampling rate, not filtered\n", filter_hz,
+              filter.sample_rate());
+    }
+  }
+  if (stats.rejected_lines || stats.bad_frames || stats.skipped_bytes) {
+    fprintf(stderr, "Rejected %llu lines, %llu bad frames, skipped %llu bytes\n",
+            (unsigned long long)stats.rejected_lines, (unsigned long long)stats.bad_frames,
+            (unsigned long long)stats.skipped_bytes);
+  }
+  if (read_stage.dropped) {
+    fprintf(stderr, "Dropped %llu bytes, the parser fell behind the port\n",
+            (unsigned long long)read_stage.dropped.load());
+  }
+  if (show_stats) {
+    for (Stage *stage : stages) {
+      fprintf(stderr, "Stage %-6s %10llu out, queue high water %zu/%zu, waited for room %llu times\n", stage->name,
+              (unsigned long long)stage->pushed(), stage->high_water(), stage->capacity,
+              (unsigned long long)stage->stalls.load());
+    }
+  }
+  fprintf(stderr, "%.1f KB in %.2f s (%.1f KB/s)\n", stats.bytes / 1e3, elapsed,
+          elapsed > 0 ? stats.bytes / 1e3 / elapsed : 0);
+  if (!written) {
+    fprintf(stderr, "%s: write failed\n", output.c_str());
+    status = 1;
+  }
+  return status;
+}
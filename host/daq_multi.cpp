@@ -0,0 +1,595 @@
+/*
+ * Synchronized capture from several boards running arduino_code.cpp, one
+ * reader thread per port, merged into one time-aligned recording.
+ *
+ * The boards are opened, waited for and configured in parallel. Once all
+ * of them are ready the threads are released together and send START
+ * within microseconds of each other.
+ *
+ * Each board stamps its samples with its own clock (Time(us)), counted
+ * from its own START and run off its own crystal. To put them on one
+ * timeline every read is also stamped with the host's monotonic clock,
+ * and per board ClockFit estimates host = offset + rate * board: the
+ * offset is where the board's zero falls in host time (the start skew),
+ * the rate its drift against the host (tens of ppm, a few ms per
+ * minute). Both come from a least squares line through the smallest
+ * host - board in each second of board time, the reads that waited least
+ * on the link, so USB and scheduling delays only ever push points up
+ * and the minima track the true offset.
+ *
+ * Each board's rows go to NAME_dev<k>.daqc as received (daqc.h). NAME.csv
+ * then gets the first board's samples on the common timeline (Time(us)
+ * from the moment START was sent), with every other board's channels
+ * interpolated to the same instants, over the span all boards recorded.
+ * Board k's A<n>(V) columns are renamed A<n + 4k>(V), so the Python
+ * scripts see one board with more inputs.
+ *
+ * usage: daq_multi [options] PORT PORT...
+ *   -b BAUD            serial speed (default 115200, ignored on a pty)
+ *   -o NAME            output base name (default arduino_daq_data_<date>_<time>)
+ *   --bin              binary frames (START_BIN / STREAM_BIN)
+ *   --stream           record until Ctrl+C (STREAM / STREAM_BIN)
+ *   --config "K=V ..." sent as CONFIG K=V ... to every board
+ *   --ready-timeout S  seconds to wait for ARDUINO_DAQ_READY (default 10)
+ */
+#include "capture.h"
+#include "daqc.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Inputs per board (analogInputs[] in arduino_code.cpp), for renaming
+// the merged columns
+const int board_inputs = 4;
+
+volatile sig_atomic_t interrupted = 0;
+
+void on_sigint(int) { interrupted++; }
+
+double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+bool starts_with(const char *line, size_t len, const char *prefix) {
+  size_t n = strlen(prefix);
+  return len >= n && !memcmp(line, prefix, n);
+}
+
+bool send_line(int fd, const std::string &line) {
+  std::string out = line + "\n";
+  return daq::write_all(fd, out.data(), out.size());
+}
+
+// host_us = offset + rate * board_us for one board. Each read gives an
+// upper bound on where a row's board time falls on the host clock (it
+// can only arrive after it was sampled); the smallest host - board in
+// each window of board time is the read that waited least, and a least
+// squares line through those minima follows the board clock.
+class ClockFit {
+ public:
+  // board_us of the last row in a read, host_us when the read returned
+  void add(double board_us, double host_us) {
+    double window = floor(board_us / window_us);
+    double d = host_us - board_us;
+    if (!minima_.empty() && minima_.back().window == window) {
+      if (d < minima_.back().d) {
+        minima_.back().board = board_us;
+        minima_.back().d = d;
+      }
+    } else {
+      minima_.push_back(Point{window, board_us, d});
+    }
+  }
+
+  void solve() {
+    offset_ = minima_.empty() ? 0 : minima_[0].d;
+    rate_ = 1;
+    if (minima_.size() < 2) return;
+    // Centered so the board times' size doesn't cost precision
+    double mb = 0, md = 0;
+    for (const Point &p : minima_) {
+      mb += p.board;
+      md += p.d;
+    }
+    mb /= minima_.size();
+    md /= minima_.size();
+    double sbb = 0, sbd = 0;
+    for (const Point &p : minima_) {
+      sbb += (p.board - mb) * (p.board - mb);
+      sbd += (p.board - mb) * (p.d - md);
+    }
+    double slope = sbb > 0 ? sbd / sbb : 0;
+    rate_ = 1 + slope;
+    offset_ = md - slope * mb;
+  }
+
+  double to_host(double board_us) const { return offset_ + rate_ * board_us; }
+  double to_board(double host_us) const { return (host_us - offset_) / rate_; }
+  double drift_ppm() const { return (rate_ - 1) * 1e6; }
+
+ private:
+  static constexpr double window_us = 1e6;
+  struct Point {
+    double window, board, d;
+  };
+  std::vector<Point> minima_;
+  double offset_ = 0, rate_ = 1;
+};
+
+struct Options {
+  unsigned long baud = 115200;
+  std::string config;
+  bool binary = false;
+  bool streaming = false;
+  double ready_timeout = 10;
+};
+
+// Start line: the boards wait at the barrier until all are configured
+// (or one failed), then go together
+struct StartGate {
+  std::mutex mutex;
+  std::condition_variable cv;
+  int arrived = 0;
+  std::atomic<int> go{0};  // 1 start, -1 abort
+  double t0 = 0;           // host time of the release
+};
+
+struct Board {
+  int index = 0;
+  const char *port = nullptr;
+  std::string daqc_path;
+
+  daq::DaqcInfo info;
+  ClockFit clock;
+  std::atomic<uint64_t> rows{0};
+  long device_dropped = -1;
+  double start_sent = 0;  // host us
+  bool ok = false;        // recorded to the end
+  std::string error;
+  std::atomic<bool> done{false};  // the thread has finished with the above
+};
+
+// Read whatever is there into the decoder, waiting up to timeout_ms for
+// the first byte. Returns bytes read, 0 on timeout or signal, -1 on error.
+long pump(int fd, daq::StreamDecoder &decoder, std::vector<uint8_t> &buf, int timeout_ms) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  int ready = poll(&pfd, 1, timeout_ms);
+  if (ready < 0) return errno == EINTR ? 0 : -1;
+  if (ready == 0) return 0;
+  if (pfd.revents & (POLLERR | POLLNVAL)) return -1;
+
+  long total = 0;
+  for (;;) {
+    ssize_t n = read(fd, buf.data(), buf.size());
+    if (n > 0) {
+      decoder.feed(buf.data(), n);
+      total += n;
+      if ((size_t)n < buf.size()) break;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      break;
+    } else {
+      return total ? total : -1;
+    }
+  }
+  return total;
+}
+
+// Wait for a line starting with prefix, returns it (empty on timeout)
+std::string wait_for_line(int fd, daq::StreamDecoder &decoder, std::vector<uint8_t> &buf, const char *prefix,
+                          const char *alt_prefix, double timeout_s) {
+  std::string found;
+  decoder.on_line = [&](const char *line, size_t len) {
+    if (found.empty() && (starts_with(line, len, prefix) || (alt_prefix && starts_with(line, len, alt_prefix)))) {
+      found.assign(line, len);
+    }
+  };
+  double deadline = now_us() + timeout_s * 1e6;
+  while (found.empty() && !interrupted && now_us() < deadline) {
+    if (pump(fd, decoder, buf, 100) < 0) break;
+  }
+  decoder.on_line = nullptr;
+  return found;
+}
+
+// One board, start to finish: open, ready, CONFIG, wait at the gate,
+// START, record into board.daqc_path
+void run_board(Board &board, const Options &options, StartGate &gate) {
+  int fd = -1, out_fd = -1;
+  std::vector<uint8_t> buf(1 << 16);
+  daq::StreamDecoder decoder;
+  bool ready = false;
+
+  fd = daq::open_serial(board.port, options.baud);
+  if (fd < 0) {
+    board.error = strerror(errno);
+  } else {
+    // Opening the port resets the Arduino
+    if (wait_for_line(fd, decoder, buf, "ARDUINO_DAQ_READY", nullptr, options.ready_timeout).empty()) {
+      fprintf(stderr, "%s: no ready signal, continuing anyway...\n", board.port);
+    }
+    send_line(fd, "CONFIG " + options.config);
+    std::string reply = wait_for_line(fd, decoder, buf, "CONFIG:", "CONFIG_ERROR", 3);
+    if (reply.empty()) {
+      board.error = "no answer to CONFIG (older firmware?)";
+    } else if (starts_with(reply.c_str(), reply.size(), "CONFIG_ERROR")) {
+      board.error = reply;
+    } else {
+      const char *period = strstr(reply.c_str(), "PERIOD_US=");
+      const char *oversample = strstr(reply.c_str(), "OVERSAMPLE=");
+      if (period) board.info.period_us = strtoul(period + 10, nullptr, 10);
+      if (oversample) board.info.code_bits = 10 + atoi(oversample + 11);
+      board.info.code_max = 1023u << (board.info.code_bits - 10);
+      out_fd = open(board.daqc_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (out_fd < 0) {
+        board.error = board.daqc_path + ": " + strerror(errno);
+      } else {
+        fprintf(stderr, "%s: %s\n", board.port, reply.c_str());
+        ready = true;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(gate.mutex);
+    gate.arrived++;
+    if (!ready) gate.go = -1;
+  }
+  gate.cv.notify_all();
+  if (!ready) {
+    if (fd >= 0) close(fd);
+    return;
+  }
+
+  // Spin rather than sleep, so every thread sees the release at once
+  const std::string start = options.streaming ? (options.binary ? "STREAM_BIN\n" : "STREAM\n")
+                                              : (options.binary ? "START_BIN\n" : "START\n");
+  while (!gate.go) std::this_thread::yield();
+  if (gate.go < 0) {
+    close(out_fd);
+    unlink(board.daqc_path.c_str());
+    close(fd);
+    return;
+  }
+  daq::write_all(fd, start.data(), start.size());
+  board.start_sent = now_us();
+
+  std::unique_ptr<daq::DaqcWriter> writer;
+  bool end_of_data = false;
+  bool stop_sent = false;
+  bool have_row = false;
+  uint64_t last_time = 0;
+  decoder.reset();
+  decoder.on_row = [&](const daq::Row &row) {
+    if (writer) writer->row(row);
+    last_time = row.time_us;
+    have_row = true;
+  };
+  decoder.on_line = [&](const char *line, size_t len) {
+    if (starts_with(line, len, "Sample,Time")) {
+      if (!writer) {
+        board.info.names = decoder.columns();
+        writer.reset(new daq::DaqcWriter(out_fd, board.info));
+      }
+    } else if (starts_with(line, len, "SAMPLES_DROPPED:")) {
+      board.device_dropped = atol(std::string(line + 16, len - 16).c_str());
+    } else if (starts_with(line, len, "END_OF_DATA")) {
+      end_of_data = true;
+    } else if (!starts_with(line, len, "RECORDING_") && !starts_with(line, len, "SAMPLES_") &&
+               !starts_with(line, len, "SEQ:")) {
+      fprintf(stderr, "\n%s: %.*s\n", board.port, (int)len, line);
+    }
+  };
+
+  const double idle_timeout_us = 5e6;
+  double last_data = now_us();
+  double last_flush = last_data;
+  while (!end_of_data) {
+    if (interrupted && !stop_sent) {
+      send_line(fd, "STOP");
+      stop_sent = true;
+      last_data = now_us();
+    } else if (interrupted > 1) {
+      board.error = "interrupted";
+      break;
+    }
+
+    have_row = false;
+    long n = pump(fd, decoder, buf, 100);
+    double now = now_us();
+    if (n < 0) {
+      board.error = "connection lost";
+      break;
+    }
+    if (have_row) board.clock.add(last_time, now);
+    if (n > 0) last_data = now;
+    if (now - last_data > idle_timeout_us) {
+      board.error = "no data for 5 s";
+      break;
+    }
+    if (now - last_flush > 5e5) {
+      if (writer) writer->flush();
+      last_flush = now;
+    }
+    board.rows = decoder.stats().rows;
+  }
+
+  board.ok = end_of_data && (!writer || writer->finish());
+  if (!writer) {
+    // No header came, leave an empty file rather than none
+    daq::DaqcWriter empty(out_fd, board.info);
+  }
+  writer.reset();
+  close(out_fd);
+  close(fd);
+}
+
+// Walks one board's rows in time order, interpolating every channel at
+// non-decreasing board times
+class Cursor {
+ public:
+  explicit Cursor(const daq::DaqcFile &file) : file_(file) {}
+
+  // false before the first row or after the last
+  bool at(double t, double *values) {
+    const std::vector<daq::DaqcFile::Chunk> &chunks = file_.chunks();
+    while (chunk_ < chunks.size() && time(chunk_, row_) < t) {
+      prev_chunk_ = chunk_;
+      prev_row_ = row_;
+      have_prev_ = true;
+      if (++row_ == chunks[chunk_].rows) {
+        chunk_++;
+        row_ = 0;
+      }
+    }
+    if (chunk_ == chunks.size()) return false;
+
+    const int channels = file_.info().names.size();
+    const daq::DaqcFile::Chunk &next = chunks[chunk_];
+    double t1 = time(chunk_, row_);
+    if (t1 == t || !have_prev_) {
+      if (t1 != t) return false;
+      for (int c = 0; c < channels; c++) values[c] = file_.volts(next.codes[c][row_]);
+      return true;
+    }
+    const daq::DaqcFile::Chunk &prev = chunks[prev_chunk_];
+    double w = (t - time(prev_chunk_, prev_row_)) / (t1 - time(prev_chunk_, prev_row_));
+    for (int c = 0; c < channels; c++) {
+      double v0 = file_.volts(prev.codes[c][prev_row_]), v1 = file_.volts(next.codes[c][row_]);
+      values[c] = v0 + w * (v1 - v0);
+    }
+    return true;
+  }
+
+ private:
+  double time(size_t chunk, uint32_t row) const {
+    const daq::DaqcFile::Chunk &c = file_.chunks()[chunk];
+    return c.first_time_us + c.time_offset[row];
+  }
+
+  const daq::DaqcFile &file_;
+  size_t chunk_ = 0, prev_chunk_ = 0;
+  uint32_t row_ = 0, prev_row_ = 0;
+  bool have_prev_ = false;
+};
+
+// A<n>(V)... of board k becomes A<n + 4k>(V)...
+std::string merged_name(const std::string &name, int board) {
+  size_t digits = 1;
+  while (digits < name.size() && isdigit((unsigned char)name[digits])) digits++;
+  if (name.size() < 2 || name[0] != 'A' || digits == 1 || name.compare(digits, 3, "(V)") != 0) {
+    return name + "_dev" + std::to_string(board);
+  }
+  int n = atoi(name.c_str() + 1) + board_inputs * board;
+  return "A" + std::to_string(n) + name.substr(digits);
+}
+
+// Board 0's rows on the common timeline with the others interpolated in.
+// Returns rows written, -1 on failure.
+long merge(std::vector<std::unique_ptr<Board>> &boards, double t0, const std::string &path) {
+  std::vector<std::unique_ptr<daq::DaqcFile>> files;
+  std::string header = "Sample,Time(us)";
+  int total = 0;
+  for (auto &board : boards) {
+    files.emplace_back(new daq::DaqcFile);
+    if (!files.back()->open(board->daqc_path.c_str())) {
+      fprintf(stderr, "%s: %s\n", board->daqc_path.c_str(), files.back()->error().c_str());
+      return -1;
+    }
+    for (const std::string &name : files.back()->info().names) header += "," + merged_name(name, board->index);
+    total += files.back()->info().names.size();
+  }
+
+  int out_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return -1;
+  }
+  daq::CsvWriter writer(out_fd);
+  writer.header(header);
+
+  std::vector<Cursor> cursors;
+  for (auto &file : files) cursors.emplace_back(*file);
+  std::vector<double> values(total);
+  daq::Row row;
+  row.text = nullptr;
+  row.text_len = 0;
+  row.count = 0;
+  row.code_bits = 10;
+
+  long written = 0;
+  const daq::DaqcFile &ref = *files[0];
+  for (const daq::DaqcFile::Chunk &chunk : ref.chunks()) {
+    for (uint32_t i = 0; i < chunk.rows; i++) {
+      double host = boards[0]->clock.to_host(chunk.first_time_us + chunk.time_offset[i]);
+      int at = 0;
+      bool inside = true;
+      for (size_t k = 0; k < files.size() && inside; k++) {
+        inside = cursors[k].at(k ? boards[k]->clock.to_board(host) : chunk.first_time_us + chunk.time_offset[i],
+                               values.data() + at);
+        at += files[k]->info().names.size();
+      }
+      if (!inside) continue;
+      row.sample = chunk.first_sample + chunk.sample_offset[i];
+      row.time_us = host > t0 ? llround(host - t0) : 0;
+      writer.row(row, values.data(), total);
+      written++;
+    }
+  }
+
+  bool ok = writer.flush();
+  close(out_fd);
+  return ok ? written : -1;
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-b BAUD] [-o NAME] [--bin] [--stream] [--config \"K=V ...\"] "
+          "[--ready-timeout S] PORT PORT...\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string name;
+  std::vector<const char *> ports;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      options.baud = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      name = argv[++i];
+    } else if (!strcmp(argv[i], "--bin")) {
+      options.binary = true;
+    } else if (!strcmp(argv[i], "--stream")) {
+      options.streaming = true;
+    } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+      options.config = argv[++i];
+    } else if (!strcmp(argv[i], "--ready-timeout") && i + 1 < argc) {
+      options.ready_timeout = atof(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      ports.push_back(argv[i]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (ports.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (name.empty()) {
+    char buf[64];
+    time_t t = time(nullptr);
+    strftime(buf, sizeof(buf), "arduino_daq_data_%Y%m%d_%H%M%S", localtime(&t));
+    name = buf;
+  } else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+    name.resize(name.size() - 4);
+  }
+
+  // No SA_RESTART, so Ctrl+C wakes poll() up
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sigint;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  std::vector<std::unique_ptr<Board>> boards;
+  for (size_t i = 0; i < ports.size(); i++) {
+    boards.emplace_back(new Board);
+    boards.back()->index = i;
+    boards.back()->port = ports[i];
+    boards.back()->daqc_path = name + "_dev" + std::to_string(i) + ".daqc";
+  }
+
+  fprintf(stderr, "Waiting for %zu boards to be ready...\n", boards.size());
+  StartGate gate;
+  std::vector<std::thread> threads;
+  for (auto &board : boards) {
+    Board *b = board.get();
+    threads.emplace_back([b, &options, &gate] {
+      run_board(*b, options, gate);
+      b->done = true;
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(gate.mutex);
+    gate.cv.wait(lock, [&] { return gate.arrived == (int)boards.size(); });
+  }
+  int status = 0;
+  if (gate.go < 0 || interrupted) {
+    gate.go = -1;
+    status = 1;
+  } else {
+    gate.t0 = now_us();
+    gate.go = 1;
+    fprintf(stderr, "Recording from %zu boards...%s\n", boards.size(), options.streaming ? " (Ctrl+C to stop)" : "");
+  }
+
+  // Progress until the readers are done
+  double last_progress = 0;
+  for (;;) {
+    bool all_done = true;
+    uint64_t rows = 0;
+    for (auto &board : boards) {
+      all_done &= board->done;
+      rows += board->rows;
+    }
+    if (all_done) break;
+    if (status == 0 && now_us() - last_progress > 5e5) {
+      fprintf(stderr, "Received %llu data points...\r", (unsigned long long)rows);
+      last_progress = now_us();
+    }
+    struct timespec ts = {0, 100 * 1000 * 1000};
+    nanosleep(&ts, nullptr);
+  }
+  for (auto &thread : threads) thread.join();
+
+  fprintf(stderr, "\n");
+  for (auto &board : boards) {
+    if (!board->error.empty()) {
+      fprintf(stderr, "%s: %s\n", board->port, board->error.c_str());
+      status = 1;
+    }
+  }
+  if (gate.go < 0) return 1;
+
+  for (auto &board : boards) {
+    board->clock.solve();
+    fprintf(stderr, "%s: %llu rows -> %s, START at +%.0f us, clock zero at %+.0f us, drift %+.1f ppm\n",
+            board->port, (unsigned long long)board->rows.load(), board->daqc_path.c_str(),
+            board->start_sent - gate.t0, board->clock.to_host(0) - gate.t0, board->clock.drift_ppm());
+    if (board->device_dropped > 0) fprintf(stderr, "%s: Arduino dropped %ld samples\n", board->port, board->device_dropped);
+  }
+
+  std::string merged = name + ".csv";
+  long rows = merge(boards, gate.t0, merged);
+  if (rows < 0) return 1;
+  fprintf(stderr, "Saved %ld time-aligned rows to %s\n", rows, merged.c_str());
+  return status;
+}
@@ -0,0 +1,307 @@
+/*
+ * Board simulator for testing receivers without an Arduino: runs
+ * arduino_code.cpp on the host shim behind a pseudo-terminal.
+ *
+ * Receivers open the pty like a real port (the path is printed, and
+ * --link makes a stable symlink to it). Like the board, the sketch is
+ * reset every time a receiver opens the port and sends
+ * ARDUINO_DAQ_READY a second later; after that every command (START,
+ * STREAM, CONFIG, ...) is answered by the real sketch code, so the
+ * output is exactly what the hardware sends.
+ *
+ * Virtual time runs at --speed times real time, so with CONFIG
+ * PERIOD_US=100 and --speed 10 a receiver sees 100k rows/s. The inputs
+ * can be given waveforms and noise, and the byte stream can be corrupted
+ * on its way to the pty to exercise the receivers' resync paths.
+ *
+ * usage: daq_sim [options]
+ *   --link PATH          symlink PATH to the pty (replaced if it exists)
+ *   --speed X            virtual seconds per real second (default 1, 0 = flat out)
+ *   --baud N             UART rate the sketch is limited to (default 115200)
+ *   --no-uart            don't model the UART at all
+ *   --wave CH:TYPE[:FREQ[:AMP[:OFFSET]]]
+ *                        input CH (0-3) waveform: sine, square, triangle,
+ *                        saw or dc; FREQ Hz, AMP and OFFSET volts
+ *                        (default sine:0.5:2:2.5, the shim's default inputs)
+ *   --noise SIGMA        gaussian noise in volts on every input
+ *   --drop-bytes P       drop each output byte with probability P
+ *   --garbage-lines P    after each '\n', insert a garbage line with probability P
+ *   --seed N             random seed for noise and faults (default 1)
+ */
+#include "Arduino.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Wave {
+  std::string type = "sine";
+  double freq = 0.5;
+  double amp = 2.0;
+  double offset = 2.5;
+  double phase = 0;
+};
+
+struct Faults {
+  double drop_bytes = 0;
+  double garbage_lines = 0;
+  uint64_t dropped = 0;
+  uint64_t garbage = 0;
+};
+
+volatile sig_atomic_t quit = 0;
+
+void on_signal(int) { quit = 1; }
+
+double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double wave_value(const Wave &w, double t) {
+  double cycles = w.freq * t + w.phase;
+  double frac = cycles - floor(cycles);
+  if (w.type == "square") return w.offset + (frac < 0.5 ? w.amp : -w.amp);
+  if (w.type == "triangle") return w.offset + w.amp * (frac < 0.5 ? 4 * frac - 1 : 3 - 4 * frac);
+  if (w.type == "saw") return w.offset + w.amp * (2 * frac - 1);
+  if (w.type == "dc") return w.offset;
+  return w.offset + w.amp * sin(2 * M_PI * cycles);
+}
+
+// CH:TYPE[:FREQ[:AMP[:OFFSET]]]
+bool parse_wave(const char *arg, std::vector<Wave> &waves) {
+  char type[16];
+  int ch;
+  double freq, amp, offset;
+  int n = sscanf(arg, "%d:%15[a-z]:%lf:%lf:%lf", &ch, type, &freq, &amp, &offset);
+  if (n < 2 || ch < 0 || ch > 3) return false;
+  Wave &w = waves[ch];
+  w.type = type;
+  if (w.type != "sine" && w.type != "square" && w.type != "triangle" && w.type != "saw" &&
+      w.type != "dc") {
+    return false;
+  }
+  if (n > 2) w.freq = freq;
+  if (n > 3) w.amp = amp;
+  if (n > 4) w.offset = offset;
+  return true;
+}
+
+// Write to the pty master, waiting while the slave side's buffer is full
+void write_master(int fd, const uint8_t *p, size_t len) {
+  while (len && !quit) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        poll(&pfd, 1, 10);
+        continue;
+      }
+      return;  // EIO: receiver went away, its reopen resets the sketch anyway
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--link PATH] [--speed X] [--baud N] [--no-uart] "
+          "[--wave CH:TYPE[:FREQ[:AMP[:OFFSET]]]] [--noise SIGMA] [--drop-bytes P] "
+          "[--garbage-lines P] [--seed N]\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *link_path = nullptr;
+  double speed = 1;
+  unsigned long baud = 115200;
+  bool uart = true;
+  double noise = 0;
+  unsigned seed = 1;
+  Faults faults;
+  std::vector<Wave> waves(4);
+  for (int i = 0; i < 4; i++) waves[i].phase = i * 0.25;  // a quarter period apart
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--link") && i + 1 < argc) {
+      link_path = argv[++i];
+    } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--baud") && i + 1 < argc) {
+      baud = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--no-uart")) {
+      uart = false;
+    } else if (!strcmp(argv[i], "--wave") && i + 1 < argc) {
+      if (!parse_wave(argv[++i], waves)) {
+        fprintf(stderr, "bad --wave %s\n", argv[i]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--noise") && i + 1 < argc) {
+      noise = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--drop-bytes") && i + 1 < argc) {
+      faults.drop_bytes = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--garbage-lines") && i + 1 < argc) {
+      faults.garbage_lines = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  const char *slave = ptsname(master);
+
+  // Raw from the start, so even a receiver that doesn't set up the port
+  // sees the bytes unchanged
+  struct termios tio;
+  tcgetattr(master, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(master, TCSANOW, &tio);
+
+  if (link_path) {
+    unlink(link_path);
+    if (symlink(slave, link_path) < 0) {
+      perror(link_path);
+      return 1;
+    }
+  }
+  printf("%s\n", link_path ? link_path : slave);
+  fflush(stdout);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gauss(0.0, noise > 0 ? noise : 1.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  bool connected = false;
+  double wall_start = 0;
+  double virtual_start = 0;
+  const double loop_us = 10;  // virtual time per loop() call
+
+  // Everything the sketch prints goes through the fault injection to the pty
+  std::vector<uint8_t> out;
+  auto sink = [&](const uint8_t *p, size_t len) {
+    // Time(us) counts from here; tell bench_capture where that is on the
+    // monotonic clock so it can measure row latency
+    if (speed > 0 && memmem(p, len, "RECORDING_STARTED", 17)) {
+      fprintf(stderr, "recording started at %.6f s monotonic\n",
+              wall_start + (sim::now_seconds() - virtual_start) / speed);
+    }
+    if (!faults.drop_bytes && !faults.garbage_lines) {
+      write_master(master, p, len);
+      return;
+    }
+    out.clear();
+    for (size_t i = 0; i < len; i++) {
+      if (faults.drop_bytes && uniform(rng) < faults.drop_bytes) {
+        faults.dropped++;
+        continue;
+      }
+      out.push_back(p[i]);
+      if (p[i] == '\n' && faults.garbage_lines && uniform(rng) < faults.garbage_lines) {
+        // Line noise: printable junk, sometimes with a control byte in it
+        int n = 1 + rng() % 40;
+        for (int k = 0; k < n; k++) out.push_back(rng() % 8 ? 33 + rng() % 94 : rng() % 32);
+        out.push_back('\r');
+        out.push_back('\n');
+        faults.garbage++;
+      }
+    }
+    write_master(master, out.data(), out.size());
+  };
+
+  while (!quit) {
+    // POLLHUP on the master means no receiver has the port open
+    struct pollfd pfd = {master, POLLIN, 0};
+    poll(&pfd, 1, connected ? 0 : 20);
+    if (pfd.revents & POLLHUP) {
+      if (connected) fprintf(stderr, "receiver closed the port\n");
+      connected = false;
+      continue;
+    }
+
+    if (!connected) {
+      // Opening the port resets the board
+      fprintf(stderr, "receiver opened the port, resetting\n");
+      sim::reset();
+      sim::set_uart_baud(baud);
+      sim::set_uart_model(uart);
+      for (int ch = 0; ch < 4; ch++) {
+        Wave w = waves[ch];
+        sim::set_analog_source(ch, [w, noise, &gauss, &rng](double t) {
+          return wave_value(w, t) + (noise > 0 ? gauss(rng) : 0.0);
+        });
+      }
+      sim::set_serial_sink(sink);
+      connected = true;
+      wall_start = now_s();
+      virtual_start = 0;
+
+      // setup() includes the sketch's delay(1000), run it at the same pace
+      if (speed > 0) {
+        double setup_wall = 1.0 / speed;
+        struct timespec ts = {(time_t)setup_wall, (long)((setup_wall - (time_t)setup_wall) * 1e9)};
+        nanosleep(&ts, nullptr);
+      }
+      setup();
+      wall_start = now_s();
+      virtual_start = sim::now_seconds();
+      continue;
+    }
+
+    if (pfd.revents & POLLIN) {
+      char buf[256];
+      ssize_t n = read(master, buf, sizeof(buf));
+      if (n > 0) sim::serial_input(std::string(buf, n));
+    }
+
+    // Run the sketch up to where virtual time should be now
+    double target = speed > 0 ? virtual_start + (now_s() - wall_start) * speed : sim::now_seconds() + 0.01;
+    if (sim::now_seconds() >= target) {
+      struct timespec ts = {0, 200000};  // 0.2 ms
+      nanosleep(&ts, nullptr);
+      continue;
+    }
+    for (int i = 0; i < 1000 && sim::now_seconds() < target; i++) {
+      loop();
+      sim::advance_us(loop_us);
+    }
+  }
+
+  if (faults.dropped || faults.garbage) {
+    fprintf(stderr, "dropped %llu bytes, inserted %llu garbage lines\n",
+            (unsigned long long)faults.dropped, (unsigned long long)faults.garbage);
+  }
+  if (link_path) unlink(link_path);
+  close(master);
+  return 0;
+}
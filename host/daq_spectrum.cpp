@@ -0,0 +1,419 @@
+/*
+ * Power spectra of a capture's channels (spectrum.h): the Welch PSD of
+ * the whole recording and a spectrogram, for plotting.
+ *
+ * The capture is a .daqc, read a chunk at a time, or a CSV (daq_capture's,
+ * the Python receivers', or a _filtered.csv; every column but Sample and
+ * Time is a channel) read by csv_parse.h, like daq_batch and
+ * daq_host.read_csv(). Rows are put on an exact uniform grid first
+ * (resample.h, linear), which bridges dropped samples and jittered
+ * Time(ms) stamps, and each block's channels are then transformed in
+ * parallel, a thread each.
+ *
+ * Writes, next to the input unless -o gives another prefix:
+ *   PREFIX_psd.csv               Frequency(Hz) and each channel's PSD in V^2/Hz
+ *   PREFIX_spectrogram.npy       float32 [rows][channels][bins], V^2/Hz
+ *   PREFIX_spectrogram_time.npy  float64 [rows], each row's centre in s
+ *                                from the first sample
+ * The .npy files load with numpy.load(..., mmap_mode='r'); the bins are
+ * the PSD's frequencies.
+ *
+ * usage: daq_spectrum [options] FILE.daqc|FILE.csv
+ *   -o PREFIX         output prefix (default FILE without its extension)
+ *   --nperseg N       segment length, a power of two (default 1024)
+ *   --overlap N       samples shared by consecutive segments (default N / 2)
+ *   --window NAME     hann, hamming, blackman or rect (default hann)
+ *   --average N       segments averaged into each spectrogram row (default 1)
+ *   --fs HZ           sample rate (default: the capture's period, or its
+ *                     timestamps)
+ */
+#include "csv_parse.h"
+#include "daqc.h"
+#include "resample.h"
+#include "spectrum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Rows handed to the channel threads at a time
+const size_t block_rows = 1 << 16;
+
+// Rows the sample rate is measured over when it isn't known
+const size_t probe_rows = 256;
+
+// A .npy array written as it grows; the header (shape) is filled in by
+// finish(), in a fixed 128 bytes reserved up front
+class NpyWriter {
+ public:
+  NpyWriter(const std::string &path, const char *descr, const std::string &shape_tail)
+      : path_(path), descr_(descr), tail_(shape_tail) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    // pwrite() leaves the offset alone, the data goes after the header
+    ok_ = fd_ >= 0 && header(0) && lseek(fd_, header_size, SEEK_SET) == header_size;
+  }
+  ~NpyWriter() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  void write(const void *data, size_t len) {
+    if (ok_ && !daq::write_all(fd_, data, len)) ok_ = false;
+  }
+  bool finish(uint64_t rows) {
+    ok_ = ok_ && header(rows) && close(fd_) == 0;
+    fd_ = -1;
+    return ok_;
+  }
+  bool ok() const { return ok_; }
+  const std::string &path() const { return path_; }
+
+ private:
+  bool header(uint64_t rows) {
+    char dict[128];
+    int n = snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%llu,%s), }",
+                     descr_, (unsigned long long)rows, tail_.c_str());
+    const size_t total = header_size;
+    if (n < 0 || (size_t)n + 11 > total) return false;
+    uint8_t out[total];
+    memcpy(out, "\x93NUMPY\x01\x00", 8);
+    out[8] = (total - 10) & 0xff;
+    out[9] = (total - 10) >> 8;
+    memcpy(out + 10, dict, n);
+    memset(out + 10 + n, ' ', total - 11 - n);
+    out[total - 1] = '\n';
+    return pwrite(fd_, out, total, 0) == (ssize_t)total;
+  }
+
+  static const off_t header_size = 128;
+
+  std::string path_;
+  const char *descr_;
+  std::string tail_;
+  int fd_ = -1;
+  bool ok_ = false;
+};
+
+struct Options {
+  size_t nperseg = 1024;
+  long overlap = -1;
+  std::string window = "hann";
+  size_t average = 1;
+  double fs = 0;
+};
+
+// Rows in, on the uniform grid, a block at a time through one Welch per
+// channel on its own thread; spectrogram rows out to the .npy
+class Engine {
+ public:
+  Engine(const std::vector<std::string> &names, double fs, const Options &opt, NpyWriter *spectrogram)
+      : fs_(fs), opt_(opt), spectrogram_(spectrogram), resampler_(names.size(), 1.0 / fs, daq::Interp::linear),
+        columns_(names.size()) {
+    std::vector<double> window = daq::spectral_window(opt.window.c_str(), opt.nperseg);
+    size_t step = opt.nperseg - opt.overlap;
+    for (size_t c = 0; c < names.size(); c++) {
+      channels_.emplace_back(new Channel(window, step, fs));
+      Channel *ch = channels_.back().get();
+      ch->welch.on_segment = [ch, this](const double *density) {
+        if (ch->averaged.empty()) ch->averaged.assign(ch->welch.bins(), 0.0);
+        for (size_t k = 0; k < ch->averaged.size(); k++) ch->averaged[k] += density[k];
+        if (++ch->count < opt_.average) return;
+        for (double p : ch->averaged) ch->rows.push_back(p / opt_.average);
+        ch->averaged.assign(ch->averaged.size(), 0.0);
+        ch->count = 0;
+      };
+    }
+    resampler_.on_sample = [this](double, const double *values) {
+      for (size_t c = 0; c < columns_.size(); c++) columns_[c].push_back(values[c]);
+      if (columns_[0].size() >= block_rows) run();
+    };
+  }
+
+  void push(double time_s, const double *values) { resampler_.push(time_s, values); }
+  void finish() {
+    resampler_.finish();
+    run();
+  }
+
+  size_t bins() const { return channels_[0]->welch.bins(); }
+  double frequency(size_t bin) const { return channels_[0]->welch.frequency(bin); }
+  std::vector<double> psd(size_t channel) const { return channels_[channel]->welch.psd(); }
+  uint64_t segments() const { return channels_[0]->welch.segments(); }
+  uint64_t rows() const { return times_.size(); }
+  const std::vector<double> &times() const { return times_; }
+  const daq::Resampler &resampler() const { return resampler_; }
+
+ private:
+  struct Channel {
+    Channel(const std::vector<double> &window, size_t step, double fs) : welch(window, step, fs) {}
+    daq::Welch welch;
+    std::vector<double> averaged;
+    size_t count = 0;
+    std::vector<double> rows;  // this block's finished rows, bins() each
+  };
+
+  void run() {
+    if (columns_[0].empty()) return;
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < channels_.size(); c++) {
+      threads.emplace_back([this, c] { channels_[c]->welch.push(columns_[c].data(), columns_[c].size()); });
+    }
+    for (std::thread &t : threads) t.join();
+    for (std::vector<double> &column : columns_) column.clear();
+
+    // Every channel finished the same rows; interleave them
+    const size_t n = bins();
+    size_t rows = channels_[0]->rows.size() / n;
+    std::vector<float> out(channels_.size() * n);
+    for (size_t r = 0; r < rows; r++) {
+      for (size_t c = 0; c < channels_.size(); c++) {
+        const double *row = &channels_[c]->rows[r * n];
+        std::copy(row, row + n, out.begin() + c * n);
+      }
+      spectrogram_->write(out.data(), out.size() * sizeof(float));
+      // Centre of the row's segments
+      size_t step = opt_.nperseg - opt_.overlap;
+      double first = (double)times_.size() * opt_.average * step;
+      times_.push_back((first + ((opt_.average - 1) * step + opt_.nperseg) / 2.0) / fs_);
+    }
+    for (auto &ch : channels_) ch->rows.clear();
+  }
+
+  double fs_;
+  Options opt_;
+  NpyWriter *spectrogram_;
+  daq::Resampler resampler_;
+  std::vector<std::vector<double>> columns_;
+  std::vector<std::unique_ptr<Channel>> channels_;
+  std::vector<double> times_;
+};
+
+// Rows held while the sample rate is measured, then fed to the engine
+struct Probe {
+  std::vector<double> time;
+  std::vector<double> values;
+};
+
+double probe_rate(const Probe &probe, bool exact_clock) {
+  // A hardware sample clock's steps are mostly one period: the median of
+  // the positive ones, which drops and garbled stamps don't move (as
+  // daq_batch and filter_and_save_data() take it); jittered loop() stamps
+  // average out instead
+  size_t n = probe.time.size();
+  if (n < 2) return 0;
+  if (!exact_clock) return (n - 1) / (probe.time[n - 1] - probe.time[0]);
+  std::vector<double> steps;
+  for (size_t i = 1; i < n; i++) {
+    if (probe.time[i] > probe.time[i - 1]) steps.push_back(probe.time[i] - probe.time[i - 1]);
+  }
+  if (steps.empty()) return 0;
+  // numpy's median: the middle one, or the mean of the middle two
+  size_t mid = steps.size() / 2;
+  std::nth_element(steps.begin(), steps.begin() + mid, steps.end());
+  double step = steps[mid];
+  if (steps.size() % 2 == 0) step = (step + *std::max_element(steps.begin(), steps.begin() + mid)) / 2;
+  return 1.0 / step;
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-o PREFIX] [--nperseg N] [--overlap N] [--window hann|hamming|blackman|rect]\n"
+          "       [--average N] [--fs HZ] FILE.daqc|FILE.csv\n",
+          argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *input = nullptr;
+  std::string prefix;
+  Options opt;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      prefix = argv[++i];
+    } else if (!strcmp(argv[i], "--nperseg") && i + 1 < argc) {
+      opt.nperseg = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--overlap") && i + 1 < argc) {
+      opt.overlap = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--window") && i + 1 < argc) {
+      opt.window = argv[++i];
+    } else if (!strcmp(argv[i], "--average") && i + 1 < argc) {
+      opt.average = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--fs") && i + 1 < argc) {
+      opt.fs = atof(argv[++i]);
+    } else if (argv[i][0] != '-' && !input) {
+      input = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!input) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (opt.overlap < 0) opt.overlap = opt.nperseg / 2;
+  if (opt.nperseg < 4 || (opt.nperseg & (opt.nperseg - 1)) || (size_t)opt.overlap >= opt.nperseg ||
+      !opt.average) {
+    fprintf(stderr, "--nperseg must be a power of two >= 4, --overlap below it, --average at least 1\n");
+    return 2;
+  }
+  if (daq::spectral_window(opt.window.c_str(), 4).empty()) {
+    fprintf(stderr, "unknown window %s\n", opt.window.c_str());
+    return 2;
+  }
+  if (prefix.empty()) {
+    prefix = input;
+    size_t dot = prefix.rfind('.');
+    if (dot != std::string::npos && prefix.find('/', dot) == std::string::npos) prefix.resize(dot);
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<std::string> names;
+  Probe probe;
+  std::unique_ptr<Engine> engine;
+  std::unique_ptr<NpyWriter> spectrogram;
+  uint64_t rejected = 0;
+
+  // Rows go to the probe until the rate is known, then through the engine
+  bool exact_clock = true;
+  auto start_engine = [&](double fs) -> bool {
+    if (!(fs > 0)) {
+      fprintf(stderr, "%s: can't tell the sample rate, give --fs\n", input);
+      return false;
+    }
+    char tail[64];
+    snprintf(tail, sizeof(tail), " %zu, %zu", names.size(), opt.nperseg / 2 + 1);
+    spectrogram.reset(new NpyWriter(prefix + "_spectrogram.npy", "<f4", tail));
+    if (!spectrogram->ok()) {
+      fprintf(stderr, "%s: %s\n", spectrogram->path().c_str(), strerror(errno));
+      return false;
+    }
+    engine.reset(new Engine(names, fs, opt, spectrogram.get()));
+    for (size_t i = 0; i < probe.time.size(); i++) engine->push(probe.time[i], &probe.values[i * names.size()]);
+    probe = Probe();
+    return true;
+  };
+  auto add_row = [&](double time_s, const double *values) -> bool {
+    if (engine) {
+      engine->push(time_s, values);
+      return true;
+    }
+    probe.time.push_back(time_s);
+    probe.values.insert(probe.values.end(), values, values + names.size());
+    if (probe.time.size() < probe_rows) return true;
+    return start_engine(opt.fs > 0 ? opt.fs : probe_rate(probe, exact_clock));
+  };
+
+  std::string ext = strrchr(input, '.') ? strrchr(input, '.') : "";
+  if (ext == ".daqc") {
+    daq::DaqcFile file;
+    if (!file.open(input)) {
+      fprintf(stderr, "%s: %s\n", input, file.error().c_str());
+      return 1;
+    }
+    names = file.info().names;
+    if (!opt.fs && file.info().period_us) opt.fs = 1e6 / file.info().period_us;
+    std::vector<double> values(names.size());
+    for (const daq::DaqcFile::Chunk &chunk : file.chunks()) {
+      for (uint32_t i = 0; i < chunk.rows; i++) {
+        for (size_t c = 0; c < names.size(); c++) values[c] = file.volts(chunk.codes[c][i]);
+        if (!add_row((chunk.first_time_us + chunk.time_offset[i]) * 1e-6, values.data())) return 1;
+      }
+    }
+  } else {
+    daq::CsvData data;
+    if (!daq::parse_csv_file(input, &data)) {
+      fprintf(stderr, "%s: %s\n", input, strerror(errno));
+      return 1;
+    }
+    rejected = data.rejected;
+    // Time(us), else Time(ms) (a _filtered.csv has both); every other
+    // column but Sample is a channel
+    size_t time_column = std::find(data.names.begin(), data.names.end(), "Time(us)") - data.names.begin();
+    exact_clock = time_column < data.names.size();
+    if (!exact_clock) time_column = std::find(data.names.begin(), data.names.end(), "Time(ms)") - data.names.begin();
+    if (time_column < data.names.size()) {
+      const double time_scale = exact_clock ? 1e-6 : 1e-3;
+      std::vector<size_t> value_columns;
+      for (size_t k = 0; k < data.names.size(); k++) {
+        const std::string &name = data.names[k];
+        if (name != "Sample" && name != "Time(us)" && name != "Time(ms)" && !name.empty()) {
+          value_columns.push_back(k);
+          names.push_back(name);
+        }
+      }
+      std::vector<double> values(names.size());
+      for (uint64_t i = 0; i < data.rows; i++) {
+        for (size_t c = 0; c < value_columns.size(); c++) values[c] = data.columns[value_columns[c]][i];
+        if (!add_row(data.columns[time_column][i] * time_scale, values.data())) return 1;
+      }
+    }
+  }
+
+  if (names.empty()) {
+    fprintf(stderr, "%s: no channels (no Time(us) or Time(ms) header?)\n", input);
+    return 1;
+  }
+  // Short captures never filled the probe
+  if (!engine && !start_engine(opt.fs > 0 ? opt.fs : probe_rate(probe, exact_clock))) return 1;
+  engine->finish();
+  if (!engine->segments()) {
+    fprintf(stderr, "%s: shorter than one %zu sample segment\n", input, opt.nperseg);
+    return 1;
+  }
+
+  std::string psd_path = prefix + "_psd.csv";
+  FILE *psd = fopen(psd_path.c_str(), "w");
+  if (!psd) {
+    fprintf(stderr, "%s: %s\n", psd_path.c_str(), strerror(errno));
+    return 1;
+  }
+  fprintf(psd, "Frequency(Hz)");
+  for (const std::string &name : names) fprintf(psd, ",%s", name.c_str());
+  fprintf(psd, "\n");
+  std::vector<std::vector<double>> psds;
+  for (size_t c = 0; c < names.size(); c++) psds.push_back(engine->psd(c));
+  for (size_t k = 0; k < engine->bins(); k++) {
+    fprintf(psd, "%.6g", engine->frequency(k));
+    for (size_t c = 0; c < names.size(); c++) fprintf(psd, ",%.6e", psds[c][k]);
+    fprintf(psd, "\n");
+  }
+  bool ok = fclose(psd) == 0;
+
+  ok = spectrogram->finish(engine->rows()) && ok;
+  NpyWriter times(prefix + "_spectrogram_time.npy", "<f8", "");
+  times.write(engine->times().data(), engine->times().size() * sizeof(double));
+  ok = times.finish(engine->rows()) && ok;
+  if (!ok) {
+    fprintf(stderr, "%s: write failed\n", prefix.c_str());
+    return 1;
+  }
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  const daq::Resampler &resampler = engine->resampler();
+  fprintf(stderr, "%llu rows, %zu channels at %.1f Hz: %llu segments of %zu, %llu spectrogram rows, %.2f s\n",
+          (unsigned long long)resampler.inputs(), names.size(), 1.0 / resampler.period(),
+          (unsigned long long)engine->segments(), opt.nperseg, (unsigned long long)engine->rows(), elapsed);
+  if (resampler.outputs() > resampler.inputs() + resampler.inputs() / 1000) {
+    fprintf(stderr, "Filled %llu missing samples by interpolation\n",
+            (unsigned long long)(resampler.outputs() - resampler.inputs()));
+  }
+  if (rejected) fprintf(stderr, "Skipped %llu invalid lines\n", (unsigned long long)rejected);
+  fprintf(stderr, "Wrote %s, %s_spectrogram.npy and %s_spectrogram_time.npy\n", psd_path.c_str(), prefix.c_str(),
+          prefix.c_str());
+  return 0;
+}
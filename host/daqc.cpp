@@ -0,0 +1,274 @@
+/*
+ * .daqc writer and reader, see daqc.h.
+ */
+#include "daqc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace daq {
+
+namespace {
+
+const char header_magic[4] = {'D', 'A', 'Q', 'C'};
+const char chunk_magic[4] = {'C', 'H', 'N', 'K'};
+const char index_magic[4] = {'I', 'D', 'X', ' '};
+const char trailer_magic[8] = {'D', 'A', 'Q', 'C', 'E', 'N', 'D', '\0'};
+const uint16_t version = 1;
+const size_t header_fixed = 32;
+const size_t chunk_fixed = 24;
+const size_t trailer_size = 16;
+
+size_t pad8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+size_t chunk_size(uint32_t rows, int channels) { return pad8(chunk_fixed + rows * 8 + channels * rows * 2); }
+
+// Little endian fields into / out of a byte buffer (x86 and ARM hosts are
+// little endian, memcpy keeps it alignment safe)
+template <typename T>
+void put(std::vector<uint8_t> &buf, T value) {
+  const uint8_t *p = (const uint8_t *)&value;
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T get(const uint8_t *p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+}  // namespace
+
+// ---- DaqcWriter ----
+
+DaqcWriter::DaqcWriter(int fd, const DaqcInfo &info, uint32_t chunk_rows)
+    : fd_(fd), info_(info), chunk_rows_(chunk_rows ? chunk_rows : daqc_default_chunk_rows) {
+  if ((int)info_.names.size() > max_columns) info_.names.resize(max_columns);
+  codes_.resize(info_.names.size());
+  sample_offset_.reserve(chunk_rows_);
+  time_offset_.reserve(chunk_rows_);
+  for (auto &column : codes_) column.reserve(chunk_rows_);
+
+  std::vector<uint8_t> header;
+  header.insert(header.end(), header_magic, header_magic + 4);
+  put<uint16_t>(header, version);
+  put<uint16_t>(header, 0);  // size, filled in below
+  put<uint16_t>(header, info_.names.size());
+  put<uint16_t>(header, info_.code_bits);
+  put<uint32_t>(header, info_.period_us);
+  put<double>(header, info_.full_scale);
+  put<uint32_t>(header, info_.code_max);
+  put<uint32_t>(header, chunk_rows_);
+  for (const std::string &name : info_.names) {
+    size_t len = name.size() < 255 ? name.size() : 255;
+    header.push_back(len);
+    header.insert(header.end(), name.begin(), name.begin() + len);
+  }
+  header.resize(pad8(header.size()), 0);
+  uint16_t size = header.size();
+  memcpy(&header[6], &size, 2);
+  write(header.data(), header.size());
+}
+
+DaqcWriter::~DaqcWriter() { finish(); }
+
+void DaqcWriter::write(const void *data, size_t len) {
+  if (ok_) ok_ = write_all(fd_, data, len);
+  written_ += len;
+}
+
+void DaqcWriter::row(const Row &row) {
+  if (finished_) return;
+
+  // Offsets are 32 bits, a new chunk starts if this row doesn't fit the
+  // current one (very slow rates, or a row from before the chunk start)
+  if (!sample_offset_.empty() &&
+      (row.sample < first_sample_ || row.sample - first_sample_ > UINT32_MAX || row.time_us < first_time_ ||
+       row.time_us - first_time_ > UINT32_MAX)) {
+    write_chunk();
+  }
+  if (sample_offset_.empty()) {
+    first_sample_ = row.sample;
+    first_time_ = row.time_us;
+  }
+
+  sample_offset_.push_back(row.sample - first_sample_);
+  time_offset_.push_back(row.time_us - first_time_);
+  for (size_t c = 0; c < codes_.size(); c++) {
+    int16_t code = 0;
+    if (c < (size_t)row.count) {
+      if (row.code_bits) {
+        code = row.codes[c];
+      } else {
+        // The printed value is the code's voltage rounded to 3 or 4
+        // decimals, far less than half a code apart
+        code = (int16_t)lround(row.values[c] * info_.code_max / info_.full_scale);
+      }
+    }
+    codes_[c].push_back(code);
+  }
+  rows_++;
+
+  if (sample_offset_.size() == chunk_rows_) write_chunk();
+}
+
+void DaqcWriter::write_chunk() {
+  uint32_t rows = sample_offset_.size();
+  if (!rows) return;
+  index_.push_back(written_);
+  index_.push_back(rows);
+
+  std::vector<uint8_t> head;
+  head.insert(head.end(), chunk_magic, chunk_magic + 4);
+  put<uint32_t>(head, rows);
+  put<uint64_t>(head, first_sample_);
+  put<uint64_t>(head, first_time_);
+  write(head.data(), head.size());
+  write(sample_offset_.data(), rows * 4);
+  write(time_offset_.data(), rows * 4);
+  for (auto &column : codes_) write(column.data(), rows * 2);
+  static const uint8_t zeros[8] = {0};
+  size_t used = chunk_fixed + rows * 8 + codes_.size() * rows * 2;
+  write(zeros, pad8(used) - used);
+
+  sample_offset_.clear();
+  time_offset_.clear();
+  for (auto &column : codes_) column.clear();
+}
+
+bool DaqcWriter::finish() {
+  if (finished_) return ok_;
+  write_chunk();
+
+  uint64_t index_offset = written_;
+  std::vector<uint8_t> tail;
+  tail.insert(tail.end(), index_magic, index_magic + 4);
+  put<uint32_t>(tail, index_.size() / 2);
+  for (uint64_t v : index_) put<uint64_t>(tail, v);
+  put<uint64_t>(tail, index_offset);
+  tail.insert(tail.end(), trailer_magic, trailer_magic + 8);
+  write(tail.data(), tail.size());
+  finished_ = true;
+  return ok_;
+}
+
+// ---- DaqcFile ----
+
+DaqcFile::~DaqcFile() { close(); }
+
+void DaqcFile::close() {
+  if (map_) munmap((void *)map_, size_);
+  map_ = nullptr;
+  size_ = 0;
+  chunks_.clear();
+  rows_ = 0;
+  has_index_ = false;
+}
+
+bool DaqcFile::open(const char *path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    error_ = strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)header_fixed) {
+    error_ = "not a .daqc file";
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    error_ = strerror(errno);
+    return false;
+  }
+  map_ = (const uint8_t *)map;
+  size_ = st.st_size;
+  if (!parse()) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool DaqcFile::parse() {
+  const uint8_t *p = map_;
+  if (memcmp(p, header_magic, 4) || get<uint16_t>(p + 4) != version) {
+    error_ = "not a version 1 .daqc file";
+    return false;
+  }
+  size_t header_size = get<uint16_t>(p + 6);
+  int channels = get<uint16_t>(p + 8);
+  info_ = DaqcInfo();
+  info_.code_bits = get<uint16_t>(p + 10);
+  info_.period_us = get<uint32_t>(p + 12);
+  info_.full_scale = get<double>(p + 16);
+  info_.code_max = get<uint32_t>(p + 24);
+  if (header_size > size_ || channels > max_columns || !info_.code_max) {
+    error_ = "bad .daqc header";
+    return false;
+  }
+  size_t at = header_fixed;
+  for (int c = 0; c < channels; c++) {
+    if (at >= header_size || at + 1 + p[at] > header_size) {
+      error_ = "bad .daqc header";
+      return false;
+    }
+    info_.names.emplace_back((const char *)p + at + 1, p[at]);
+    at += 1 + p[at];
+  }
+
+  // The index if the writer finished, otherwise walk the chunks
+  if (size_ >= header_size + trailer_size && !memcmp(map_ + size_ - 8, trailer_magic, 8)) {
+    uint64_t index_offset = get<uint64_t>(map_ + size_ - trailer_size);
+    const uint8_t *idx = map_ + index_offset;
+    if (index_offset + 8 <= size_ - trailer_size && !memcmp(idx, index_magic, 4)) {
+      uint32_t count = get<uint32_t>(idx + 4);
+      if (index_offset + 8 + count * 16ULL <= size_ - trailer_size) {
+        has_index_ = true;
+        for (uint32_t i = 0; i < count && has_index_; i++) {
+          Chunk chunk;
+          uint64_t next;
+          has_index_ = chunk_at(get<uint64_t>(idx + 8 + i * 16), &chunk, &next);
+          if (has_index_) chunks_.push_back(chunk);
+        }
+      }
+    }
+    if (!has_index_) chunks_.clear();
+  }
+  if (!has_index_) {
+    uint64_t offset = header_size;
+    Chunk chunk;
+    while (chunk_at(offset, &chunk, &offset)) chunks_.push_back(chunk);
+  }
+
+  for (const Chunk &chunk : chunks_) rows_ += chunk.rows;
+  return true;
+}
+
+bool DaqcFile::chunk_at(uint64_t offset, Chunk *chunk, uint64_t *next) {
+  const int channels = info_.names.size();
+  if (offset + chunk_fixed > size_ || memcmp(map_ + offset, chunk_magic, 4)) return false;
+  const uint8_t *p = map_ + offset;
+  chunk->rows = get<uint32_t>(p + 4);
+  if (offset + chunk_size(chunk->rows, channels) > size_) return false;
+  chunk->first_sample = get<uint64_t>(p + 8);
+  chunk->first_time_us = get<uint64_t>(p + 16);
+  // Columns are 4-byte aligned within the 8-byte aligned chunk
+  chunk->sample_offset = (const uint32_t *)(p + chunk_fixed);
+  chunk->time_offset = chunk->sample_offset + chunk->rows;
+  const int16_t *codes = (const int16_t *)(chunk->time_offset + chunk->rows);
+  for (int c = 0; c < max_columns; c++) chunk->codes[c] = c < channels ? codes + c * chunk->rows : nullptr;
+  *next = offset + chunk_size(chunk->rows, channels);
+  return true;
+}
+
+}  // namespace daq
@@ -0,0 +1,131 @@
+/*
+ * .daqc: columnar binary capture files. daq_capture writes them directly
+ * (the ADC codes as they came off the board, no text formatting), readers
+ * mmap them and use the code columns in place; daqc_export turns one into
+ * the CSV the Arduino would have sent, exactly.
+ *
+ * Layout, all little endian, every block 8-byte aligned:
+ *
+ *   header   "DAQC" u16 version=1 u16 header_size
+ *            u16 channels u16 code_bits u32 period_us (0 = unknown)
+ *            f64 full_scale_volts u32 code_max u32 chunk_rows
+ *            then per channel: u8 length, name bytes; zero padded
+ *   chunk    "CHNK" u32 rows u64 first_sample u64 first_time_us
+ *            u32 sample_offset[rows]    sample = first_sample + offset
+ *            u32 time_offset[rows]      time_us = first_time_us + offset
+ *            i16 codes[channels][rows]  volts = code * full_scale / code_max
+ *            zero padded
+ *   ...
+ *   index    "IDX " u32 chunks, per chunk: u64 file_offset u64 rows
+ *   trailer  u64 index_offset "DAQCEND\0"
+ *
+ * A file whose writer died has no index; the reader then walks the
+ * chunks from the header, so everything up to the last complete chunk
+ * is still readable.
+ */
+#ifndef DAQ_DAQC_H
+#define DAQ_DAQC_H
+
+#include "capture.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace daq {
+
+const uint32_t daqc_default_chunk_rows = 1 << 16;
+
+struct DaqcInfo {
+  std::vector<std::string> names;  // the CSV header's value columns
+  int code_bits = 10;
+  uint32_t period_us = 0;
+  double full_scale = 5.0;
+  uint32_t code_max = 1023;  // 1023 << (code_bits - 10)
+};
+
+class DaqcWriter {
+ public:
+  // Writes to fd (which the caller closes after finish())
+  DaqcWriter(int fd, const DaqcInfo &info, uint32_t chunk_rows = daqc_default_chunk_rows);
+  ~DaqcWriter();
+
+  // Binary rows are stored as they are, text rows are turned back into
+  // the codes they were printed from (using info.code_bits)
+  void row(const Row &row);
+  // Write the rows so far as a (short) chunk, so a crash loses at most
+  // what came after
+  void flush() { write_chunk(); }
+  // Last chunk, index and trailer. Returns false if any write failed.
+  bool finish();
+
+  bool ok() const { return ok_; }
+  uint64_t rows() const { return rows_; }
+  uint64_t bytes_written() const { return written_; }
+
+ private:
+  void write(const void *data, size_t len);
+  void write_chunk();
+
+  int fd_;
+  DaqcInfo info_;
+  uint32_t chunk_rows_;
+  bool ok_ = true;
+  bool finished_ = false;
+  uint64_t written_ = 0;
+  uint64_t rows_ = 0;
+
+  // Current chunk, column by column
+  uint64_t first_sample_ = 0, first_time_ = 0;
+  std::vector<uint32_t> sample_offset_, time_offset_;
+  std::vector<std::vector<int16_t>> codes_;
+  std::vector<uint64_t> index_;  // file offset, rows per chunk
+};
+
+// A .daqc file mmapped read only; the arrays point into the mapping
+class DaqcFile {
+ public:
+  struct Chunk {
+    uint32_t rows;
+    uint64_t first_sample;
+    uint64_t first_time_us;
+    const uint32_t *sample_offset;
+    const uint32_t *time_offset;
+    const int16_t *codes[max_columns];
+  };
+
+  DaqcFile() {}
+  ~DaqcFile();
+  DaqcFile(const DaqcFile &) = delete;
+  DaqcFile &operator=(const DaqcFile &) = delete;
+
+  // false with error() set if it isn't a readable .daqc file
+  bool open(const char *path);
+  void close();
+
+  const DaqcInfo &info() const { return info_; }
+  const std::vector<Chunk> &chunks() const { return chunks_; }
+  uint64_t rows() const { return rows_; }
+  bool has_index() const { return has_index_; }  // false: writer didn't finish
+  const std::string &error() const { return error_; }
+
+  double volts(int16_t code) const { return code * info_.full_scale / info_.code_max; }
+
+ private:
+  bool parse();
+  bool chunk_at(uint64_t offset, Chunk *chunk, uint64_t *next);
+
+  const uint8_t *map_ = nullptr;
+  size_t size_ = 0;
+  DaqcInfo info_;
+  std::vector<Chunk> chunks_;
+  uint64_t rows_ = 0;
+  bool has_index_ = false;
+  std::string error_;
+};
+
+}  // namespace daq
+
+#endif  // DAQ_DAQC_H
@@ -0,0 +1,105 @@
+/*
+ * Converts a .daqc capture (daqc.h) to CSV: the header and rows the
+ * Arduino would have sent in text mode, character for character, with
+ * Time(us) unwrapped, i.e. what daq_capture -o FILE.csv writes.
+ *
+ * usage: daqc_export [-o OUT.csv] [--info] FILE.daqc
+ *   -o OUT.csv   output (default FILE.csv, "-" for stdout)
+ *   --info       print the header fields and chunk count, no CSV
+ */
+#include "capture.h"
+#include "daqc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace {
+
+void usage(const char *argv0) { fprintf(stderr, "usage: %s [-o OUT.csv] [--info] FILE.daqc\n", argv0); }
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *input = nullptr;
+  std::string output;
+  bool info_only = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--info")) {
+      info_only = true;
+    } else if (argv[i][0] != '-' && !input) {
+      input = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!input) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  daq::DaqcFile file;
+  if (!file.open(input)) {
+    fprintf(stderr, "%s: %s\n", input, file.error().c_str());
+    return 1;
+  }
+  const daq::DaqcInfo &info = file.info();
+  if (!file.has_index()) fprintf(stderr, "%s: no index (capture didn't finish), read the chunks directly\n", input);
+
+  if (info_only) {
+    printf("channels %zu:", info.names.size());
+    for (const std::string &name : info.names) printf(" %s", name.c_str());
+    printf("\ncode_bits %d, code_max %u, full scale %g V, period %u us\n", info.code_bits, info.code_max,
+           info.full_scale, info.period_us);
+    printf("%llu rows in %zu chunks\n", (unsigned long long)file.rows(), file.chunks().size());
+    return 0;
+  }
+
+  if (output.empty()) {
+    output = input;
+    size_t dot = output.rfind('.');
+    if (dot != std::string::npos && output.find('/', dot) == std::string::npos) output.resize(dot);
+    output += ".csv";
+  }
+  int out_fd = output == "-" ? 1 : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "%s: %s\n", output.c_str(), strerror(errno));
+    return 1;
+  }
+
+  daq::CsvWriter writer(out_fd);
+  std::string header = "Sample,Time(us)";
+  for (const std::string &name : info.names) header += "," + name;
+  writer.header(header);
+
+  daq::Row row;
+  row.text = nullptr;
+  row.text_len = 0;
+  row.count = info.names.size();
+  row.code_bits = info.code_bits;
+  for (const daq::DaqcFile::Chunk &chunk : file.chunks()) {
+    for (uint32_t i = 0; i < chunk.rows; i++) {
+      row.sample = chunk.first_sample + chunk.sample_offset[i];
+      row.time_us = chunk.first_time_us + chunk.time_offset[i];
+      for (int c = 0; c < row.count; c++) row.codes[c] = chunk.codes[c][i];
+      writer.row(row);
+    }
+  }
+
+  bool ok = writer.flush();
+  if (out_fd != 1) close(out_fd);
+  if (!ok) {
+    fprintf(stderr, "%s: write failed\n", output.c_str());
+    return 1;
+  }
+  if (out_fd != 1) fprintf(stderr, "Wrote %llu rows to %s\n", (unsigned long long)file.rows(), output.c_str());
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * C interface of libdaqhost.so, for the Python scripts (daq_host.py loads
+ * it with ctypes). Handles are opaque; arrays stay valid until the handle
+ * is closed.
+ */
+#include "csv_parse.h"
+#include "filtfilt.h"
+#include "lod.h"
+#include "resample.h"
+#include "sweep.h"
+
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+
+// Capture CSV -> columns. NULL (errno set) if the file can't be read.
+void *daq_csv_open(const char *path) {
+  daq::CsvData *data = new daq::CsvData;
+  if (!daq::parse_csv_file(path, data)) {
+    delete data;
+    return nullptr;
+  }
+  return data;
+}
+
+long daq_csv_rows(void *handle) { return ((daq::CsvData *)handle)->rows; }
+
+long daq_csv_rejected(void *handle) { return ((daq::CsvData *)handle)->rejected; }
+
+int daq_csv_columns(void *handle) { return ((daq::CsvData *)handle)->names.size(); }
+
+const char *daq_csv_column_name(void *handle, int column) {
+  return ((daq::CsvData *)handle)->names[column].c_str();
+}
+
+const double *daq_csv_column(void *handle, int column) {
+  return ((daq::CsvData *)handle)->columns[column].data();
+}
+
+void daq_csv_close(void *handle) { delete (daq::CsvData *)handle; }
+
+// Zero-phase SOS filter of channels arrays of samples (channel after
+// channel), see filtfilt.h. -1 if samples isn't more than the padding.
+int daq_sosfiltfilt(const double *sos, int sections, const double *in, double *out, int channels,
+                    long samples) {
+  return daq::sosfiltfilt(sos, sections, in, out, channels, samples) ? 0 : -1;
+}
+
+long daq_sosfiltfilt_padlen(const double *sos, int sections) {
+  return daq::sosfiltfilt_padlen(sos, sections);
+}
+
+// Resample channels arrays of samples values (channel after channel) at
+// time onto the grid time[0] + k * period, see resample.h. interp is 0
+// linear, 1 cubic, 2 sinc. out_time needs daq_resample_count() room, out
+// that per channel; returns how many were written, -1 for a bad interp.
+long daq_resample_count(const double *time, long samples, double period) {
+  return daq::resample_count(time, samples, period);
+}
+
+long daq_resample(const double *time, const double *in, int channels, long samples, double period, int interp,
+                  double *out_time, double *out) {
+  if (interp < 0 || interp > 2) return -1;
+  return daq::resample(time, in, channels, samples, period, (daq::Interp)interp, out_time, out);
+}
+
+// Low-pass sweep over cutoffs x orders, see sweep.h. data is channels
+// arrays of samples values. Results are cutoff-major: lag_ms,
+// overshoot_pct and causal_overshoot_pct one per configuration (NaN where
+// it can't be applied), residual_rms channels per configuration;
+// noise_rms one per channel. threads 0: one per core.
+void daq_sweep_lowpass(const double *data, int channels, long samples, double fs, const double *cutoffs,
+                       int n_cutoffs, const int *orders, int n_orders, int threads, double *lag_ms,
+                       double *overshoot_pct, double *causal_overshoot_pct, double *residual_rms,
+                       double *noise_rms) {
+  std::vector<daq::SweepResult> results =
+      daq::sweep_lowpass(data, channels, samples, fs, std::vector<double>(cutoffs, cutoffs + n_cutoffs),
+                         std::vector<int>(orders, orders + n_orders), threads);
+  for (size_t i = 0; i < results.size(); i++) {
+    lag_ms[i] = results[i].lag_ms;
+    overshoot_pct[i] = results[i].overshoot_pct;
+    causal_overshoot_pct[i] = results[i].causal_overshoot_pct;
+    std::copy(results[i].residual_rms.begin(), results[i].residual_rms.end(), residual_rms + i * channels);
+  }
+  for (int c = 0; c < channels; c++) noise_rms[c] = daq::noise_rms(data + c * samples, samples);
+}
+
+// Min/max pyramid over samples timestamps, see lod.h. time and every
+// channel added must stay valid until daq_lod_close().
+void *daq_lod_open(const double *time, long samples) { return new daq::MinMaxPyramid(time, samples); }
+
+int daq_lod_add_channel(void *handle, const double *values) {
+  return ((daq::MinMaxPyramid *)handle)->add_channel(values);
+}
+
+long daq_lod_max_points(long width) { return daq::MinMaxPyramid::max_points(width); }
+
+long daq_lod_query(void *handle, int channel, double t0, double t1, long width, double *time, double *min,
+                   double *max) {
+  return ((daq::MinMaxPyramid *)handle)->query(channel, t0, t1, width, time, min, max);
+}
+
+void daq_lod_close(void *handle) { delete (daq::MinMaxPyramid *)handle; }
+
+}  // extern "C"
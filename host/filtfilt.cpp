@@ -0,0 +1,198 @@
+/*
+ * sosfiltfilt, see filtfilt.h.
+ */
+#include "filtfilt.h"
+#include "iir.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace daq {
+
+namespace {
+
+// One channel per lane. With AVX that's one register (GCC/clang vector
+// extension); without, GCC's lowering of the 4-wide type goes through
+// memory, so it's two SSE2 halves with the operators spelled out.
+const int lanes = 4;
+#ifdef __AVX__
+typedef double Vec __attribute__((vector_size(32)));
+
+inline Vec splat(double v) { return Vec{v, v, v, v}; }
+inline Vec gather(const double *const *p, size_t i) { return Vec{p[0][i], p[1][i], p[2][i], p[3][i]}; }
+inline void scatter(double *const *p, size_t i, Vec v) {
+  for (int l = 0; l < lanes; l++) p[l][i] = v[l];
+}
+#else
+typedef double Half __attribute__((vector_size(16)));
+struct Vec {
+  Half lo, hi;
+};
+
+inline Vec operator+(Vec a, Vec b) { return Vec{a.lo + b.lo, a.hi + b.hi}; }
+inline Vec operator-(Vec a, Vec b) { return Vec{a.lo - b.lo, a.hi - b.hi}; }
+inline Vec operator*(Vec a, Vec b) { return Vec{a.lo * b.lo, a.hi * b.hi}; }
+inline Vec splat(double v) { return Vec{Half{v, v}, Half{v, v}}; }
+inline Vec gather(const double *const *p, size_t i) {
+  return Vec{Half{p[0][i], p[1][i]}, Half{p[2][i], p[3][i]}};
+}
+inline void scatter(double *const *p, size_t i, Vec v) {
+  p[0][i] = v.lo[0];
+  p[1][i] = v.lo[1];
+  p[2][i] = v.hi[0];
+  p[3][i] = v.hi[1];
+}
+#endif
+
+struct Section {
+  Vec b0, b1, b2, a1, a2;
+  double zi0, zi1;  // steady state for a unit step, sosfilt_zi()
+};
+
+std::vector<Section> make_sections(const double *sos, int sections) {
+  std::vector<Section> out(sections);
+  std::vector<double> zi = sosfilt_zi(sos, sections);
+  for (int s = 0; s < sections; s++) {
+    const double *c = sos + 6 * s;
+    Section &sec = out[s];
+    sec.b0 = splat(c[0]);
+    sec.b1 = splat(c[1]);
+    sec.b2 = splat(c[2]);
+    sec.a1 = splat(c[4]);
+    sec.a2 = splat(c[5]);
+    sec.zi0 = zi[2 * s];
+    sec.zi1 = zi[2 * s + 1];
+  }
+  return out;
+}
+
+// Start state for a pass whose first input is x0
+void init_state(const std::vector<Section> &secs, Vec x0, Vec *z) {
+  for (size_t s = 0; s < secs.size(); s++) {
+    z[2 * s] = splat(secs[s].zi0) * x0;
+    z[2 * s + 1] = splat(secs[s].zi1) * x0;
+  }
+}
+
+// Filter len interleaved samples in place, carrying the state in z.
+// Two sections at a time over the whole block: their recursions are
+// independent chains the CPU can overlap, the state stays in registers
+// and the block stays in L1.
+void run_block(const std::vector<Section> &secs, Vec *z, Vec *buf, size_t len) {
+  size_t s = 0;
+  for (; s + 1 < secs.size(); s += 2) {
+    const Section &c = secs[s], &d = secs[s + 1];
+    Vec z0 = z[2 * s], z1 = z[2 * s + 1], w0 = z[2 * s + 2], w1 = z[2 * s + 3];
+    for (size_t i = 0; i < len; i++) {
+      // Same operation order as scipy's _sosfilt
+      Vec x = buf[i];
+      Vec y = c.b0 * x + z0;
+      z0 = c.b1 * x - c.a1 * y + z1;
+      z1 = c.b2 * x - c.a2 * y;
+      Vec v = d.b0 * y + w0;
+      w0 = d.b1 * y - d.a1 * v + w1;
+      w1 = d.b2 * y - d.a2 * v;
+      buf[i] = v;
+    }
+    z[2 * s] = z0;
+    z[2 * s + 1] = z1;
+    z[2 * s + 2] = w0;
+    z[2 * s + 3] = w1;
+  }
+  if (s < secs.size()) {
+    const Section &c = secs[s];
+    Vec z0 = z[2 * s], z1 = z[2 * s + 1];
+    for (size_t i = 0; i < len; i++) {
+      Vec x = buf[i];
+      Vec y = c.b0 * x + z0;
+      z0 = c.b1 * x - c.a1 * y + z1;
+      z1 = c.b2 * x - c.a2 * y;
+      buf[i] = y;
+    }
+    z[2 * s] = z0;
+    z[2 * s + 1] = z1;
+  }
+}
+
+}  // namespace
+
+size_t sosfiltfilt_padlen(const double *sos, int sections) {
+  int b2_zero = 0, a2_zero = 0;
+  for (int s = 0; s < sections; s++) {
+    b2_zero += sos[6 * s + 2] == 0;
+    a2_zero += sos[6 * s + 5] == 0;
+  }
+  return 3 * (2 * sections + 1 - std::min(b2_zero, a2_zero));
+}
+
+bool sosfiltfilt(const double *sos, int sections, const double *in, double *out, int channels,
+                 size_t samples) {
+  const size_t pad = sosfiltfilt_padlen(sos, sections);
+  if (samples <= pad) return false;
+
+  const std::vector<Section> secs = make_sections(sos, sections);
+  std::vector<Vec> z(2 * sections);
+  std::vector<Vec> tail(pad);
+  const size_t block = 256;
+  Vec buf[block];
+
+  // The extended signal is never stored whole: the forward pass goes from
+  // in to out (the extension at the end to tail), the backward pass from
+  // out/tail back to out, a block at a time through buf
+  for (int first = 0; first < channels; first += lanes) {
+    // A short last group repeats its last channel in the spare lanes,
+    // which then write the same values as the lane they copy
+    const double *x[lanes];
+    double *y[lanes];
+    for (int l = 0; l < lanes; l++) {
+      int ch = std::min(first + l, channels - 1);
+      x[l] = in + ch * samples;
+      y[l] = out + ch * samples;
+    }
+
+    // Odd extensions: 2 x[0] - x[pad - i] before, 2 x[N-1] - x[N-2-j]
+    // after. The end one is read before out overwrites in.
+    const Vec head = gather(x, 0) * splat(2), end = gather(x, samples - 1) * splat(2);
+    for (size_t j = 0; j < pad; j++) tail[j] = end - gather(x, samples - 2 - j);
+
+    // Forward over extension + samples + extension
+    const size_t n = samples + 2 * pad;
+    init_state(secs, head - gather(x, pad), z.data());
+    for (size_t done = 0; done < n; done += block) {
+      const size_t len = std::min(block, n - done);
+      for (size_t k = 0; k < len; k++) {
+        size_t i = done + k;
+        buf[k] = i < pad ? head - gather(x, pad - i) : i < pad + samples ? gather(x, i - pad) : tail[i - pad - samples];
+      }
+      run_block(secs, z.data(), buf, len);
+      for (size_t k = 0; k < len; k++) {
+        size_t i = done + k;
+        if (i >= pad + samples) {
+          tail[i - pad - samples] = buf[k];
+        } else if (i >= pad) {
+          scatter(y, i - pad, buf[k]);
+        }
+      }
+    }
+
+    // Backward from the end of the extension; the samples' outputs are
+    // the result and the leading extension's aren't needed
+    const size_t m = samples + pad;
+    auto fetch = [&](size_t i) {  // forward output at extended index pad + i
+      return i >= samples ? tail[i - samples] : gather(y, i);
+    };
+    init_state(secs, fetch(m - 1), z.data());
+    for (size_t done = 0; done < m; done += block) {
+      const size_t len = std::min(block, m - done);
+      for (size_t k = 0; k < len; k++) buf[k] = fetch(m - 1 - done - k);
+      run_block(secs, z.data(), buf, len);
+      for (size_t k = 0; k < len; k++) {
+        size_t i = m - 1 - done - k;
+        if (i < samples) scatter(y, i, buf[k]);
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace daq
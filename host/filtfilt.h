@@ -0,0 +1,34 @@
+/*
+ * Zero-phase IIR filtering of whole recordings, the native counterpart of
+ * scipy.signal.sosfiltfilt() as apply_lowpass_filter() uses it.
+ *
+ * Same algorithm as scipy so the results agree to rounding: odd extension
+ * of both ends by 3 * (2 * sections + 1) samples (less one tap per section
+ * pair with b2 == a2 == 0, as odd-order Butterworths have), sosfilt_zi()
+ * steady state initial conditions scaled by the first sample, a forward
+ * transposed direct form II pass, then the same backwards.
+ *
+ * The channels are filtered together, four to a vector (one lane each),
+ * so the recursion's latency is paid once per sample instead of once per
+ * sample per channel.
+ */
+#ifndef DAQ_FILTFILT_H
+#define DAQ_FILTFILT_H
+
+#include <stddef.h>
+
+namespace daq {
+
+// sos is sections rows of b0 b1 b2 a0 a1 a2 (a0 must be 1, as scipy
+// requires). in and out are channels arrays of samples values each,
+// channel after channel; out may be in. Returns false, leaving out
+// untouched, if samples isn't more than sosfiltfilt_padlen().
+bool sosfiltfilt(const double *sos, int sections, const double *in, double *out, int channels,
+                 size_t samples);
+
+// Samples added at each end; recordings must be longer than this
+size_t sosfiltfilt_padlen(const double *sos, int sections);
+
+}  // namespace daq
+
+#endif  // DAQ_FILTFILT_H
@@ -0,0 +1,211 @@
+/*
+ * Live IIR filtering, see iir.h.
+ */
+#include "iir.h"
+
+#include "butterworth.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace daq {
+
+namespace {
+
+// Rows the sample rate is measured over before designing the filter
+const size_t probe_rows = 16;
+
+}  // namespace
+
+std::vector<double> butter_lowpass(int order, double cutoff_hz, double fs) {
+  std::vector<double> sos;
+  if (order < 1 || !(cutoff_hz > 0) || !(cutoff_hz < fs / 2)) return sos;
+
+  // The firmware's compile time designer, run at runtime
+  const double t = butterworth::prewarp(cutoff_hz, fs);
+  for (int k = 0; k < (order + 1) / 2; k++) {
+    butterworth::Section c = butterworth::section(order, k, t);
+    sos.insert(sos.end(), {c.b0, c.b1, c.b2, 1, c.a1, c.a2});
+  }
+  return sos;
+}
+
+std::vector<double> sosfilt_zi(const double *sos, int sections) {
+  std::vector<double> zi(2 * sections);
+  double scale = 1.0;
+  for (int s = 0; s < sections; s++) {
+    const double *c = sos + 6 * s;
+    // lfilter_zi() for a biquad, (I - A) zi = B solved by hand
+    double B0 = c[1] - c[4] * c[0];
+    double B1 = c[2] - c[5] * c[0];
+    double z0 = (B0 + B1) / (1.0 + c[4] + c[5]);
+    zi[2 * s] = scale * z0;
+    zi[2 * s + 1] = scale * (B1 - c[5] * z0);
+    scale *= (c[0] + c[1] + c[2]) / (1.0 + c[4] + c[5]);
+  }
+  return zi;
+}
+
+SosFilter::SosFilter(const std::vector<double> &sos, int channels)
+    : sos_(sos), zi_(sosfilt_zi(sos.data(), sos.size() / 6)), z_(channels * zi_.size()), channels_(channels) {}
+
+void SosFilter::process(const double *in, double *out) {
+  const int ns = sections();
+  if (!primed_) {
+    for (int ch = 0; ch < channels_; ch++) {
+      for (int k = 0; k < 2 * ns; k++) z_[ch * 2 * ns + k] = zi_[k] * in[ch];
+    }
+    primed_ = true;
+  }
+
+  for (int ch = 0; ch < channels_; ch++) {
+    double x = in[ch];
+    double *z = &z_[ch * 2 * ns];
+    for (int s = 0; s < ns; s++, z += 2) {
+      const double *c = &sos_[6 * s];
+      double y = c[0] * x + z[0];
+      z[0] = c[1] * x - c[4] * y + z[1];
+      z[1] = c[2] * x - c[5] * y;
+      x = y;
+    }
+    out[ch] = x;
+  }
+}
+
+RowFilter::RowFilter(int order, double cutoff_hz, double lag_ms)
+    : order_(order), cutoff_(cutoff_hz), lag_ms_(lag_ms) {}
+
+void RowFilter::start(const std::vector<int> &columns, double tick_us) {
+  columns_ = columns;
+  tick_us_ = tick_us;
+  designed_ = false;
+  fs_ = 0;
+  sos_.clear();
+  lag_ = 0;
+  ring_.assign(probe_rows, Held());
+  head_ = count_ = 0;
+}
+
+void RowFilter::design() {
+  // Most steps are one sample period: the median of the positive ones,
+  // which drops (bigger) and a garbled time digit (either way) don't move
+  std::vector<uint64_t> steps;
+  for (size_t i = 1; i < count_; i++) {
+    uint64_t t0 = ring_[(head_ + i - 1) % ring_.size()].row.time_us;
+    uint64_t t1 = ring_[(head_ + i) % ring_.size()].row.time_us;
+    if (t1 > t0) steps.push_back(t1 - t0);
+  }
+  if (!steps.empty()) {
+    // numpy's median: the middle one, or the mean of the middle two
+    size_t mid = steps.size() / 2;
+    std::nth_element(steps.begin(), steps.begin() + mid, steps.end());
+    double step = steps[mid];
+    if (steps.size() % 2 == 0) step = (step + *std::max_element(steps.begin(), steps.begin() + mid)) / 2;
+    fs_ = 1e6 / (step * tick_us_);
+    sos_ = butter_lowpass(order_, cutoff_, fs_);
+  }
+  lag_ = lag_ms_ > 0 && fs_ > 0 ? (size_t)ceil(lag_ms_ * 1e-3 * fs_) : 0;
+  forward_ = SosFilter(sos_, columns_.size());
+  backward_ = SosFilter(sos_, columns_.size());
+  designed_ = true;
+
+  // Room for 2 * lag; nothing has been sent yet, so the held rows are
+  // still at the front in order
+  if (ring_.size() < 2 * lag_ + 1) ring_.resize(2 * lag_ + 1);
+  for (size_t i = 0; i < count_; i++) run_forward(ring_[i]);
+}
+
+void RowFilter::hold(const Row &row) {
+  Held &held = ring_[(head_ + count_) % ring_.size()];
+  held.row = row;
+  if (row.text) held.text.assign(row.text, row.text_len);
+  count_++;
+}
+
+void RowFilter::run_forward(Held &held) {
+  double in[max_columns];
+  for (size_t k = 0; k < columns_.size(); k++) in[k] = held.row.values[columns_[k]];
+  if (sos_.empty()) {
+    memcpy(held.forward, in, columns_.size() * sizeof(double));  // no usable filter, pass through
+  } else {
+    forward_.process(in, held.forward);
+  }
+}
+
+void RowFilter::emit(Held &held, const double *filtered) {
+  if (held.row.text) held.row.text = held.text.data();
+  if (on_row) on_row(held.row, filtered);
+}
+
+void RowFilter::emit_held() {
+  for (; count_; count_--, head_ = (head_ + 1) % ring_.size()) emit(ring_[head_], ring_[head_].forward);
+}
+
+void RowFilter::push(const Row &row) {
+  if (designed_ && !lag_) {
+    // Causal: straight through
+    double in[max_columns], out[max_columns];
+    for (size_t k = 0; k < columns_.size(); k++) in[k] = row.values[columns_[k]];
+    if (sos_.empty()) {
+      memcpy(out, in, columns_.size() * sizeof(double));
+    } else {
+      forward_.process(in, out);
+    }
+    if (on_row) on_row(row, out);
+    return;
+  }
+
+  hold(row);
+  if (!designed_) {
+    if (count_ < probe_rows) return;
+    design();
+  } else {
+    run_forward(ring_[(head_ + count_ - 1) % ring_.size()]);
+  }
+
+  if (!lag_) {
+    emit_held();
+  } else if (count_ >= 2 * lag_) {
+    smooth(lag_);
+  }
+}
+
+// Run the held forward output backwards from the newest row, then send
+// out the oldest count rows with the result
+void RowFilter::smooth(size_t count) {
+  const size_t n = columns_.size();
+  smoothed_.resize(count_ * n);
+  if (sos_.empty()) {
+    for (size_t i = 0; i < count_; i++) {
+      memcpy(&smoothed_[i * n], ring_[(head_ + i) % ring_.size()].forward, n * sizeof(double));
+    }
+  } else {
+    backward_.reset();
+    for (size_t i = count_; i-- > 0;) {
+      backward_.process(ring_[(head_ + i) % ring_.size()].forward, &smoothed_[i * n]);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    emit(ring_[head_], &smoothed_[i * n]);
+    head_ = (head_ + 1) % ring_.size();
+    count_--;
+  }
+}
+
+void RowFilter::finish() {
+  if (!count_) return;
+  // Too short to have measured the rate over probe_rows, use what there is
+  if (!designed_) design();
+  if (lag_) {
+    smooth(count_);
+  } else {
+    emit_held();
+  }
+}
+
+}  // namespace daq
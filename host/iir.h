@@ -0,0 +1,117 @@
+/*
+ * Causal IIR filtering for live capture: a runtime Butterworth designer,
+ * a second order section filter that keeps its state between samples,
+ * and RowFilter, which low-passes decoded rows as they arrive so the
+ * capture can write (and act on) filtered values during the recording.
+ *
+ * The filters are the same transposed direct form II as scipy's sosfilt,
+ * started in their steady state for the first sample (sosfilt_zi), so
+ * there's no startup transient; the Arduino's own filter does the same.
+ */
+#ifndef DAQ_IIR_H
+#define DAQ_IIR_H
+
+#include "capture.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace daq {
+
+// Low-pass Butterworth as second order sections, rows of b0 b1 b2 a0 a1 a2,
+// from ../butterworth.h (scipy's butter() poles and section order, each
+// section at unity DC gain). Empty unless 0 < cutoff_hz < fs / 2 and
+// order >= 1.
+std::vector<double> butter_lowpass(int order, double cutoff_hz, double fs);
+
+// Each section's two delays in its steady state for a unit step
+// (scipy.signal.sosfilt_zi), 2 values per section
+std::vector<double> sosfilt_zi(const double *sos, int sections);
+
+// Causal filter over channels inputs, one sample of each at a time
+class SosFilter {
+ public:
+  SosFilter() {}
+  SosFilter(const std::vector<double> &sos, int channels);
+
+  // The first sample after construction or reset() primes the state
+  void process(const double *in, double *out);
+  void reset() { primed_ = false; }
+
+  int sections() const { return sos_.size() / 6; }
+
+ private:
+  std::vector<double> sos_;
+  std::vector<double> zi_;
+  std::vector<double> z_;  // [channel][section][2]
+  int channels_ = 0;
+  bool primed_ = false;
+};
+
+// Rows in, the same rows out with a low-passed value for each of the
+// chosen columns. The sample rate comes from the rows' timestamps (the
+// median step over the first rows), so the filter is designed once
+// enough rows have arrived; until then rows are held back.
+//
+// lag_ms 0 is the causal filter, each row comes straight back with its
+// filtered values. lag_ms > 0 is a fixed-lag smoother: every lag the
+// forward output of the last 2 * lag is run backwards, and the older
+// half goes out, so rows come out lag to 2 * lag late with nearly zero
+// phase. Pick lag_ms a few cutoff periods long so the backward pass has
+// settled by the time it reaches them.
+class RowFilter {
+ public:
+  RowFilter(int order, double cutoff_hz, double lag_ms = 0);
+
+  // Called for every row, with the filtered values in columns() order.
+  // Rows that were held have their text copied, it's valid during the call.
+  std::function<void(const Row &row, const double *filtered)> on_row;
+
+  // New recording: filter these value columns; tick_us is the time unit
+  // of Row::time_us in microseconds
+  void start(const std::vector<int> &columns, double tick_us = 1);
+  void push(const Row &row);
+  // End of the recording, sends out everything still held
+  void finish();
+
+  const std::vector<int> &columns() const { return columns_; }
+  double sample_rate() const { return fs_; }
+  // Empty if it hasn't been designed yet (or the cutoff is above fs / 2)
+  const std::vector<double> &sos() const { return sos_; }
+
+ private:
+  struct Held {
+    Row row;
+    std::string text;
+    double forward[max_columns];
+  };
+
+  void design();
+  void hold(const Row &row);
+  void run_forward(Held &held);
+  void emit(Held &held, const double *filtered);
+  void emit_held();
+  void smooth(size_t count);
+
+  int order_;
+  double cutoff_;
+  double lag_ms_;
+  std::vector<int> columns_;
+  double tick_us_ = 1;
+
+  bool designed_ = false;
+  double fs_ = 0;
+  std::vector<double> sos_;
+  size_t lag_ = 0;  // samples
+  SosFilter forward_, backward_;
+
+  // Held rows, oldest at head_
+  std::vector<Held> ring_;
+  size_t head_ = 0, count_ = 0;
+  std::vector<double> smoothed_;
+};
+
+}  // namespace daq
+
+#endif  // DAQ_IIR_H
@@ -0,0 +1,123 @@
+/*
+ * Min/max pyramid, see lod.h.
+ */
+#include "lod.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace daq {
+
+namespace {
+
+// min_out / max_out[b] = min / max of the b-th fanout (4) inputs, for the
+// first buckets full buckets
+void reduce4(const double *min_in, const double *max_in, size_t buckets, double *min_out, double *max_out) {
+  static_assert(lod_fanout == 4, "reduce4 does buckets of 4");
+  size_t b = 0;
+#ifdef __SSE2__
+  // Two buckets at a time: lanes of the first halves against the second
+  // halves, then the two buckets' pairs against each other
+  for (; b + 2 <= buckets; b += 2) {
+    const double *lo = min_in + b * 4, *hi = max_in + b * 4;
+    __m128d mn0 = _mm_min_pd(_mm_loadu_pd(lo), _mm_loadu_pd(lo + 2));
+    __m128d mn1 = _mm_min_pd(_mm_loadu_pd(lo + 4), _mm_loadu_pd(lo + 6));
+    __m128d mx0 = _mm_max_pd(_mm_loadu_pd(hi), _mm_loadu_pd(hi + 2));
+    __m128d mx1 = _mm_max_pd(_mm_loadu_pd(hi + 4), _mm_loadu_pd(hi + 6));
+    _mm_storeu_pd(min_out + b, _mm_min_pd(_mm_unpacklo_pd(mn0, mn1), _mm_unpackhi_pd(mn0, mn1)));
+    _mm_storeu_pd(max_out + b, _mm_max_pd(_mm_unpacklo_pd(mx0, mx1), _mm_unpackhi_pd(mx0, mx1)));
+  }
+#endif
+  for (; b < buckets; b++) {
+    const double *lo = min_in + b * 4, *hi = max_in + b * 4;
+    min_out[b] = std::min(std::min(lo[0], lo[1]), std::min(lo[2], lo[3]));
+    max_out[b] = std::max(std::max(hi[0], hi[1]), std::max(hi[2], hi[3]));
+  }
+}
+
+}  // namespace
+
+MinMaxPyramid::MinMaxPyramid(const double *time, size_t samples) : time_(time), samples_(samples) {}
+
+int MinMaxPyramid::add_channel(const double *values) {
+  channels_.emplace_back();
+  Channel &channel = channels_.back();
+  channel.values = values;
+
+  // Level 1 from the samples, then each level from the one below, until
+  // one bucket covers everything (reserved, the loop reads the previous
+  // level while adding the next)
+  size_t levels = 0;
+  for (size_t count = samples_; count > 1; count = (count + lod_fanout - 1) / lod_fanout) levels++;
+  channel.levels.reserve(levels);
+  const double *min_in = values, *max_in = values;
+  size_t count = samples_;
+  size_t bucket = 1;
+  while (count > 1) {
+    size_t out_count = (count + lod_fanout - 1) / lod_fanout;
+    bucket *= lod_fanout;
+    channel.levels.push_back(Level{bucket, std::vector<double>(out_count), std::vector<double>(out_count)});
+    Level &level = channel.levels.back();
+    double *min_out = level.min.data(), *max_out = level.max.data();
+
+    size_t full = count / lod_fanout;
+    reduce4(min_in, max_in, full, min_out, max_out);
+    if (full < out_count) {
+      // Last, partial bucket
+      double mn = min_in[full * lod_fanout], mx = max_in[full * lod_fanout];
+      for (size_t i = full * lod_fanout + 1; i < count; i++) {
+        mn = std::min(mn, min_in[i]);
+        mx = std::max(mx, max_in[i]);
+      }
+      min_out[full] = mn;
+      max_out[full] = mx;
+    }
+
+    min_in = min_out;
+    max_in = max_out;
+    count = out_count;
+  }
+  return channels_.size() - 1;
+}
+
+size_t MinMaxPyramid::query(int channel, double t0, double t1, size_t width, double *time, double *min,
+                            double *max) const {
+  if (channel < 0 || channel >= (int)channels_.size() || !samples_) return 0;
+  if (!width) width = 1;
+  const Channel &ch = channels_[channel];
+
+  size_t i0 = std::lower_bound(time_, time_ + samples_, t0) - time_;
+  size_t i1 = std::upper_bound(time_, time_ + samples_, t1) - time_;
+  if (i0 > 0) i0--;
+  if (i1 < samples_) i1++;
+  if (i1 <= i0) return 0;
+  size_t count = i1 - i0;
+
+  // Few enough samples to draw them all
+  if (count <= lod_fanout * width) {
+    std::copy(time_ + i0, time_ + i1, time);
+    std::copy(ch.values + i0, ch.values + i1, min);
+    std::copy(ch.values + i0, ch.values + i1, max);
+    return count;
+  }
+
+  // The coarsest level with at least a bucket per pixel. Level 1 always
+  // qualifies here (count / fanout > width), and the next one up has
+  // fewer than width, so this one has fewer than fanout * width.
+  size_t l = ch.levels.size() - 1;
+  while (l > 0 && count / ch.levels[l].bucket < width) l--;
+  const Level &level = ch.levels[l];
+
+  size_t b0 = i0 / level.bucket, b1 = (i1 - 1) / level.bucket + 1;
+  for (size_t b = b0; b < b1; b++) {
+    time[b - b0] = time_[b * level.bucket];
+    min[b - b0] = level.min[b];
+    max[b - b0] = level.max[b];
+  }
+  return b1 - b0;
+}
+
+}  // namespace daq
@@ -0,0 +1,64 @@
+/*
+ * Min/max level-of-detail pyramid for plotting long captures, so a plot
+ * costs the same whatever the recording length.
+ *
+ * Level 1 holds the min and max of every lod_fanout samples of a
+ * channel, level 2 of every lod_fanout level 1 buckets, and so on up to
+ * a single bucket; all levels together are 2/3 the size of the channel.
+ * A query for a time window at a pixel width picks the coarsest level
+ * that still has a bucket per pixel (or the samples themselves if the
+ * window is that short) and returns at most 4 * width + 2 buckets, each
+ * drawn as a vertical min-max stroke, which looks the same as drawing
+ * every sample.
+ */
+#ifndef DAQ_LOD_H
+#define DAQ_LOD_H
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace daq {
+
+const size_t lod_fanout = 4;
+
+class MinMaxPyramid {
+ public:
+  // time must be non-decreasing. It and the channels' values are used in
+  // place, not copied, so they must outlive the pyramid.
+  MinMaxPyramid(const double *time, size_t samples);
+
+  // Builds the levels for one more channel of samples values; returns
+  // its index for query()
+  int add_channel(const double *values);
+
+  int channels() const { return channels_.size(); }
+  size_t samples() const { return samples_; }
+
+  // Buckets of channel covering [t0, t1] (plus a sample either side so
+  // lines reach the edges) for a plot width pixels wide: time of each
+  // bucket's first sample, its min and max (equal for raw samples). The
+  // arrays need max_points(width) room; returns how many were written.
+  size_t query(int channel, double t0, double t1, size_t width, double *time, double *min,
+               double *max) const;
+
+  static size_t max_points(size_t width) { return lod_fanout * width + 2; }
+
+ private:
+  struct Level {
+    size_t bucket;  // samples per bucket
+    std::vector<double> min, max;
+  };
+  struct Channel {
+    const double *values;
+    std::vector<Level> levels;  // levels[0] is level 1
+  };
+
+  const double *time_;
+  size_t samples_;
+  std::vector<Channel> channels_;
+};
+
+}  // namespace daq
+
+#endif  // DAQ_LOD_H
@@ -0,0 +1,231 @@
+/*
+ * Uniform resampling, see resample.h.
+ */
+#include "resample.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace daq {
+
+namespace {
+
+// Kernel integral tables' resolution, points per unit of x (linearly
+// interpolated)
+const int kernel_steps = 256;
+
+// Trimmed inputs are only erased once this many have piled up
+const size_t trim_slack = 1024;
+
+}  // namespace
+
+bool parse_interp(const char *name, Interp *interp) {
+  if (!strcmp(name, "linear")) {
+    *interp = Interp::linear;
+  } else if (!strcmp(name, "cubic")) {
+    *interp = Interp::cubic;
+  } else if (!strcmp(name, "sinc")) {
+    *interp = Interp::sinc;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+Resampler::Resampler(int channels, double period, Interp interp, int half_width)
+    : channels_(channels), period_(period), interp_(interp), half_width_(std::max(half_width, 1)), out_(channels) {
+  if (interp_ != Interp::sinc) return;
+  // Running integrals of k(x) = sinc(x) * Blackman window over
+  // |x| < half_width, and of x k(x), by the trapezoid rule on a fine grid
+  size_t points = half_width_ * kernel_steps + 1;
+  k0_.resize(points);
+  k1_.resize(points);
+  double prev = 1;
+  for (size_t i = 1; i < points; i++) {
+    double x = (double)i / kernel_steps;
+    double w = 0.42 + 0.5 * cos(M_PI * x / half_width_) + 0.08 * cos(2 * M_PI * x / half_width_);
+    double k = sin(M_PI * x) / (M_PI * x) * w;
+    k0_[i] = k0_[i - 1] + (prev + k) / (2 * kernel_steps);
+    k1_[i] = k1_[i - 1] + ((x - 1.0 / kernel_steps) * prev + x * k) / (2 * kernel_steps);
+    prev = k;
+  }
+}
+
+// The integrals from 0 to x, for x of either sign (k is even), constant
+// past the window
+void Resampler::integrals(double x, double *i0, double *i1) const {
+  double ax = fabs(x) * kernel_steps;
+  size_t i = std::min((size_t)ax, k0_.size() - 2);
+  double f = std::min(ax - i, 1.0);
+  double a0 = k0_[i] + f * (k0_[i + 1] - k0_[i]);
+  *i0 = x < 0 ? -a0 : a0;
+  *i1 = k1_[i] + f * (k1_[i + 1] - k1_[i]);
+}
+
+// The sinc's unit: the output period, or the mean input spacing if the
+// inputs are sparser, so it never asks for detail the inputs don't have
+double Resampler::scale() const {
+  if (inputs_ < 2) return period_;
+  return std::max(period_, (time(count() - 1) - first_time_) / (inputs_ - 1));
+}
+
+void Resampler::push(double t, const double *v) {
+  if (inputs_ && !(t > time(count() - 1))) {
+    skipped_++;
+    return;
+  }
+  if (!inputs_) first_time_ = t;
+  times_.push_back(t);
+  values_.insert(values_.end(), v, v + channels_);
+  inputs_++;
+  emit(false);
+}
+
+void Resampler::finish() {
+  if (inputs_) emit(true);
+}
+
+void Resampler::emit(bool finishing) {
+  const double last = time(count() - 1);
+  double *values = out_.data();
+
+  for (;;) {
+    double t = first_time_ + next_ * period_;
+    if (t > last) break;
+    while (cursor_ + 1 < count() && time(cursor_ + 1) <= t) cursor_++;
+
+    // Wait for the inputs after t that the interpolation uses
+    bool ready = finishing;
+    if (interp_ == Interp::linear) ready = ready || cursor_ + 1 < count();
+    if (interp_ == Interp::cubic) ready = ready || cursor_ + 2 < count();
+    if (interp_ == Interp::sinc) ready = ready || last >= t + reach();
+    if (!ready) break;
+
+    if (interp_ == Interp::sinc) {
+      sinc(t, values);
+    } else {
+      interpolate(t, cursor_, interp_ == Interp::cubic, values);
+    }
+    if (on_sample) on_sample(t, values);
+    outputs_++;
+    next_++;
+  }
+
+  // Keep what the next output can still need: the input before the
+  // cursor for the cubic's slope, the kernel's reach back for sinc
+  size_t keep = cursor_ > base_ ? cursor_ - 1 : base_;
+  if (interp_ == Interp::sinc) {
+    double from = first_time_ + next_ * period_ - reach();
+    keep = cursor_;
+    while (keep > base_ && time(keep) > from) keep--;
+  }
+  trim(keep);
+}
+
+void Resampler::interpolate(double t, size_t i, bool cubic, double *out) const {
+  const double *y0 = values(i);
+  if (i + 1 >= count()) {
+    memcpy(out, y0, channels_ * sizeof(double));  // t is the last input's time
+    return;
+  }
+  const double *y1 = values(i + 1);
+  double t0 = time(i), t1 = time(i + 1), h = t1 - t0;
+  double u = (t - t0) / h;
+
+  if (!cubic) {
+    for (int c = 0; c < channels_; c++) out[c] = y0[c] + u * (y1[c] - y0[c]);
+    return;
+  }
+
+  // Cubic Hermite on [t0, t1], slopes from the neighbours either side
+  // (one sided at the ends)
+  bool before = i > base_, after = i + 2 < count();
+  const double *ym = before ? values(i - 1) : y0;
+  const double *y2 = after ? values(i + 2) : y1;
+  double tm = before ? time(i - 1) : t0, t2 = after ? time(i + 2) : t1;
+  double u2 = u * u, u3 = u2 * u;
+  double h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u, h01 = -2 * u3 + 3 * u2, h11 = u3 - u2;
+  for (int c = 0; c < channels_; c++) {
+    double m0 = (y1[c] - ym[c]) / (t1 - tm);
+    double m1 = (y2[c] - y0[c]) / (t2 - t0);
+    out[c] = h00 * y0[c] + h10 * h * m0 + h01 * y1[c] + h11 * h * m1;
+  }
+}
+
+void Resampler::sinc(double t, double *out) const {
+  const double s = scale(), r = reach();
+  size_t lo = cursor_, hi = cursor_ + 1;
+  while (lo > base_ && time(lo) > t - r) lo--;
+  while (hi + 1 < count() && time(hi) < t + r) hi++;
+
+  // The kernel applied to the line through the inputs, integrated
+  // exactly segment by segment: a gap is bridged by its segment rather
+  // than weighing the lobes either side, which would leave the result
+  // at the mercy of where the samples happened to land. Normalized by
+  // the kernel's integral over the segments, for the ends of the stream.
+  std::fill(out, out + channels_, 0.0);
+  double total = 0;
+  for (size_t j = lo; j < hi; j++) {
+    double xa = (t - time(j)) / s, xb = (t - time(j + 1)) / s;
+    double a0, a1, b0, b1;
+    integrals(xa, &a0, &a1);
+    integrals(xb, &b0, &b1);
+    double i0 = a0 - b0, i1 = a1 - b1;
+    if (!i0 && !i1) continue;
+    // y(x) = y0 + (y1 - y0) * (xa - x) / (xa - xb) over the segment
+    double w1 = (xa * i0 - i1) / (xa - xb), w0 = i0 - w1;
+    const double *y0 = values(j), *y1 = values(j + 1);
+    for (int c = 0; c < channels_; c++) out[c] += w0 * y0[c] + w1 * y1[c];
+    total += i0;
+  }
+  if (total > 1e-3) {
+    for (int c = 0; c < channels_; c++) out[c] /= total;
+  } else {
+    interpolate(t, cursor_, false, out);  // too little of the kernel covered
+  }
+}
+
+void Resampler::trim(size_t keep_from) {
+  size_t drop = keep_from - base_;
+  if (drop < trim_slack || drop < times_.size() / 2) return;
+  times_.erase(times_.begin(), times_.begin() + drop);
+  values_.erase(values_.begin(), values_.begin() + drop * channels_);
+  base_ = keep_from;
+}
+
+size_t resample_count(const double *time, size_t samples, double period) {
+  if (!samples || !(period > 0)) return 0;
+  double t0 = time[0], last = time[samples - 1];
+  if (!(last >= t0)) return 1;
+  // The grid points t0 + k * period <= last, computed the way the
+  // Resampler does
+  size_t k = (size_t)((last - t0) / period);
+  while (t0 + (k + 1) * period <= last) k++;
+  while (k > 0 && t0 + k * period > last) k--;
+  return k + 1;
+}
+
+size_t resample(const double *time, const double *in, int channels, size_t samples, double period, Interp interp,
+                double *out_time, double *out) {
+  size_t capacity = resample_count(time, samples, period);
+  if (!capacity) return 0;
+  size_t n = 0;
+  Resampler resampler(channels, period, interp);
+  resampler.on_sample = [&](double t, const double *values) {
+    if (n >= capacity) return;
+    out_time[n] = t;
+    for (int c = 0; c < channels; c++) out[c * capacity + n] = values[c];
+    n++;
+  };
+  std::vector<double> row(channels);
+  for (size_t i = 0; i < samples; i++) {
+    for (int c = 0; c < channels; c++) row[c] = in[c * samples + i];
+    resampler.push(time[i], row.data());
+  }
+  resampler.finish();
+  return n;
+}
+
+}  // namespace daq
@@ -0,0 +1,99 @@
+/*
+ * Resampling a timestamped stream onto an exact uniform grid, so filters
+ * designed for a sample rate see that rate. Rows arrive with jittered
+ * timestamps (older firmware samples whenever loop() gets round to it)
+ * and with gaps where samples were dropped; the output has one sample
+ * every period from the first input time, values interpolated:
+ *
+ *   linear  between the two neighbouring inputs
+ *   cubic   Hermite with Catmull-Rom slopes from the neighbours (through
+ *           the inputs, continuous slope; the default)
+ *   sinc    Blackman windowed sinc, band limited to the output's Nyquist
+ *           rate (or the input's, if that's lower), applied to the line
+ *           through the inputs so gaps and clumps don't bias it
+ *
+ * It streams: inputs are pushed one at a time and outputs come out
+ * through on_sample as soon as the inputs they depend on have arrived,
+ * keeping only the last few inputs.
+ */
+#ifndef DAQ_RESAMPLE_H
+#define DAQ_RESAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+namespace daq {
+
+enum class Interp { linear, cubic, sinc };
+
+// "linear", "cubic" or "sinc"; false if it's none of them
+bool parse_interp(const char *name, Interp *interp);
+
+class Resampler {
+ public:
+  // period is in the input times' unit; sinc uses half_width input
+  // periods of inputs either side
+  Resampler(int channels, double period, Interp interp = Interp::cubic, int half_width = 8);
+
+  // Called for every output sample; values has channels entries
+  std::function<void(double time, const double *values)> on_sample;
+
+  // Times must increase; an input at or before the previous one is
+  // skipped (and counted)
+  void push(double time, const double *values);
+  // End of the stream: the outputs up to the last input time
+  void finish();
+
+  int channels() const { return channels_; }
+  double period() const { return period_; }
+  uint64_t inputs() const { return inputs_; }
+  uint64_t outputs() const { return outputs_; }
+  uint64_t skipped() const { return skipped_; }
+
+ private:
+  double time(size_t i) const { return times_[i - base_]; }
+  const double *values(size_t i) const { return &values_[(i - base_) * channels_]; }
+  size_t count() const { return base_ + times_.size(); }
+
+  void emit(bool finishing);
+  void interpolate(double t, size_t i, bool cubic, double *out) const;
+  void sinc(double t, double *out) const;
+  void integrals(double x, double *i0, double *i1) const;
+  double scale() const;
+  double reach() const { return half_width_ * scale(); }
+  void trim(size_t keep_from);
+
+  int channels_;
+  double period_;
+  Interp interp_;
+  int half_width_;
+  // Integrals of the sinc kernel k and of x k from 0, kernel_steps points
+  // per unit of x
+  std::vector<double> k0_, k1_;
+  std::vector<double> out_;
+
+  // Inputs base_ onwards (older ones are dropped once no output needs them)
+  std::vector<double> times_, values_;
+  size_t base_ = 0;
+  size_t cursor_ = 0;  // last input at or before the next output time
+  double first_time_ = 0;
+  uint64_t next_ = 0;  // next output is at first_time_ + next_ * period_
+
+  uint64_t inputs_ = 0, outputs_ = 0, skipped_ = 0;  // inputs_ counts the accepted ones
+};
+
+// Whole arrays at once through a Resampler: time[samples], in is channels
+// arrays of samples values (channel after channel), out the same with
+// room for resample_count() outputs per channel (channel c starts at
+// out + c * resample_count()). Returns how many were written, fewer only
+// if times went backwards.
+size_t resample(const double *time, const double *in, int channels, size_t samples, double period, Interp interp,
+                double *out_time, double *out);
+size_t resample_count(const double *time, size_t samples, double period);
+
+}  // namespace daq
+
+#endif  // DAQ_RESAMPLE_H
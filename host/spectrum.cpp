@@ -0,0 +1,131 @@
+/*
+ * FFT and Welch's method, see spectrum.h.
+ */
+#include "spectrum.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace daq {
+
+RealFft::RealFft(size_t n) : n_(n), twiddle_(n / 2), reverse_(n / 2), work_(n / 2), spectrum_(n / 2 + 1) {
+  for (size_t k = 0; k < n / 2; k++) twiddle_[k] = std::polar(1.0, -2 * M_PI * k / n);
+  size_t half = n / 2;
+  int bits = 0;
+  while ((size_t)1 << bits < half) bits++;
+  for (size_t k = 0; k < half; k++) {
+    uint32_t r = 0;
+    for (int b = 0; b < bits; b++) r |= ((k >> b) & 1) << (bits - 1 - b);
+    reverse_[k] = r;
+  }
+}
+
+void RealFft::forward(const double *in, std::complex<double> *out) {
+  const size_t half = n_ / 2;
+  // Even samples as the real parts, odd as the imaginary, in bit
+  // reversed order for the in place butterflies
+  for (size_t k = 0; k < half; k++) work_[reverse_[k]] = std::complex<double>(in[2 * k], in[2 * k + 1]);
+
+  // Radix 2, the twiddles for a len point stage are every n / len th
+  for (size_t len = 2; len <= half; len *= 2) {
+    size_t stride = n_ / len;
+    for (size_t i = 0; i < half; i += len) {
+      for (size_t j = 0; j < len / 2; j++) {
+        std::complex<double> a = work_[i + j];
+        std::complex<double> b = work_[i + j + len / 2] * twiddle_[j * stride];
+        work_[i + j] = a + b;
+        work_[i + j + len / 2] = a - b;
+      }
+    }
+  }
+
+  // Z = E + i O, where E and O are the even and odd samples' spectra;
+  // X[k] = E[k] + W^k O[k]
+  for (size_t k = 0; k <= half; k++) {
+    std::complex<double> z = work_[k == half ? 0 : k];
+    std::complex<double> zc = std::conj(work_[k ? half - k : 0]);
+    std::complex<double> even = 0.5 * (z + zc);
+    std::complex<double> odd = std::complex<double>(0, -0.5) * (z - zc);
+    std::complex<double> w = k < half ? twiddle_[k] : std::complex<double>(-1, 0);
+    out[k] = even + w * odd;
+  }
+}
+
+void RealFft::power(const double *in, double *out) {
+  forward(in, spectrum_.data());
+  for (size_t k = 0; k < bins(); k++) out[k] = std::norm(spectrum_[k]);
+}
+
+std::vector<double> spectral_window(const char *name, size_t n) {
+  std::vector<double> w(n);
+  for (size_t k = 0; k < n; k++) {
+    double x = 2 * M_PI * k / n;
+    if (!strcmp(name, "hann")) {
+      w[k] = 0.5 - 0.5 * cos(x);
+    } else if (!strcmp(name, "hamming")) {
+      w[k] = 0.54 - 0.46 * cos(x);
+    } else if (!strcmp(name, "blackman")) {
+      w[k] = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+    } else if (!strcmp(name, "rect")) {
+      w[k] = 1;
+    } else {
+      return std::vector<double>();
+    }
+  }
+  return w;
+}
+
+Welch::Welch(const std::vector<double> &window, size_t step, double fs)
+    : fft_(window.size()), window_(window), step_(std::max(step, (size_t)1)), fs_(fs) {
+  double energy = 0;
+  for (double w : window_) energy += w * w;
+  scale_ = 1.0 / (fs_ * energy);
+  frame_.resize(window_.size());
+  power_.resize(bins());
+  sum_.resize(bins());
+}
+
+void Welch::push(const double *x, size_t n) {
+  const size_t len = window_.size();
+  // Drop what no segment needs any more before growing
+  if (start_ >= len && start_ >= pending_.size() / 2) {
+    size_t drop = std::min(start_, pending_.size());
+    pending_.erase(pending_.begin(), pending_.begin() + drop);
+    start_ -= drop;
+  }
+  pending_.insert(pending_.end(), x, x + n);
+  while (pending_.size() >= start_ + len) {
+    segment();
+    start_ += step_;
+  }
+}
+
+void Welch::segment() {
+  const size_t len = window_.size();
+  const double *x = &pending_[start_];
+  double mean = 0;
+  for (size_t i = 0; i < len; i++) mean += x[i];
+  mean /= len;
+  for (size_t i = 0; i < len; i++) frame_[i] = (x[i] - mean) * window_[i];
+
+  fft_.power(frame_.data(), power_.data());
+  // One sided: every bin but DC and Nyquist stands for its negative twin too
+  for (size_t k = 0; k < bins(); k++) {
+    power_[k] *= (k && k + 1 < bins() ? 2 : 1) * scale_;
+    sum_[k] += power_[k];
+  }
+  segments_++;
+  if (on_segment) on_segment(power_.data());
+}
+
+std::vector<double> Welch::psd() const {
+  std::vector<double> out(bins());
+  if (segments_) {
+    for (size_t k = 0; k < bins(); k++) out[k] = sum_[k] / segments_;
+  }
+  return out;
+}
+
+}  // namespace daq
@@ -0,0 +1,83 @@
+/*
+ * Spectral estimates of captured channels: a real FFT, and Welch's
+ * method over a stream of samples, which also hands out every segment's
+ * spectrum for a spectrogram (STFT).
+ *
+ * Welch matches scipy.signal.welch(x, fs, window, nperseg, noverlap) with
+ * its defaults otherwise (constant detrend, one-sided density in V^2/Hz,
+ * mean of the segments; a trailing partial segment is left out). It only
+ * keeps the last segment's worth of samples, so it runs over captures of
+ * any length.
+ */
+#ifndef DAQ_SPECTRUM_H
+#define DAQ_SPECTRUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <complex>
+#include <functional>
+#include <vector>
+
+namespace daq {
+
+// Forward FFT of n real samples, n a power of two (>= 4), as the n / 2 + 1
+// bins k = 0 .. n / 2 (the rest are their conjugates): an n / 2 point
+// complex FFT of the even and odd samples, then split into the real
+// input's spectrum
+class RealFft {
+ public:
+  explicit RealFft(size_t n);
+
+  size_t size() const { return n_; }
+  size_t bins() const { return n_ / 2 + 1; }
+  void forward(const double *in, std::complex<double> *out);
+  // |X[k]|^2 of forward()
+  void power(const double *in, double *out);
+
+ private:
+  size_t n_;
+  std::vector<std::complex<double>> twiddle_;  // exp(-2 pi i k / n), k < n / 2
+  std::vector<uint32_t> reverse_;              // bit reversal for n / 2 points
+  std::vector<std::complex<double>> work_, spectrum_;
+};
+
+// "hann", "hamming", "blackman" or "rect" (scipy's periodic windows, as
+// welch() uses them); empty if it's none of those
+std::vector<double> spectral_window(const char *name, size_t n);
+
+class Welch {
+ public:
+  // Segments of window.size() samples (a power of two), each step samples
+  // after the previous one, fs in Hz
+  Welch(const std::vector<double> &window, size_t step, double fs);
+
+  // Called with every segment's density spectrum, bins() values
+  std::function<void(const double *density)> on_segment;
+
+  void push(const double *x, size_t n);
+
+  size_t bins() const { return fft_.bins(); }
+  double frequency(size_t bin) const { return bin * fs_ / fft_.size(); }
+  uint64_t segments() const { return segments_; }
+  // Mean of the segments so far (zeros before the first)
+  std::vector<double> psd() const;
+
+ private:
+  void segment();
+
+  RealFft fft_;
+  std::vector<double> window_;
+  size_t step_;
+  double fs_;
+  double scale_;  // density scaling, with the one-sided doubling left to segment()
+
+  std::vector<double> pending_;  // samples not yet in a segment, oldest first
+  size_t start_ = 0;             // pending_[start_] begins the next segment
+  std::vector<double> frame_, power_, sum_;
+  uint64_t segments_ = 0;
+};
+
+}  // namespace daq
+
+#endif  // DAQ_SPECTRUM_H
@@ -0,0 +1,88 @@
+/*
+ * Lock-free single-producer single-consumer ring, for handing work from
+ * one pipeline stage's thread to the next (daq_capture: serial reader ->
+ * parser -> filter -> writer).
+ *
+ * The slots are allocated up front and filled in place: the producer
+ * claim()s the next free slot, fills it and push()es it; the consumer
+ * reads front() and pop()s it. Neither side ever blocks or takes a lock,
+ * so what to do when the ring is full (drop, wait) is up to the stage.
+ * Each index is written by one side only and read with acquire by the
+ * other, and they sit on separate cache lines.
+ */
+#ifndef DAQ_SPSC_H
+#define DAQ_SPSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace daq {
+
+template <typename T>
+class SpscRing {
+ public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n *= 2;
+    // Default initialized: a ring of plain buffers only gets its pages
+    // once they're used
+    slots_.reset(new T[n]);
+    mask_ = n - 1;
+  }
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // Producer: the slot to fill next, nullptr while the ring is full
+  T *claim() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) return nullptr;
+    }
+    return &slots_[tail & mask_];
+  }
+  // Producer: publish the claimed slot
+  void push() {
+    size_t tail = tail_.load(std::memory_order_relaxed) + 1;
+    tail_.store(tail, std::memory_order_release);
+    size_t used = tail - head_.load(std::memory_order_relaxed);
+    if (used > high_water_.load(std::memory_order_relaxed)) high_water_.store(used, std::memory_order_relaxed);
+  }
+
+  // Consumer: the oldest item, nullptr while the ring is empty
+  T *front() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) return nullptr;
+    }
+    return &slots_[head & mask_];
+  }
+  // Consumer: release the front slot to the producer
+  void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Either thread (or a third one): a snapshot, not exact while running
+  size_t size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+  size_t capacity() const { return mask_ + 1; }
+  uint64_t pushed() const { return tail_.load(std::memory_order_acquire); }
+  // Most items ever queued, as seen at push()
+  size_t high_water() const { return high_water_.load(std::memory_order_relaxed); }
+
+ private:
+  std::unique_ptr<T[]> slots_;
+  size_t mask_;
+
+  alignas(64) std::atomic<size_t> head_{0};  // consumer's
+  size_t cached_tail_ = 0;
+  alignas(64) std::atomic<size_t> tail_{0};  // producer's
+  size_t cached_head_ = 0;
+  std::atomic<size_t> high_water_{0};
+};
+
+}  // namespace daq
+
+#endif  // DAQ_SPSC_H
@@ -0,0 +1,106 @@
+/*
+ * Low-pass parameter sweep, see sweep.h.
+ */
+#include "sweep.h"
+
+#include "filtfilt.h"
+#include "iir.h"
+#include "thread_pool.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace daq {
+
+namespace {
+
+// Step responses run this many cutoff periods either side of the step,
+// long enough for any order here to settle
+const double step_periods = 20;
+
+// Group delay at DC of the sections run causally, in samples: for each
+// B(z) / A(z), sum(k b_k) / sum(b_k) - sum(k a_k) / sum(a_k)
+double dc_delay(const std::vector<double> &sos) {
+  double delay = 0;
+  for (size_t s = 0; s < sos.size(); s += 6) {
+    const double *c = &sos[s];
+    delay += (c[1] + 2 * c[2]) / (c[0] + c[1] + c[2]) - (c[4] + 2 * c[5]) / (1 + c[4] + c[5]);
+  }
+  return delay;
+}
+
+void step_overshoot(const std::vector<double> &sos, double fs, double cutoff_hz, SweepResult *result) {
+  size_t half = std::min((size_t)(step_periods * fs / cutoff_hz), (size_t)1 << 20);
+  half = std::max(half, sosfiltfilt_padlen(sos.data(), sos.size() / 6) + 1);
+  std::vector<double> step(2 * half, 0.0);
+  std::fill(step.begin() + half, step.end(), 1.0);
+
+  // Causal, from rest
+  SosFilter causal(sos, 1);
+  double peak = 0;
+  for (double x : step) {
+    double y;
+    causal.process(&x, &y);
+    peak = std::max(peak, y);
+  }
+  result->causal_overshoot_pct = 100 * (peak - 1);
+
+  std::vector<double> out(step.size());
+  sosfiltfilt(sos.data(), sos.size() / 6, step.data(), out.data(), 1, step.size());
+  result->overshoot_pct = 100 * (*std::max_element(out.begin(), out.end()) - 1);
+}
+
+void run_config(const double *data, int channels, size_t samples, double fs, SweepResult *result) {
+  std::vector<double> sos = butter_lowpass(result->order, result->cutoff_hz, fs);
+  result->residual_rms.assign(channels, NAN);
+  result->valid = !sos.empty() && samples > sosfiltfilt_padlen(sos.data(), sos.size() / 6);
+  if (!result->valid) {
+    result->lag_ms = result->overshoot_pct = result->causal_overshoot_pct = NAN;
+    return;
+  }
+  result->lag_ms = dc_delay(sos) / fs * 1000;
+  step_overshoot(sos, fs, result->cutoff_hz, result);
+
+  std::vector<double> filtered((size_t)channels * samples);
+  sosfiltfilt(sos.data(), sos.size() / 6, data, filtered.data(), channels, samples);
+  for (int c = 0; c < channels; c++) {
+    const double *x = data + c * samples, *y = filtered.data() + c * samples;
+    double sum = 0;
+    for (size_t i = 0; i < samples; i++) sum += (x[i] - y[i]) * (x[i] - y[i]);
+    result->residual_rms[c] = sqrt(sum / samples);
+  }
+}
+
+}  // namespace
+
+std::vector<SweepResult> sweep_lowpass(const double *data, int channels, size_t samples, double fs,
+                                       const std::vector<double> &cutoffs, const std::vector<int> &orders,
+                                       int threads) {
+  std::vector<SweepResult> results;
+  for (double cutoff : cutoffs) {
+    for (int order : orders) results.push_back(SweepResult{cutoff, order, false, NAN, NAN, NAN, {}});
+  }
+
+  // Each result is written by its own task only
+  ThreadPool pool(std::min(threads > 0 ? threads : (int)std::thread::hardware_concurrency(), (int)results.size()));
+  for (SweepResult &result : results) {
+    SweepResult *r = &result;
+    pool.submit([=] { run_config(data, channels, samples, fs, r); });
+  }
+  pool.wait();
+  return results;
+}
+
+double noise_rms(const double *x, size_t samples) {
+  // Second differences of white noise have 6 times its variance
+  if (samples < 3) return NAN;
+  double sum = 0;
+  for (size_t i = 1; i + 1 < samples; i++) {
+    double d = x[i + 1] - 2 * x[i] + x[i - 1];
+    sum += d * d;
+  }
+  return sqrt(sum / (samples - 2) / 6);
+}
+
+}  // namespace daq
@@ -0,0 +1,54 @@
+/*
+ * Low-pass parameter sweep: every cutoff x order Butterworth run over
+ * every channel of a capture, one configuration per task on a thread
+ * pool, with the numbers needed to pick one.
+ *
+ * Per configuration and channel:
+ *   residual_rms   RMS of what the zero-phase filter (sosfiltfilt, as the
+ *                  scripts apply it) took out
+ * Per configuration, from the design alone:
+ *   lag_ms               group delay at DC of the same filter run causally
+ *                        (the Arduino's live filter, daq_capture --filter);
+ *                        the zero-phase one has none
+ *   overshoot_pct        step response overshoot, zero-phase
+ *   causal_overshoot_pct step response overshoot, causal
+ * Per channel:
+ *   noise_rms      the capture's noise floor, estimated from second
+ *                  differences (exact for white noise on a signal that's
+ *                  slow next to the sample rate)
+ *
+ * A residual close to the noise floor means the filter takes out the
+ * noise and leaves the signal; well below, noise is left in; well above,
+ * signal is being removed too.
+ */
+#ifndef DAQ_SWEEP_H
+#define DAQ_SWEEP_H
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace daq {
+
+struct SweepResult {
+  double cutoff_hz;
+  int order;
+  bool valid;  // false if the cutoff isn't below fs / 2 or the capture is too short for it
+  double lag_ms;
+  double overshoot_pct;
+  double causal_overshoot_pct;
+  std::vector<double> residual_rms;  // per channel
+};
+
+// data is channels arrays of samples values, channel after channel.
+// Results are in cutoffs-major order (cutoff 0 with each order, then
+// cutoff 1, ...). threads 0: one per core.
+std::vector<SweepResult> sweep_lowpass(const double *data, int channels, size_t samples, double fs,
+                                       const std::vector<double> &cutoffs, const std::vector<int> &orders,
+                                       int threads = 0);
+
+double noise_rms(const double *x, size_t samples);
+
+}  // namespace daq
+
+#endif  // DAQ_SWEEP_H
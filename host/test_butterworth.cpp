@@ -0,0 +1,144 @@
+/*
+ * butterworth.h against scipy.signal.butter(output='sos'), every design in
+ * testdata/butter.txt (orders 1 to 8, cutoffs 0.1% to 48% of fs), both
+ * through lowpass<Order>() and section() at runtime.
+ *
+ * The sections can't be compared coefficient for coefficient: scipy puts
+ * the whole gain in the first section, butterworth.h gives each one unity
+ * DC gain. So per section the poles (a1, a2) must match, which also checks
+ * scipy's section order, and over the cascade the zeros (the product of
+ * the numerators scaled to b0 = 1) and the overall gain (the product of
+ * the b0s).
+ *
+ * Regenerate the reference with testdata/gen_reference.py.
+ */
+#include "butterworth.h"
+#include "check.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+namespace {
+
+const double pole_tolerance = 1e-12;
+const double zero_tolerance = 1e-9;  // the numerator's coefficients run up to 8 choose 4 = 70
+const double gain_tolerance = 1e-10;  // relative
+
+// Compile time, as the firmware uses it
+constexpr butterworth::Lowpass<4> firmware_default = butterworth::lowpass<4>(2.0, 500.0);
+static_assert(butterworth::Lowpass<4>::sections == 2, "4th order is two sections");
+static_assert(firmware_default.sos[0].b0 > 0 && firmware_default.sos[1].a2 < 1, "constexpr design");
+
+struct Design {
+  int order = 0, sections = 0;
+  double cutoff = 0, fs = 0;
+  std::vector<double> sos;  // scipy's rows, b0 b1 b2 a0 a1 a2
+};
+
+std::vector<Design> read_designs(const char *path) {
+  std::vector<Design> designs;
+  FILE *f = fopen(path, "r");
+  if (!f) return designs;
+  char line[4096];
+  while (fgets(line, sizeof line, f)) {
+    if (line[0] == '#') continue;
+    Design d;
+    int used = 0;
+    if (sscanf(line, "butter %d %lf %lf %d%n", &d.order, &d.cutoff, &d.fs, &d.sections, &used) != 4) {
+      designs.clear();
+      break;
+    }
+    const char *p = line + used;
+    double v;
+    int n;
+    while (sscanf(p, "%lf%n", &v, &n) == 1) {
+      d.sos.push_back(v);
+      p += n;
+    }
+    if (d.sos.size() != 6u * d.sections) {
+      designs.clear();
+      break;
+    }
+    designs.push_back(d);
+  }
+  fclose(f);
+  return designs;
+}
+
+template <int Order>
+std::vector<butterworth::Section> design(double cutoff, double fs) {
+  butterworth::Lowpass<Order> lp = butterworth::lowpass<Order>(cutoff, fs);
+  return std::vector<butterworth::Section>(lp.sos, lp.sos + lp.sections);
+}
+
+std::vector<butterworth::Section> lowpass(int order, double cutoff, double fs) {
+  switch (order) {
+    case 1: return design<1>(cutoff, fs);
+    case 2: return design<2>(cutoff, fs);
+    case 3: return design<3>(cutoff, fs);
+    case 4: return design<4>(cutoff, fs);
+    case 5: return design<5>(cutoff, fs);
+    case 6: return design<6>(cutoff, fs);
+    case 7: return design<7>(cutoff, fs);
+    case 8: return design<8>(cutoff, fs);
+  }
+  return {};
+}
+
+// p *= (1 + b1 z^-1 + b2 z^-2)
+void multiply(std::vector<double> &p, double b1, double b2) {
+  std::vector<double> out(p.size() + 2, 0.0);
+  for (size_t i = 0; i < p.size(); i++) {
+    out[i] += p[i];
+    out[i + 1] += b1 * p[i];
+    out[i + 2] += b2 * p[i];
+  }
+  p = out;
+}
+
+void compare(const Design &d, const std::vector<butterworth::Section> &got, const char *how) {
+  if (got.size() != (size_t)d.sections) {
+    CHECK(false, "%s order %d: %zu sections, scipy has %d", how, d.order, got.size(), d.sections);
+    return;
+  }
+  std::vector<double> want_zeros = {1}, got_zeros = {1};
+  double want_gain = 1, got_gain = 1;
+  for (int i = 0; i < d.sections; i++) {
+    const double *row = &d.sos[6 * i];
+    const butterworth::Section &s = got[i];
+    CHECK(fabs(s.a1 - row[4]) <= pole_tolerance && fabs(s.a2 - row[5]) <= pole_tolerance,
+          "%s order %d at %g Hz, section %d: a1 %.17g a2 %.17g, scipy %.17g %.17g", how, d.order, d.cutoff, i,
+          s.a1, s.a2, row[4], row[5]);
+    multiply(want_zeros, row[1] / row[0], row[2] / row[0]);
+    multiply(got_zeros, s.b1 / s.b0, s.b2 / s.b0);
+    want_gain *= row[0];
+    got_gain *= s.b0;
+  }
+  double worst = 0;
+  for (size_t i = 0; i < want_zeros.size(); i++) worst = fmax(worst, fabs(got_zeros[i] - want_zeros[i]));
+  CHECK(worst <= zero_tolerance, "%s order %d at %g Hz: numerator off by %g", how, d.order, d.cutoff, worst);
+  CHECK(fabs(got_gain / want_gain - 1) <= gain_tolerance, "%s order %d at %g Hz: gain %.17g, scipy %.17g", how,
+        d.order, d.cutoff, got_gain, want_gain);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "testdata/butter.txt";
+  std::vector<Design> designs = read_designs(path);
+  CHECK(!designs.empty(), "couldn't read %s", path);
+
+  for (const Design &d : designs) {
+    compare(d, lowpass(d.order, d.cutoff, d.fs), "lowpass<>()");
+
+    std::vector<butterworth::Section> sections;
+    double t = butterworth::prewarp(d.cutoff, d.fs);
+    for (int i = 0; i < (d.order + 1) / 2; i++) sections.push_back(butterworth::section(d.order, i, t));
+    compare(d, sections, "section()");
+  }
+
+  printf("%zu designs\n", designs.size());
+  return check_result("test_butterworth");
+}
@@ -0,0 +1,117 @@
+/*
+ * parse_csv_file() (csv_parse.h) on what daq_multi writes: four boards
+ * with CONFIG OUTPUT=2 merged into one file, Sample, Time(us) and 32
+ * voltage columns (A0(V) .. A15(V) and their _iir twins), 6 decimals
+ * from CsvWriter. Every row must come back with every column, nothing
+ * rejected but the stray line in the middle. Then a _filtered.csv's
+ * pandas formatted numbers.
+ */
+#include "capture.h"
+#include "check.h"
+#include "csv_parse.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const int boards = 4;
+const int rows = 500;
+
+// daq_multi's merge(): board k's A<n>(V) become A<n + 4k>(V), raw columns
+// then filtered ones per board
+std::vector<std::string> merged_names() {
+  std::vector<std::string> names = {"Sample", "Time(us)"};
+  for (int k = 0; k < boards; k++) {
+    for (int n = 0; n < 4; n++) names.push_back("A" + std::to_string(n + 4 * k) + "(V)");
+    for (int n = 0; n < 4; n++) names.push_back("A" + std::to_string(n + 4 * k) + "(V)_iir");
+  }
+  return names;
+}
+
+double value(int row, int column) {
+  // Filtered columns can dip below 0
+  return 2.5 + 2.6 * sin(0.01 * row * (column + 1) + column);
+}
+
+}  // namespace
+
+int main() {
+  char path[] = "/tmp/test_csv_parse_XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0, "mkstemp failed");
+  if (fd < 0) return check_result("test_csv_parse");
+
+  std::vector<std::string> names = merged_names();
+  const int values = names.size() - 2;
+  {
+    daq::CsvWriter writer(fd);
+    std::string header;
+    for (const std::string &name : names) header += (header.empty() ? "" : ",") + name;
+    writer.header(header);
+
+    daq::Row row;
+    row.count = 0;
+    row.text = nullptr;
+    row.text_len = 0;
+    row.code_bits = 10;
+    std::vector<double> extra(values);
+    for (int r = 0; r < rows; r++) {
+      if (r == rows / 2) {
+        writer.flush();
+        const char stray[] = "SAMPLES_DROPPED:0\n";
+        CHECK(write(fd, stray, sizeof stray - 1) == (ssize_t)sizeof stray - 1, "write failed");
+      }
+      row.sample = 70000 + r;
+      row.time_us = 2000ull * r;
+      for (int c = 0; c < values; c++) extra[c] = value(r, c);
+      writer.row(row, extra.data(), values);
+    }
+    CHECK(writer.flush(), "writing %s failed", path);
+  }
+  close(fd);
+
+  daq::CsvData data;
+  bool ok = daq::parse_csv_file(path, &data);
+  unlink(path);
+  CHECK(ok, "couldn't read it back");
+
+  CHECK(data.names == names, "%zu columns named, %zu written", data.names.size(), names.size());
+  CHECK(data.columns.size() == names.size(), "%zu columns", data.columns.size());
+  CHECK(data.rows == (uint64_t)rows, "%llu rows", (unsigned long long)data.rows);
+  CHECK(data.rejected == 1, "%llu lines rejected", (unsigned long long)data.rejected);
+  if (data.columns.size() == names.size() && data.rows == (uint64_t)rows) {
+    double worst = 0;
+    for (int r = 0; r < rows; r++) {
+      CHECK(data.columns[0][r] == 70000 + r && data.columns[1][r] == 2000.0 * r, "row %d: sample %.0f time %.0f",
+            r, data.columns[0][r], data.columns[1][r]);
+      for (int c = 0; c < values; c++) worst = fmax(worst, fabs(data.columns[c + 2][r] - value(r, c)));
+    }
+    CHECK(worst <= 5e-7, "values off by up to %g", worst);
+  }
+
+  // A _filtered.csv as pandas writes it: full precision and exponents
+  // take the strtod() path, malformed numbers are still rejected
+  const char filtered[] =
+      "Sample,Time(us),A0(V),Time(ms),A0(V)_filtered\n"
+      "7,14000,2.361,14.0,2.3612345678901234\n"
+      "8,16000,-0.005,16.0,-1.25e-05\n"
+      "9,18000,2.361,18.0,2.3.6\n"
+      "10,20000,2.361,20.0,1e\n";
+  daq::parse_csv(filtered, sizeof filtered - 1, &data);
+  CHECK(data.rows == 2 && data.rejected == 2, "%llu rows, %llu rejected", (unsigned long long)data.rows,
+        (unsigned long long)data.rejected);
+  if (data.rows == 2) {
+    CHECK(data.columns[2][0] == 2.361 && data.columns[4][0] == 2.3612345678901234, "row 0: %.17g %.17g",
+          data.columns[2][0], data.columns[4][0]);
+    CHECK(data.columns[2][1] == -0.005 && data.columns[4][1] == -1.25e-05, "row 1: %.17g %.17g",
+          data.columns[2][1], data.columns[4][1]);
+  }
+
+  return check_result("test_csv_parse");
+}
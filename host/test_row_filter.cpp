@@ -0,0 +1,49 @@
+/*
+ * RowFilter's sample rate (iir.h): taken from the first rows' steps, it
+ * must not be thrown by a dropped sample or a garbled Time(us) digit in a
+ * text stream, only by most of the steps.
+ */
+#include "check.h"
+#include "iir.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace {
+
+// Rows at 500 Hz, except where times says otherwise; the rate once designed
+double rate(const std::vector<uint64_t> &times) {
+  daq::RowFilter filter(4, 2.0);
+  filter.on_row = [](const daq::Row &, const double *) {};
+  filter.start({0});
+  for (size_t i = 0; i < times.size(); i++) {
+    daq::Row row = {};
+    row.sample = i + 1;
+    row.time_us = times[i];
+    row.count = 1;
+    row.values[0] = 2.5;
+    filter.push(row);
+  }
+  filter.finish();
+  return filter.sample_rate();
+}
+
+}  // namespace
+
+int main() {
+  std::vector<uint64_t> times;
+  for (int i = 0; i < 64; i++) times.push_back(2000 * (i + 1));
+  CHECK(fabs(rate(times) - 500) < 1e-9, "clean: %g Hz", rate(times));
+
+  std::vector<uint64_t> garbled = times;
+  garbled[5] = 10010;  // a digit off: 10 us after the row before it
+  CHECK(fabs(rate(garbled) - 500) < 1e-9, "garbled time: %g Hz", rate(garbled));
+
+  std::vector<uint64_t> dropped = times;
+  dropped.erase(dropped.begin() + 3, dropped.begin() + 6);
+  CHECK(fabs(rate(dropped) - 500) < 1e-9, "dropped rows: %g Hz", rate(dropped));
+
+  return check_result("test_row_filter");
+}
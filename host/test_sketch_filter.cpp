@@ -0,0 +1,123 @@
+/*
+ * The sketch's fixed-point low-pass (arduino_code.cpp, CONFIG OUTPUT=2)
+ * against a double precision cascade of the exact Butterworth sections it
+ * was rounded from, run on the host shim.
+ *
+ * Each input gets a step, a 1.3 Hz sine and 40 Hz ripple; the raw codes
+ * the sketch sends go through the reference cascade (primed at steady
+ * state on the first code, as the sketch primes its own), and every
+ * filtered code the sketch sends must be within 1 LSB of the reference
+ * rounded to a code, at OVERSAMPLE=0, 1 and 3.
+ */
+#include "Arduino.h"
+#include "butterworth.h"
+#include "capture.h"
+#include "check.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The sketch's compiled in design
+const int order = 4;
+constexpr double cutoff_hz = 2.0, sample_hz = 500.0;
+
+class Reference {
+ public:
+  explicit Reference(double first) {
+    constexpr butterworth::Lowpass<order> lp = butterworth::lowpass<order>(cutoff_hz, sample_hz);
+    for (const butterworth::Section &s : lp.sos) {
+      // Unity DC gain per section: the steady state for first is first
+      sections_.push_back(State{s, first, first, first, first});
+    }
+  }
+  double process(double x) {
+    for (State &st : sections_) {
+      const butterworth::Section &c = st.c;
+      double y = c.b0 * x + c.b1 * st.x1 + c.b2 * st.x2 - c.a1 * st.y1 - c.a2 * st.y2;
+      st.x2 = st.x1;
+      st.x1 = x;
+      st.y2 = st.y1;
+      st.y1 = y;
+      x = y;
+    }
+    return x;
+  }
+
+ private:
+  struct State {
+    butterworth::Section c;
+    double x1, x2, y1, y2;
+  };
+  std::vector<State> sections_;
+};
+
+// Worst filtered code error over one recording, in LSB of 10 + oversample bits
+double run(int oversample, long *rows_out) {
+  sim::reset();
+  sim::set_uart_model(false);
+  for (int ch = 0; ch < 4; ch++) {
+    sim::set_analog_source(ch, [ch](double t) {
+      return 1.0 + (t > 1.0 ? 2.0 : 0.0) + 0.8 * sin(2 * M_PI * 1.3 * t + ch) + 0.05 * sin(2 * M_PI * 40 * t);
+    });
+  }
+  setup();
+  sim::clear_serial_output();
+  // The period is raised to what the ADC can do at this oversampling; the
+  // filter's coefficients don't depend on it
+  sim::serial_input("CONFIG PERIOD_US=2000 DURATION_MS=4000 OVERSAMPLE=" + std::to_string(oversample) +
+                    " OUTPUT=2\n");
+  sim::serial_input("START_BIN\n");
+
+  const std::string &out = sim::serial_output();
+  double start = sim::now_seconds();
+  while (out.find("END_OF_DATA") == std::string::npos && sim::now_seconds() - start < 60) {
+    loop();
+    sim::advance_us(10);
+  }
+  CHECK(out.find("END_OF_DATA") != std::string::npos, "OVERSAMPLE=%d: recording didn't finish", oversample);
+
+  daq::StreamDecoder decoder;
+  std::vector<Reference> refs;
+  double worst = 0;
+  long rows = 0;
+  const int max_code = 1023 << oversample;
+  decoder.on_row = [&](const daq::Row &row) {
+    CHECK(row.count == 8 && row.code_bits == 10 + oversample, "OVERSAMPLE=%d: row has %d values of %d bits",
+          oversample, row.count, row.code_bits);
+    if (row.count != 8) return;
+    if (refs.empty()) {
+      for (int i = 0; i < 4; i++) refs.emplace_back(row.codes[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+      double want = std::min(std::max(refs[i].process(row.codes[i]), 0.0), (double)max_code);
+      worst = std::max(worst, fabs(row.codes[4 + i] - want));
+    }
+    rows++;
+  };
+  decoder.feed((const uint8_t *)out.data(), out.size());
+  CHECK(decoder.columns().size() == 8 && decoder.columns()[4] == "A0(V)_iir", "OVERSAMPLE=%d: header %s",
+        oversample, decoder.header().c_str());
+  CHECK(!decoder.stats().bad_frames, "OVERSAMPLE=%d: %llu bad frames", oversample,
+        (unsigned long long)decoder.stats().bad_frames);
+  *rows_out = rows;
+  return worst;
+}
+
+}  // namespace
+
+int main() {
+  for (int oversample : {0, 1, 3}) {
+    long rows = 0;
+    double worst = run(oversample, &rows);
+    printf("OVERSAMPLE=%d: %ld rows, worst filtered code off by %.3f LSB\n", oversample, rows, worst);
+    CHECK(rows > 100, "OVERSAMPLE=%d: only %ld rows", oversample, rows);
+    CHECK(worst <= 1.0, "OVERSAMPLE=%d: %.3f LSB from the double precision cascade", oversample, worst);
+  }
+  return check_result("test_sketch_filter");
+}
@@ -0,0 +1,77 @@
+/*
+ * StreamDecoder's binary frame handling (capture.h): the 16-bit sample
+ * index unwraps across 65535 -> 0 and across gaps longer than that, while
+ * a frame whose checksum happens to pass but whose index or time is
+ * corrupted, a jump forward as much as a step back, is dropped as bad and
+ * the genuine frames after it are kept.
+ */
+#include "capture.h"
+#include "check.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// A START_BIN frame with four 10-bit codes, as arduino_code.cpp sends it
+std::vector<uint8_t> frame(uint16_t index, uint32_t time_us, const uint16_t codes[4]) {
+  std::vector<uint8_t> f = {0xA5, 0x5A, (uint8_t)index, (uint8_t)(index >> 8), (uint8_t)time_us,
+                            (uint8_t)(time_us >> 8), (uint8_t)(time_us >> 16), (uint8_t)(time_us >> 24)};
+  uint64_t bits = 0;
+  for (int i = 0; i < 4; i++) bits |= (uint64_t)codes[i] << (10 * i);
+  for (int i = 0; i < 5; i++) f.push_back(bits >> (8 * i));
+  uint8_t check = 0;
+  for (size_t i = 2; i < f.size(); i++) check ^= f[i];
+  f.push_back(check);
+  return f;
+}
+
+}  // namespace
+
+int main() {
+  daq::StreamDecoder decoder;
+  std::vector<uint64_t> samples;
+  decoder.on_row = [&](const daq::Row &row) { samples.push_back(row.sample); };
+
+  std::string header = "Sample,Time(us),A0(V),A1(V),A2(V),A3(V)\r\n";
+  decoder.feed((const uint8_t *)header.data(), header.size());
+
+  // Sample n is stamped n periods into the recording, as the sketch does
+  const uint32_t period = 2000;
+  const uint16_t codes[4] = {0, 511, 1023, 42};
+  std::vector<uint8_t> stream;
+  auto add = [&](uint64_t sample, uint32_t time_us) {
+    std::vector<uint8_t> f = frame((uint16_t)sample, time_us, codes);
+    stream.insert(stream.end(), f.begin(), f.end());
+  };
+  auto good = [&](uint64_t sample) { add(sample, (uint32_t)(sample * period)); };
+  good(65533);
+  good(65534);
+  good(65535);
+  good(65536);  // index wraps to 0
+  good(65537);
+  good(65538);
+  add(65536 + 0x0100, 65539 * period);  // corrupted index, jumping forward
+  good(65539);                          // ... the genuine frames after it stay
+  good(65540);
+  good(65541);
+  add(65537, 65542 * period);  // corrupted index, a small step back
+  good(65542);
+  add(65543, 65543 * period + 0x10000);  // corrupted time
+  good(65543);
+  good(65544);
+  good(65700);          // host side gap
+  good(65700 + 70000);  // a gap longer than the index's 65536
+  good(65700 + 70001);
+  decoder.feed(stream.data(), stream.size());
+
+  std::vector<uint64_t> want = {65533, 65534, 65535, 65536, 65537, 65538, 65539, 65540, 65541,
+                                65542, 65543, 65544, 65700, 135700, 135701};
+  CHECK(samples == want, "got %zu rows, last %llu", samples.size(),
+        samples.empty() ? 0ULL : (unsigned long long)samples.back());
+  CHECK(decoder.stats().bad_frames == 3, "%llu bad frames, 3 corrupted",
+        (unsigned long long)decoder.stats().bad_frames);
+  return check_result("test_stream_decoder");
+}
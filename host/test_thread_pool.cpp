@@ -0,0 +1,58 @@
+/*
+ * WorkStealingPool's order (thread_pool.h): tasks from outside the pool
+ * run in submission order, a task's own subtasks newest first and before
+ * the next outside task. One worker makes that deterministic; then four
+ * workers and a lot of nested tasks, which must all run exactly once.
+ */
+#include "check.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+int main() {
+  {
+    daq::WorkStealingPool pool(1);
+    std::mutex mutex;
+    std::string order;
+    auto log = [&](char c) {
+      std::lock_guard<std::mutex> lock(mutex);
+      order += c;
+    };
+    // Held until everything is submitted, so nothing runs early
+    std::mutex gate;
+    gate.lock();
+    pool.submit([&] {
+      std::lock_guard<std::mutex> hold(gate);
+      log('A');
+      pool.submit([&] { log('1'); });
+      pool.submit([&] { log('2'); });
+    });
+    pool.submit([&] { log('B'); });
+    pool.submit([&] {
+      log('C');
+      pool.submit([&] { log('3'); });
+    });
+    pool.submit([&] { log('D'); });
+    gate.unlock();
+    pool.wait();
+    CHECK(order == "A21BC3D", "ran in the order %s", order.c_str());
+  }
+
+  {
+    daq::WorkStealingPool pool(4);
+    std::atomic<int> runs{0};
+    for (int i = 0; i < 100; i++) {
+      pool.submit([&] {
+        for (int j = 0; j < 10; j++) pool.submit([&] { runs++; });
+        runs++;
+      });
+    }
+    pool.wait();
+    CHECK(runs == 1100, "%d tasks ran, 1100 submitted", runs.load());
+  }
+
+  return check_result("test_thread_pool");
+}
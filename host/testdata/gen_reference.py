@@ -0,0 +1,275 @@
+"""
+Reference data for the make check tests (host/test_*.cpp), from scipy:
+
+  butter.txt        scipy.signal.butter(output='sos') designs, orders 1 to
+                    8 at cutoffs from 0.1% to 48% of the sample rate
+  sosfiltfilt.txt   scipy.signal.sosfiltfilt() of Butterworth designs (even
+                    and odd orders) on 9 channels of test signal, at
+                    lengths from just over the padding up
+
+Run from anywhere, rewrites the files next to this script:
+  python3 host/testdata/gen_reference.py
+
+Where scipy isn't installed the same numbers are computed from scipy's
+algorithms (buttap / bilinear_zpk / zpk2sos, odd_ext / sosfilt_zi /
+sosfilt) in 60 digit decimal arithmetic instead, rounded to doubles at
+the end; --exact forces that. Each file's first line says which was used.
+Either way the references are good to well under the tests' tolerances.
+"""
+import argparse
+import math
+import os
+import random
+from decimal import Decimal, getcontext
+
+getcontext().prec = 60
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+BUTTER_ORDERS = range(1, 9)
+BUTTER_FS = 500.0
+BUTTER_CUTOFFS = [0.5, 2.0, 10.0, 50.0, 120.0, 240.0]
+
+# (order, cutoff / fs) for the sosfiltfilt cases: even and odd orders, a
+# one-section design, low and high cutoffs
+FILTFILT_DESIGNS = [(1, 0.05), (2, 0.004), (3, 0.1), (4, 0.004), (5, 0.02), (8, 0.2), (9, 0.01)]
+FILTFILT_CHANNELS = 9
+
+# ---- decimal arithmetic ----
+
+def _pi():
+    # The decimal module documentation's recipe
+    getcontext().prec += 2
+    three = Decimal(3)
+    lasts, t, s, n, na, d, da = 0, three, 3, 1, 0, 0, 24
+    while s != lasts:
+        lasts = s
+        n, na = n + na, na + 8
+        d, da = d + da, da + 32
+        t = (t * n) / d
+        s += t
+    getcontext().prec -= 2
+    return +s
+
+PI = _pi()
+
+def _sin_cos(x):
+    """sin(x), cos(x) by Taylor series, |x| <= pi"""
+    sin, cos = Decimal(0), Decimal(0)
+    term, n = Decimal(1), 0
+    while True:
+        if n % 4 == 0:
+            cos += term
+        elif n % 4 == 1:
+            sin += term
+        elif n % 4 == 2:
+            cos -= term
+        else:
+            sin -= term
+        n += 1
+        term = term * x / n
+        if abs(term) < Decimal('1e-70'):
+            return sin, cos
+
+def _exact_butter_sos(order, cutoff_ratio):
+    """
+    scipy.signal.butter(order, cutoff_ratio * 2, output='sos'), each step
+    as scipy does it, in decimal: buttap() poles -exp(j pi m / (2 order)),
+    m = -order+1, -order+3, ..., order-1; lp2lp_zpk() and bilinear_zpk()
+    at fs = 2 with the cutoff prewarped (z = (1 + t p) / (1 - t p), t =
+    tan(pi cutoff / fs), zeros all at -1, gain t^order / prod(1 - t p));
+    zpk2sos() with pairing='nearest' (a zero and a pole at 0 added for odd
+    orders, sections filled from the last one with the pole nearest the
+    unit circle, gain on the first section)
+    """
+    s, c = _sin_cos(PI * Decimal(cutoff_ratio))
+    t = s / c
+    poles = []
+    for m in range(-order + 1, order, 2):
+        ps, pc = _sin_cos(PI * m / (2 * order))
+        # -exp(j theta), times t
+        pr, pi_ = -pc * t, -ps * t
+        # (1 + p) / (1 - p)
+        nr, ni = 1 + pr, pi_
+        dr, di = 1 - pr, -pi_
+        den = dr * dr + di * di
+        poles.append(((nr * dr + ni * di) / den, (ni * dr - nr * di) / den))
+    # prod(1 - t p) over the analog poles, real since they come in
+    # conjugate pairs (and the real one)
+    gr, gi = Decimal(1), Decimal(0)
+    for m in range(-order + 1, order, 2):
+        ps, pc = _sin_cos(PI * m / (2 * order))
+        ar, ai = 1 + pc * t, ps * t  # 1 - t * (-exp(j theta))
+        gr, gi = gr * ar - gi * ai, gr * ai + gi * ar
+    gain = t ** order / gr
+
+    # zpk2sos, pairing='nearest'
+    zeros = [(Decimal(-1), Decimal(0))] * order
+    if order % 2:
+        poles.append((Decimal(0), Decimal(0)))
+        zeros.append((Decimal(0), Decimal(0)))
+    n_sections = len(poles) // 2
+    sos = [None] * n_sections
+    distance = lambda p: abs(1 - (p[0] * p[0] + p[1] * p[1]).sqrt())
+    for si in range(n_sections - 1, -1, -1):
+        p1 = min(poles, key=distance)
+        poles.remove(p1)
+        if p1[1] == 0:
+            # Real: with the remaining real pole nearest the unit circle
+            reals = [p for p in poles if p[1] == 0]
+            p2 = min(reals, key=lambda p: abs((p[0] * p[0]).sqrt() - 1))
+        else:
+            p2 = (p1[0], -p1[1])
+        poles.remove(p2)
+        # Zeros: the real ones nearest p1 (-1 always, then 0 for odd orders)
+        reals = sorted(zeros, key=lambda z: (z[0] - p1[0]) ** 2 + p1[1] ** 2)
+        z1 = reals[0]
+        zeros.remove(z1)
+        rest = sorted(zeros, key=lambda z: (z[0] - p1[0]) ** 2 + p1[1] ** 2)
+        z2 = rest[0]
+        zeros.remove(z2)
+        b = [Decimal(1), -(z1[0] + z2[0]), z1[0] * z2[0]]
+        a = [Decimal(1), -(p1[0] + p2[0]), p1[0] * p2[0] - p1[1] * p2[1]]
+        sos[si] = b + a
+    for i in range(3):
+        sos[0][i] *= gain
+    return sos
+
+def _exact_sosfiltfilt(sos, x):
+    """scipy.signal.sosfiltfilt(sos, x) in decimal, sos and x Decimals"""
+    n_sections = len(sos)
+    ntaps = 2 * n_sections + 1
+    ntaps -= min(sum(1 for s in sos if s[2] == 0), sum(1 for s in sos if s[5] == 0))
+    edge = 3 * ntaps
+    assert len(x) > edge
+    # odd_ext
+    ext = [2 * x[0] - v for v in x[edge:0:-1]] + list(x) + [2 * x[-1] - v for v in x[-2:-edge - 2:-1]]
+
+    # sosfilt_zi: each section's steady state for a unit step, scaled by
+    # the DC gain of the sections before it
+    zi = []
+    scale = Decimal(1)
+    for b0, b1, b2, a0, a1, a2 in sos:
+        y = (b0 + b1 + b2) / (a0 + a1 + a2)
+        zi.append((scale * (y - b0), scale * (b2 - a2 * y)))
+        scale *= y
+
+    def sosfilt(data, x0):
+        state = [[z0 * x0, z1 * x0] for z0, z1 in zi]
+        out = []
+        for v in data:
+            for (b0, b1, b2, a0, a1, a2), z in zip(sos, state):
+                y = b0 * v + z[0]
+                z[0] = b1 * v - a1 * y + z[1]
+                z[1] = b2 * v - a2 * y
+                v = y
+            out.append(v)
+        return out
+
+    y = sosfilt(ext, ext[0])
+    y = sosfilt(y[::-1], y[-1])[::-1]
+    return y[edge:len(y) - edge]
+
+# ---- scipy, or the above ----
+
+def _scipy():
+    try:
+        import numpy as np
+        import scipy
+        from scipy import signal
+        return np, scipy, signal
+    except ImportError:
+        return None
+
+def butter_sos(order, cutoff_ratio, lib):
+    if lib:
+        np, scipy, signal = lib
+        return [[float(v) for v in row] for row in signal.butter(order, 2 * cutoff_ratio, output='sos')]
+    return [[float(v) for v in row] for row in _exact_butter_sos(order, cutoff_ratio)]
+
+def sosfiltfilt(sos, channels, lib):
+    if lib:
+        np, scipy, signal = lib
+        return [list(map(float, row)) for row in signal.sosfiltfilt(np.array(sos), np.array(channels), axis=1)]
+    dsos = [[Decimal(v) for v in row] for row in sos]
+    return [[float(v) for v in _exact_sosfiltfilt(dsos, [Decimal(v) for v in x])] for x in channels]
+
+def padlen(sos):
+    ntaps = 2 * len(sos) + 1
+    ntaps -= min(sum(1 for s in sos if s[2] == 0), sum(1 for s in sos if s[5] == 0))
+    return 3 * ntaps
+
+def test_signal(rng, n, channel):
+    """A step, a sine and noise, different on every channel"""
+    out = []
+    for i in range(n):
+        v = 1.5 * math.sin(2 * math.pi * (channel + 1) * i / n) + rng.gauss(0, 0.3)
+        if i > n * (channel + 1) // (FILTFILT_CHANNELS + 2):
+            v += 2.0
+        out.append(v + channel)
+    return out
+
+def fmt(values):
+    return ' '.join(repr(float(v)) for v in values)
+
+def generator_line(lib):
+    if lib:
+        return f"# generator: scipy {lib[1].__version__}\n"
+    return "# generator: scipy's algorithms in 60 digit decimal (gen_reference.py --exact)\n"
+
+def write_butter(lib):
+    """
+    One design per line:
+      butter ORDER CUTOFF FS SECTIONS b0 b1 b2 a0 a1 a2 ...
+    """
+    path = os.path.join(HERE, 'butter.txt')
+    with open(path, 'w') as f:
+        f.write(generator_line(lib))
+        f.write("# butter ORDER CUTOFF FS SECTIONS, then b0 b1 b2 a0 a1 a2 per section\n")
+        for order in BUTTER_ORDERS:
+            for cutoff in BUTTER_CUTOFFS:
+                # The ratio as written, so the decimal path's is exact
+                sos = butter_sos(order, Decimal(repr(cutoff)) / Decimal(repr(BUTTER_FS)) if not lib
+                                 else cutoff / BUTTER_FS, lib)
+                f.write(f"butter {order} {cutoff!r} {BUTTER_FS!r} {len(sos)} ")
+                f.write(fmt(v for row in sos for v in row) + "\n")
+    print(f"Wrote {path}")
+
+def write_sosfiltfilt(lib):
+    """
+    One case per design and length:
+      case ORDER SECTIONS LENGTH CHANNELS
+      sos <6 * SECTIONS values, scipy's layout b0 b1 b2 a0 a1 a2>
+      x <LENGTH values>   \\ CHANNELS times, input then
+      y <LENGTH values>   /  sosfiltfilt output
+    """
+    rng = random.Random(14)
+    path = os.path.join(HERE, 'sosfiltfilt.txt')
+    with open(path, 'w') as f:
+        f.write(generator_line(lib))
+        f.write("# case ORDER SECTIONS LENGTH CHANNELS, sos, then x / y per channel\n")
+        for order, cutoff in FILTFILT_DESIGNS:
+            sos = butter_sos(order, cutoff, lib)
+            pad = padlen(sos)
+            for length in (pad + 1, pad + 2, pad + 9, 3 * pad, 400):
+                channels = [test_signal(rng, length, c) for c in range(FILTFILT_CHANNELS)]
+                outputs = sosfiltfilt(sos, channels, lib)
+                f.write(f"case {order} {len(sos)} {length} {FILTFILT_CHANNELS}\n")
+                f.write("sos " + fmt(v for row in sos for v in row) + "\n")
+                for x, y in zip(channels, outputs):
+                    f.write("x " + fmt(x) + "\n")
+                    f.write("y " + fmt(y) + "\n")
+    print(f"Wrote {path}")
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('--exact', action='store_true', help="don't use scipy even if it's installed")
+    args = parser.parse_args()
+    lib = None if args.exact else _scipy()
+    if lib is None and not args.exact:
+        print("scipy isn't installed, computing the references in decimal arithmetic")
+    write_butter(lib)
+    write_sosfiltfilt(lib)
+
+if __name__ == "__main__":
+    main()
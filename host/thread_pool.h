@@ -0,0 +1,209 @@
+/*
+ * Fixed sets of worker threads running queued tasks, for batch work that
+ * splits into independent pieces. wait() blocks until every task
+ * submitted so far has finished.
+ *
+ *   ThreadPool        one shared queue, tasks taken in submission order
+ *                     (the filter sweep's configurations, all alike)
+ *   WorkStealingPool  queues per worker, for tasks that submit more tasks
+ *                     (daq_batch: a file, then blocks of its rows). Tasks
+ *                     submitted from outside are dealt out to the workers
+ *                     in turn and run in submission order, so work
+ *                     submitted biggest first starts biggest first. A
+ *                     task submitted from a worker goes on that worker's
+ *                     own local queue, which it runs newest first ahead
+ *                     of anything else, so it finishes what it started
+ *                     before taking new work. A worker with nothing left
+ *                     takes from another's queues: the oldest submitted
+ *                     task, else the oldest local one, the biggest piece
+ *                     left there.
+ */
+#ifndef DAQ_THREAD_POOL_H
+#define DAQ_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace daq {
+
+class ThreadPool {
+ public:
+  // threads 0: one per core
+  explicit ThreadPool(int threads = 0) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < threads; i++) workers_.emplace_back([this] { work(); });
+  }
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &t : workers_) t.join();
+  }
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(task));
+      unfinished_++;
+    }
+    wake_.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !unfinished_; });
+  }
+
+  int size() const { return workers_.size(); }
+
+ private:
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) return;  // stopping, and nothing left
+      std::function<void()> task = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+      if (!--unfinished_) idle_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_, idle_;
+  std::deque<std::function<void()>> queue_;
+  size_t unfinished_ = 0;
+  bool stopping_ = false;
+};
+
+class WorkStealingPool {
+ public:
+  // threads 0: one per core
+  explicit WorkStealingPool(int threads = 0) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    queues_ = std::vector<Queue>(threads);
+    // Every queue exists before any worker looks at the others'
+    for (int i = 0; i < threads; i++) workers_.emplace_back([this, i] { work(i); });
+  }
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &t : workers_) t.join();
+  }
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // From one of this pool's tasks: onto the running worker's local queue;
+  // from anywhere else: the workers' submitted queues in turn
+  void submit(std::function<void()> task) {
+    unfinished_++;
+    {
+      // Counted first (so a taker never sees it go below zero) and under
+      // the lock, so a worker about to sleep can't miss it
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_++;
+    }
+    if (current_pool_ == this) {
+      Queue &q = queues_[current_worker_];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.local.push_back(std::move(task));
+    } else {
+      Queue &q = queues_[next_++ % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.submitted.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !unfinished_; });
+  }
+
+  int size() const { return workers_.size(); }
+  // Tasks run by a worker other than the one whose queue they were on
+  uint64_t steals() const { return steals_; }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> local;      // from the worker's own tasks
+    std::deque<std::function<void()>> submitted;  // from outside the pool
+  };
+
+  // Own queue: the newest local task, else the oldest submitted one.
+  // Another's: the oldest submitted, else the oldest local.
+  bool take(size_t self, std::function<void()> *task) {
+    for (size_t k = 0; k < queues_.size(); k++) {
+      Queue &q = queues_[(self + k) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!k && !q.local.empty()) {
+        *task = std::move(q.local.back());
+        q.local.pop_back();
+      } else if (!q.submitted.empty()) {
+        *task = std::move(q.submitted.front());
+        q.submitted.pop_front();
+      } else if (!q.local.empty()) {
+        *task = std::move(q.local.front());
+        q.local.pop_front();
+      } else {
+        continue;
+      }
+      if (k) steals_++;
+      queued_--;
+      return true;
+    }
+    return false;
+  }
+
+  void work(size_t self) {
+    current_pool_ = this;
+    current_worker_ = self;
+    std::function<void()> task;
+    for (;;) {
+      if (take(self, &task)) {
+        task();
+        task = nullptr;
+        if (!--unfinished_) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          idle_.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_; });
+      if (stopping_ && !queued_) return;
+    }
+  }
+
+  static inline thread_local WorkStealingPool *current_pool_ = nullptr;
+  static inline thread_local size_t current_worker_ = 0;
+
+  std::vector<std::thread> workers_;
+  std::vector<Queue> queues_;
+  std::mutex mutex_;  // sleeping and waking, wait()
+  std::condition_variable wake_, idle_;
+  std::atomic<size_t> queued_{0}, unfinished_{0}, next_{0};
+  std::atomic<uint64_t> steals_{0};
+  bool stopping_ = false;
+};
+
+}  // namespace daq
+
+#endif  // DAQ_THREAD_POOL_H
@@ -85,11 +85,18 @@ def filter_and_save_data(filename, cutoff_freq=2.0, filter_order=4):
         df = df.dropna()
         
         # Calculate the sampling frequency from the time data
-        # Use the median time difference to handle potential irregularities
-        time_diffs = np.diff(df['Time(ms)'])
-        median_time_diff = np.median(time_diffs)  # in milliseconds
-        fs = 1000.0 / median_time_diff  # Convert to Hz
-        print(f"Estimated sampling frequency: {fs:.1f} Hz")
+        if 'Time(us)' in df.columns:
+            # Timestamps come from the Arduino's hardware sample clock, so the
+            # smallest step is exactly one sample period (bigger steps are drops)
+            fs = 1e6 / np.min(np.diff(df['Time(us)']))
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+            print(f"Sampling frequency: {fs:.1f} Hz")
+        else:
+            # Use the median time difference to handle potential irregularities
+            time_diffs = np.diff(df['Time(ms)'])
+            median_time_diff = np.median(time_diffs)  # in milliseconds
+            fs = 1000.0 / median_time_diff  # Convert to Hz
+            print(f"Estimated sampling frequency: {fs:.1f} Hz")
         
         # Filter each analog channel
         analog_channels = ['A0(V)', 'A1(V)', 'A2(V)', 'A3(V)']
@@ -137,6 +144,10 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
         # Drop rows with NaN values
         df = df.dropna()
         
+        # Newer firmware timestamps in microseconds, plot in ms
+        if 'Time(us)' in df.columns:
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+        
         # Check for filtered columns
         has_filtered = any('_filtered' in col for col in df.columns)
         
@@ -30,6 +30,10 @@ def plot_data(filename):
         # Drop rows with NaN values
         df = df.dropna()
         
+        # Newer firmware timestamps in microseconds, plot in ms
+        if 'Time(us)' in df.columns:
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+        
         # Create the plot
         plt.figure(figsize=(12, 8))
         
@@ -178,44 +182,62 @@ def main():
             if choice.lower() != 'y':
                 break
             
+            # Streaming runs until Ctrl+C instead of for the Arduino's recording time
+            streaming = input("Stream until Ctrl+C? (y/n): ").lower() == 'y'
+            
             # Create a filename for this recording session
             filename = f"arduino_daq_data_{time.strftime('%Y%m%d_%H%M%S')}.csv"
             
             with open(filename, 'w', newline='') as file:
                 # Send start command
-                ser.write(b"START\n")
+                ser.write(b"STREAM\n" if streaming else b"START\n")
                 
                 print(f"Recording data to {filename}...")
+                if streaming:
+                    print("Press Ctrl+C to stop")
                 recording = True
+                stop_sent = False
                 data_lines = 0
                 
                 # Start time for timeout
                 start_time = time.time()
-                timeout_duration = 15  # seconds
+                timeout_duration = float('inf') if streaming else 15  # seconds
                 
                 while recording and (time.time() - start_time) < timeout_duration:
-                    if ser.in_waiting:
-                        line = ser.readline().decode('utf-8', errors='ignore').strip()
-                        
-                        if "RECORDING_COMPLETE" in line:
-                            recording = False
-                            print("Recording complete!")
-                        elif "SAMPLES_COLLECTED" in line:
-                            try:
-                                samples = int(line.split(":")[1])
-                                print(f"Collected {samples} samples")
-                            except:
-                                print(f"Received sample info: {line}")
-                        elif "END_OF_DATA" in line:
-                            print("End of data received")
-                        elif line:
-                            # Write the line to the file
-                            file.write(line + '\n')
-                            data_lines += 1
+                    try:
+                        if ser.in_waiting:
+                            line = ser.readline().decode('utf-8', errors='ignore').strip()
                             
-                            # Show progress periodically
-                            if data_lines % 100 == 0:
-                                print(f"Received {data_lines} data points...", end='\r')
+                            if "RECORDING_COMPLETE" in line:
+                                recording = False
+                                print("Recording complete!")
+                            elif "SAMPLES_COLLECTED" in line:
+                                try:
+                                    samples = int(line.split(":")[1])
+                                    print(f"Collected {samples} samples")
+                                except:
+                                    print(f"Received sample info: {line}")
+                            elif "SAMPLES_DROPPED" in line or line.startswith("SEQ:"):
+                                print(f"\n{line}")
+                            elif "END_OF_DATA" in line:
+                                print("End of data received")
+                            elif line:
+                                # Write the line to the file
+                                file.write(line + '\n')
+                                data_lines += 1
+                                
+                                # Show progress periodically
+                                if data_lines % 100 == 0:
+                                    print(f"Received {data_lines} data points...", end='\r')
+                    except KeyboardInterrupt:
+                        if not streaming or stop_sent:
+                            raise
+                        # Stop the Arduino and read what it still has buffered
+                        ser.write(b"STOP\n")
+                        stop_sent = True
+                        print("\nStopping...")
+                        start_time = time.time()
+                        timeout_duration = 5
                 
                 print(f"\nSaved {data_lines} data points to {filename}")
             
@@ -7,12 +7,31 @@ import matplotlib.pyplot as plt
 import pandas as pd
 import os
 import re
+import struct
 import numpy as np
 from scipy import signal
+import daq_host
 
 # the arduino code decides recording length, this is just a timeout which
-# must be greater than the time in arduino code
-recordingLength = 10 # seconds # Must change both here and in arduino_code.cpp
+# must be greater than the time in arduino code. Only used if the Arduino
+# doesn't answer CONFIG, otherwise the timeout follows the configured duration
+recordingLength = 10 # seconds
+
+# Resolution of the saved plots
+PLOT_DPI = 300
+
+# Binary frame layout sent by arduino_code.cpp after START_BIN (little-endian):
+# sync 0xA5 0x5A+b, uint16 sample index, uint32 time (us), the (10+b)-bit
+# codes of the scanned inputs packed LSB first (5 bytes for 4 inputs at b=0),
+# uint8 XOR of everything after the sync word. b is the OVERSAMPLE setting
+# (0-3). The text header before the frames names the scanned inputs, so
+# together with b it gives the frame size.
+FRAME_SYNC = b'\xa5\x5a'
+MAX_OVERSAMPLE = 3
+
+def binary_frame_size(channels, oversample=0):
+    """Size in bytes of a binary frame carrying the given number of inputs"""
+    return 9 + ((10 + oversample) * channels + 7) // 8
 
 def list_available_ports():
     """Lists all available serial ports based on the operating system"""
@@ -38,7 +57,7 @@ def apply_lowpass_filter(data, cutoff_freq, fs, order=4):
     Apply a low-pass Butterworth filter to the data
     
     Parameters:
-    data (numpy.ndarray): The data to filter
+    data (numpy.ndarray): The data to filter, one channel or one column per channel
     cutoff_freq (float): The cutoff frequency in Hz
     fs (float): The sampling frequency in Hz
     order (int): The filter order (4 pole = 24dB/octave, 6 pole = 36dB/octave)
@@ -49,15 +68,55 @@ def apply_lowpass_filter(data, cutoff_freq, fs, order=4):
     nyquist = 0.5 * fs
     normal_cutoff = cutoff_freq / nyquist
     
-    # Design the Butterworth filter
-    b, a = signal.butter(order, normal_cutoff, btype='low', analog=False)
+    # Design the Butterworth filter, as second order sections (the single
+    # b, a polynomial loses precision at low cutoffs)
+    sos = signal.butter(order, normal_cutoff, btype='low', analog=False, output='sos')
+    
+    # Apply the filter forwards and backwards for zero-phase filtering (no
+    # time delay). The native version does all the channels in one pass.
+    if daq_host.available():
+        return daq_host.sosfiltfilt(sos, data)
+    return signal.sosfiltfilt(sos, data, axis=0)
+
+def load_capture(filename):
+    """
+    Load a capture (a CSV as saved by the receivers, cleaned or not, or a
+    .daqc from daq_capture) into a DataFrame
+    
+    Parameters:
+    filename (str): The CSV or .daqc file containing the data
+    
+    Returns:
+    pandas.DataFrame: The valid data rows
+    """
+    if filename.endswith('.daqc'):
+        return daq_host.read_daqc(filename)
+    
+    # The native parser (make -C host) does the cleaning and the numeric
+    # conversion in one pass, much faster on long recordings
+    if daq_host.available():
+        df, rejected = daq_host.read_csv(filename)
+        if rejected:
+            print(f"Skipped {rejected} invalid lines")
+        return df
+    
+    # Read the CSV data
+    try:
+        # Try standard header names
+        df = pd.read_csv(filename)
+    except:
+        # Try with manual column specification
+        df = pd.read_csv(filename, names=['Sample', 'Time(ms)', 'A0(V)', 'A1(V)', 'A2(V)', 'A3(V)'])
     
-    # Apply the filter using filtfilt for zero-phase filtering (no time delay)
-    filtered_data = signal.filtfilt(b, a, data)
+    # Clean the dataframe - remove rows with invalid data
+    # Convert all columns to numeric, errors become NaN
+    for col in df.columns:
+        df[col] = pd.to_numeric(df[col], errors='coerce')
     
-    return filtered_data
+    # Drop rows with NaN values
+    return df.dropna()
 
-def filter_and_save_data(filename, cutoff_freq=2.0, filter_order=4):
+def filter_and_save_data(filename, cutoff_freq=2.0, filter_order=4, period_us=None):
     """
     Load data from CSV, apply a low-pass filter, and save the filtered data
     
@@ -65,6 +124,8 @@ def filter_and_save_data(filename, cutoff_freq=2.0, filter_order=4):
     filename (str): The CSV file containing the data
     cutoff_freq (float): The cutoff frequency in Hz
     filter_order (int): The filter order (4=24dB/octave, 5=30dB/octave, 6=36dB/octave)
+    period_us (int): The sample period the Arduino confirmed with CONFIG, if
+                     known; otherwise it's measured from the timestamps
     
     Returns:
     str: The filename of the filtered data
@@ -72,36 +133,55 @@ def filter_and_save_data(filename, cutoff_freq=2.0, filter_order=4):
     try:
         print(f"Filtering data from {filename}...")
         
-        # Read the CSV data
-        try:
-            # Try standard header names
-            df = pd.read_csv(filename)
-        except:
-            # Try with manual column specification
-            df = pd.read_csv(filename, names=['Sample', 'Time(ms)', 'A0(V)', 'A1(V)', 'A2(V)', 'A3(V)'])
-        
-        # Clean the dataframe - remove rows with invalid data
-        # Convert all columns to numeric, errors become NaN
-        for col in df.columns:
-            df[col] = pd.to_numeric(df[col], errors='coerce')
-        
-        # Drop rows with NaN values
-        df = df.dropna()
+        df = load_capture(filename)
         
         # Calculate the sampling frequency from the time data
-        # Use the median time difference to handle potential irregularities
-        time_diffs = np.diff(df['Time(ms)'])
-        median_time_diff = np.median(time_diffs)  # in milliseconds
-        fs = 1000.0 / median_time_diff  # Convert to Hz
-        print(f"Estimated sampling frequency: {fs:.1f} Hz")
+        period_us = period_us or df.attrs.get('period_us')
+        if 'Time(us)' in df.columns and period_us:
+            # What the Arduino's sample clock was set to
+            fs = 1e6 / period_us
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+            print(f"Sampling frequency: {fs:.1f} Hz (configured)")
+        elif 'Time(us)' in df.columns:
+            # Timestamps come from the Arduino's hardware sample clock, so most
+            # steps are exactly one sample period; the median of the positive
+            # ones ignores drops, and duplicated or garbled rows, which the
+            # smallest step wouldn't
+            time_diffs = np.diff(df['Time(us)'])
+            fs = 1e6 / np.median(time_diffs[time_diffs > 0])
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+            print(f"Sampling frequency: {fs:.1f} Hz")
+        elif daq_host.available():
+            # Jittered loop() timestamps: the average rate over the recording,
+            # the data is resampled onto it below
+            time_ms = df['Time(ms)'].values
+            fs = 1000.0 * (len(time_ms) - 1) / (time_ms[-1] - time_ms[0])
+            print(f"Average sampling frequency: {fs:.1f} Hz")
+        else:
+            # Use the median time difference to handle potential irregularities
+            time_diffs = np.diff(df['Time(ms)'])
+            median_time_diff = np.median(time_diffs)  # in milliseconds
+            fs = 1000.0 / median_time_diff  # Convert to Hz
+            print(f"Estimated sampling frequency: {fs:.1f} Hz")
         
         # Filter each analog channel
-        analog_channels = ['A0(V)', 'A1(V)', 'A2(V)', 'A3(V)']
-        for channel in analog_channels:
-            if channel in df.columns:
-                df[f"{channel}_filtered"] = apply_lowpass_filter(
-                    df[channel].values, cutoff_freq, fs, order=filter_order
-                )   
+        analog_channels = [c for c in ['A0(V)', 'A1(V)', 'A2(V)', 'A3(V)'] if c in df.columns]
+        if analog_channels and daq_host.available():
+            # The filter only has the response it was designed for on a uniform
+            # grid: resample onto an exact one (bridging jitter and dropped
+            # samples), filter there, and read the result back at the rows' times
+            time_s = df['Time(ms)'].values / 1000.0
+            grid, uniform = daq_host.resample(time_s, df[analog_channels].values, 1.0 / fs)
+            smooth = apply_lowpass_filter(uniform, cutoff_freq, fs, order=filter_order)
+            filtered = np.column_stack([np.interp(time_s, grid, smooth[:, i])
+                                        for i in range(len(analog_channels))])
+        elif analog_channels:
+            filtered = apply_lowpass_filter(
+                df[analog_channels].values, cutoff_freq, fs, order=filter_order
+            )
+        if analog_channels:
+            for i, channel in enumerate(analog_channels):
+                df[f"{channel}_filtered"] = filtered[:, i]
         
         # Save the filtered data to a new CSV file
         filtered_filename = f"{os.path.splitext(filename)[0]}_filtered.csv"
@@ -141,11 +221,25 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
         # Drop rows with NaN values
         df = df.dropna()
         
+        # Newer firmware timestamps in microseconds, plot in ms
+        if 'Time(us)' in df.columns:
+            df['Time(ms)'] = df['Time(us)'] / 1000.0
+        
         # Check for filtered columns
         has_filtered = any('_filtered' in col for col in df.columns)
         
         # Identify all analog channels
         analog_channels = [col for col in df.columns if col.startswith('A') and col.endswith('(V)') and not '_filtered' in col]
+        if not analog_channels:
+            # Recorded with OUTPUT=1, only the Arduino's filtered columns
+            analog_channels = [col for col in df.columns if col.endswith('(V)_iir')]
+        
+        # With the native library every line is drawn from a min/max
+        # pyramid, a few points per pixel however long the capture
+        lod = None
+        if daq_host.available():
+            plotted = [col for col in df.columns if col.startswith('A') and '(V)' in col]
+            lod = daq_host.MinMaxPyramid(df['Time(ms)'].to_numpy(), {col: df[col].to_numpy() for col in plotted})
         
         # Create color cycle for different channels
         colors = ['orange', 'yellow', 'blue', 'purple', 'pink', 'pink', 'pink', 'pink']
@@ -158,7 +252,7 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
             if show_original:
                 for i, channel in enumerate(analog_channels):
                     color = colors[i % len(colors)]
-                    plt.plot(df['Time(ms)'], df[channel], label=f'{channel} Original', 
+                    plot_series(df, channel, lod, label=f'{channel} Original', 
                             linewidth=1.5, alpha=0.4, color=color, linestyle='-')
             
             # Plot filtered data
@@ -167,9 +261,17 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
                     filtered_channel = f"{channel}_filtered"
                     if filtered_channel in df.columns:
                         color = colors[i % len(colors)]
-                        plt.plot(df['Time(ms)'], df[filtered_channel], label=f'{channel} Filtered', 
+                        plot_series(df, filtered_channel, lod, label=f'{channel} Filtered', 
                                 linewidth=2.5, color=color, linestyle='-')
             
+            # Plot the Arduino's live (causal) filter output
+            if show_filtered:
+                for i, channel in enumerate(analog_channels):
+                    if f"{channel}_iir" in df.columns:
+                        color = colors[i % len(colors)]
+                        plot_series(df, f"{channel}_iir", lod, label=f'{channel} Arduino IIR', 
+                                linewidth=1.5, color=color, linestyle='--')
+            
             # Set the y-axis range from 0 to 5V
             plt.ylim(0, 5)
             
@@ -190,15 +292,20 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
                 
                 # Plot original data if requested
                 if show_original:
-                    plt.plot(df['Time(ms)'], df[channel], label=f'{channel} Original', 
+                    plot_series(df, channel, lod, label=f'{channel} Original', 
                             linewidth=1, alpha=0.7, color='lightgray')
                 
                 # Plot filtered data if available and requested
                 filtered_channel = f"{channel}_filtered"
                 if has_filtered and filtered_channel in df.columns and show_filtered:
-                    plt.plot(df['Time(ms)'], df[filtered_channel], label=f'{channel} Filtered', 
+                    plot_series(df, filtered_channel, lod, label=f'{channel} Filtered', 
                             linewidth=2, color='blue')
                 
+                # Plot the Arduino's live (causal) filter output
+                if f"{channel}_iir" in df.columns and show_filtered:
+                    plot_series(df, f"{channel}_iir", lod, label=f'{channel} Arduino IIR', 
+                            linewidth=1.5, color='red', linestyle='--')
+                
                 # Set the y-axis range from 0 to 5V
                 plt.ylim(0, 5)
                 
@@ -239,7 +346,7 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
         # Save the plot
         plot_suffix = "_overlapped" if overlapping_plots else "_subplots"
         plot_filename = f"{os.path.splitext(filename)[0]}{plot_suffix}_plot.png"
-        plt.savefig(plot_filename, dpi=300, bbox_inches='tight')
+        plt.savefig(plot_filename, dpi=PLOT_DPI, bbox_inches='tight')
         print(f"Plot saved as {plot_filename}")
         
         # Show the plot
@@ -249,6 +356,32 @@ def plot_data(filename, show_original=True, show_filtered=True, overlapping_plot
     except Exception as e:
         print(f"Error plotting data: {e}")
 
+def plot_series(df, column, lod, **style):
+    """
+    plt.plot() of a column against Time(ms), through the min/max pyramid if
+    there is one: drawn at the saved figure's resolution, and redrawn from
+    the pyramid for the visible window when zooming in plt.show()
+    
+    Parameters:
+    df (pandas.DataFrame): The data, with a Time(ms) column
+    column (str): The column to plot
+    lod (daq_host.MinMaxPyramid): The pyramid, or None to plot every sample
+    style: Passed on to plt.plot()
+    """
+    if lod is None or column not in lod:
+        return plt.plot(df['Time(ms)'], df[column], **style)
+    
+    ax = plt.gca()
+    
+    def points(t0, t1):
+        # Pixels across the axes in the saved PNG, at least as many as on screen
+        width = ax.bbox.width * PLOT_DPI / ax.figure.dpi
+        return lod.polyline(column, t0, t1, width)
+    
+    line, = ax.plot(*points(df['Time(ms)'].iloc[0], df['Time(ms)'].iloc[-1]), **style)
+    ax.callbacks.connect('xlim_changed', lambda ax: line.set_data(*points(*ax.get_xlim())))
+    return [line]
+
 def clean_data_file(filename):
     """Cleans a CSV data file by removing invalid lines"""
     try:
@@ -262,20 +395,24 @@ def clean_data_file(filename):
         header_found = False
         
         # Regular expression to match valid data lines
-        # Format: number,number,number,number,number,number
-        data_pattern = re.compile(r'^\d+,\d+,\d+\.\d+,\d+\.\d+,\d+\.\d+,\d+\.\d+$')
+        # Format: number,number,number(,number...) - the Arduino only sends
+        # the channels selected with CONFIG, so the header sets the width
+        data_pattern = re.compile(r'^\d+,\d+(,\d+\.\d+)+$')
+        field_count = 6
         
         for line in lines:
             line = line.strip()
             
             # Keep the header line
             if "Sample,Time" in line:
-                cleaned_lines.append(line + '\n')
+                if not header_found:
+                    cleaned_lines.append(line + '\n')
+                    field_count = line.count(',') + 1
                 header_found = True
                 continue
             
             # Check if it's a valid data line
-            if data_pattern.match(line) or (line.count(',') == 5 and line[0].isdigit()):
+            if line.count(',') == field_count - 1 and (data_pattern.match(line) or line[:1].isdigit()):
                 cleaned_lines.append(line + '\n')
         
         # If no header was found, add one
@@ -294,6 +431,256 @@ def clean_data_file(filename):
         print(f"Error cleaning data file: {e}")
         return filename
 
+def decode_binary_stream(buffer, state):
+    """
+    Decode the binary frames and text control lines waiting in buffer
+    
+    Frames are turned into the same CSV rows the text mode sends, so the rest
+    of the pipeline (clean_data_file, filter_and_save_data) doesn't change.
+    
+    Parameters:
+    buffer (bytearray): Received bytes, decoded bytes are removed in place
+    state (dict): Decoder state kept between calls, start with {}
+    
+    Returns:
+    list: Decoded lines (CSV rows and control lines) in arrival order
+    """
+    lines = []
+    pos = 0
+    channels = state.get('channels', 4)
+    
+    while pos < len(buffer):
+        if pos + 1 == len(buffer) and buffer[pos] == FRAME_SYNC[0]:
+            break  # maybe the start of a frame, wait for the next byte
+        oversample = buffer[pos + 1] - FRAME_SYNC[1] if pos + 1 < len(buffer) else -1
+        if buffer[pos] == FRAME_SYNC[0] and 0 <= oversample <= MAX_OVERSAMPLE:
+            code_bits = 10 + oversample
+            frame_size = binary_frame_size(channels, oversample)
+            if len(buffer) - pos < frame_size:
+                break  # wait for the rest of the frame
+            
+            frame = buffer[pos:pos + frame_size]
+            check = 0
+            for byte in frame[2:frame_size - 1]:
+                check ^= byte
+            
+            index, elapsed = struct.unpack_from('<HI', frame, 2)
+            
+            sample = frame_sample(index, elapsed, state) if check == frame[frame_size - 1] else None
+            
+            if sample is not None:
+                # Same digits as the text mode: 3 decimals, 4 when oversampled
+                packed = int.from_bytes(frame[8:frame_size - 1], 'little')
+                mask = (1 << code_bits) - 1
+                scale = 5.0 / (1023 << oversample)
+                decimals = 4 if oversample else 3
+                voltages = [((packed >> (code_bits * i)) & mask) * scale for i in range(channels)]
+                lines.append(f"{sample},{elapsed}," + ",".join(f"{v:.{decimals}f}" for v in voltages))
+                pos += frame_size
+                continue
+        
+        # Not a valid frame, try a text line (header or control message)
+        if 32 <= buffer[pos] < 127:
+            end = buffer.find(b'\n', pos)
+            if end == -1:
+                if len(buffer) - pos < 64:
+                    break  # wait for the rest of the line
+            else:
+                text = bytes(buffer[pos:end]).rstrip(b'\r')
+                if all(32 <= byte < 127 for byte in text):
+                    line = text.decode('ascii')
+                    lines.append(line)
+                    pos = end + 1
+                    
+                    # The header tells us how many inputs each frame carries
+                    if line.startswith("Sample,Time"):
+                        channels = line.count('(V)')
+                        state['channels'] = channels
+                        for key in ('frame', 'period', 'period_guess', 'rejected_run'):
+                            state.pop(key, None)
+                    continue
+        
+        # Garbage byte, skip it and resync
+        pos += 1
+    
+    del buffer[:pos]
+    return lines
+
+def frame_sample(index, elapsed, state):
+    """
+    The running sample number of a binary frame whose checksum passed, or
+    None if it doesn't belong to the recording
+    
+    The XOR checksum lets 1 in 256 corrupted frames through, and the 16-bit
+    index alone can't tell a corrupted one from a wrap (65535 -> 0) or a
+    gap, in either direction. But the Arduino stamps sample n at n periods
+    on its sample clock, so once the period is known a genuine frame's time
+    step is a whole number of periods, and that number (which is also how
+    far the index moved, wraps included) matches the index step modulo
+    65536. A frame that doesn't is dropped without moving anything, so the
+    next genuine one is measured from the last good frame again. Until two
+    one-sample steps agree on the period a small step back is dropped and
+    anything else taken; after 16 drops in a row the period is relearned
+    rather than losing the rest of the stream. Same rules as
+    StreamDecoder::frame_step() in host/capture.cpp.
+    
+    Parameters:
+    index (int): The frame's 16-bit sample index
+    elapsed (int): The frame's 32-bit Time(us)
+    state (dict): Decoder state kept between calls
+    
+    Returns:
+    int or None: The sample number
+    """
+    last = state.get('frame')
+    if last is None:
+        sample = index
+    else:
+        last_index, last_time, last_sample = last
+        steps = (index - last_index) & 0xFFFF
+        dt = (elapsed - last_time) & 0xFFFFFFFF
+        period = state.get('period')
+        if period:
+            advance = dt // period
+            ok = dt > 0 and dt % period == 0 and advance & 0xFFFF == steps
+        else:
+            advance = steps
+            ok = not (index < last_index and last_index - index <= 0x8000)
+        if not ok:
+            state['rejected_run'] = state.get('rejected_run', 0) + 1
+            if state['rejected_run'] < 16:
+                return None
+            state.pop('period', None)
+            state.pop('period_guess', None)
+            advance = steps
+        if not state.get('period') and steps == 1 and dt:
+            if dt == state.get('period_guess'):
+                state['period'] = dt
+            state['period_guess'] = dt
+        sample = last_sample + advance
+    state['rejected_run'] = 0
+    state['frame'] = (index, elapsed, sample)
+    return sample
+
+def unwrap_time(line, state):
+    """
+    Unwrap the Time(us) field of a CSV row into a running count
+    
+    The Arduino's microsecond clock is 32 bits and wraps after ~71.6 minutes,
+    which only matters for long streams. A big step backwards is a wrap, a
+    small one is a corrupted row and is left alone.
+    
+    Parameters:
+    line (str): A CSV data row
+    state (dict): Unwrap state kept between calls, start with {}
+    
+    Returns:
+    str: The row with the time unwrapped
+    """
+    fields = line.split(',', 2)
+    if len(fields) < 3 or not fields[1].isdigit():
+        return line
+    
+    elapsed = int(fields[1])
+    last_time = state.get('last_time')
+    if last_time is not None and elapsed < last_time - 2**31:
+        state['wraps'] = state.get('wraps', 0) + 1
+    state['last_time'] = elapsed
+    
+    if not state.get('wraps'):
+        return line
+    return f"{fields[0]},{elapsed + state['wraps'] * 2**32},{fields[2]}"
+
+def configure_arduino(ser, period_us=None, duration_ms=None, channels=None, oversample=None, output=None):
+    """
+    Send the sampling settings to the Arduino with the CONFIG command
+    
+    Parameters:
+    ser (serial.Serial): Open connection to the Arduino
+    period_us (int): Sample period in microseconds, None keeps the current one
+    duration_ms (int): Recording duration in milliseconds, None keeps the current one
+    channels (int): Bit mask of inputs to scan (bit 0 = A0), None keeps the current one
+    oversample (int): Extra bits from averaging 4^n conversions (0-3), None keeps the current one
+    output (int): 0 = raw, 1 = the Arduino's filter output, 2 = both, None keeps the current one
+    
+    Returns:
+    dict: The effective settings the Arduino replied with ('PERIOD_US',
+          'DURATION_MS', 'CHANNELS', 'OVERSAMPLE', 'OUTPUT'), or None if it
+          refused or didn't answer
+    """
+    command = "CONFIG"
+    if period_us is not None:
+        command += f" PERIOD_US={int(period_us)}"
+    if duration_ms is not None:
+        command += f" DURATION_MS={int(duration_ms)}"
+    if channels is not None:
+        command += f" CHANNELS={int(channels)}"
+    if oversample is not None:
+        command += f" OVERSAMPLE={int(oversample)}"
+    if output is not None:
+        command += f" OUTPUT={int(output)}"
+    ser.write((command + "\n").encode())
+    
+    timeout = time.time() + 3
+    while time.time() < timeout:
+        line = ser.readline().decode('utf-8', errors='ignore').strip()
+        if line.startswith("CONFIG:"):
+            settings = {}
+            for item in line[len("CONFIG:"):].split(','):
+                key, value = item.split('=')
+                settings[key] = int(value)
+            return settings
+        elif line.startswith("CONFIG_ERROR"):
+            print(f"Arduino rejected settings: {line}")
+            return None
+    
+    print("Arduino did not answer CONFIG (older firmware?)")
+    return None
+
+def upload_filter(ser, cutoff_freq, fs, filter_order=4):
+    """
+    Load a Butterworth low-pass into the Arduino's live filter (SOS command)
+    
+    The Arduino runs it as second order sections with Q28 coefficients. Each
+    section is scaled to unity DC gain, otherwise the tiny overall gain of a
+    low cutoff would be lost to rounding in the first section.
+    
+    Parameters:
+    ser (serial.Serial): Open connection to the Arduino
+    cutoff_freq (float): The cutoff frequency in Hz
+    fs (float): The Arduino's sampling frequency in Hz
+    filter_order (int): The filter order, at most 6
+    
+    Returns:
+    bool: True if the Arduino accepted every section
+    """
+    sos = signal.butter(filter_order, cutoff_freq / (0.5 * fs), btype='low', output='sos')
+    if len(sos) > 3:
+        print("The Arduino filter holds at most 3 sections (6th order)")
+        return False
+    
+    for k, section in enumerate(sos):
+        b, a = section[:3], section[3:]
+        b = b * (np.sum(a) / np.sum(b))
+        values = [int(round(v * 2**28)) for v in (b[0], b[1], b[2], a[1], a[2])]
+        # b1 takes up the rounding so b0 + b1 + b2 = 1 + a1 + a2 exactly,
+        # keeping the DC gain at 1 (same as the compiled in table)
+        values[1] = 2**28 + values[3] + values[4] - values[0] - values[2]
+        ser.write(f"SOS {k} {' '.join(str(v) for v in values)}\n".encode())
+        
+        reply = None
+        timeout = time.time() + 3
+        while reply is None and time.time() < timeout:
+            line = ser.readline().decode('utf-8', errors='ignore').strip()
+            if line.startswith("SOS"):
+                reply = line
+        if reply is None or reply.startswith("SOS_ERROR"):
+            print(f"Arduino rejected filter section {k}: {reply}")
+            return False
+    
+    print(f"Arduino filter: {filter_order}th order low-pass at {cutoff_freq} Hz ({fs:.1f} Hz sampling)")
+    return True
+
 def main():
     # List available ports
     available_ports = list_available_ports()
@@ -340,60 +727,151 @@ def main():
         if not ready:
             print("Arduino did not respond with ready signal, continuing anyway...")
         
+        # Sampling settings, the Arduino replies with what it will actually use
+        print("\nSampling settings (press Enter to keep the Arduino's current value):")
+        period_us = input("Sample period in us (2000 = 500 Hz): ")
+        duration_ms = input("Recording duration in ms: ")
+        channels = input("Channels to record as a bit mask (15 = A0-A3, 5 = A0+A2): ")
+        oversample = input("Oversampling bits, averages 4^n conversions per sample (0-3): ")
+        output = input("Arduino output (0 = raw, 1 = live filtered, 2 = both): ")
+        
+        config = configure_arduino(ser,
+                                   period_us=int(period_us) if period_us else None,
+                                   duration_ms=int(duration_ms) if duration_ms else None,
+                                   channels=int(channels, 0) if channels else None,
+                                   oversample=int(oversample) if oversample else None,
+                                   output=int(output) if output else None)
+        if config:
+            print(f"Sample rate: {1e6 / config['PERIOD_US']:.1f} Hz, "
+                  f"duration: {config['DURATION_MS']} ms, channels: {config['CHANNELS']:#x}, "
+                  f"resolution: {10 + config.get('OVERSAMPLE', 0)} bits")
+            
+            # The live filter uses the same cutoff and order as the filtfilt
+            # applied after the recording
+            if config.get('OUTPUT'):
+                upload_filter(ser, cutoff_freq, 1e6 / config['PERIOD_US'], filter_order=filter_order)
+        
         while True:
             # Ask user if they want to start recording
             choice = input("Start recording? (y/n): ")
             if choice.lower() != 'y':
                 break
             
+            # Binary frames are ~3x smaller on the wire than CSV text
+            binary_mode = input("Use binary streaming mode? (y/n): ").lower() == 'y'
+            
+            # Streaming runs until Ctrl+C instead of for the configured duration
+            if config and config['DURATION_MS'] == 0:
+                streaming = True
+            else:
+                streaming = input("Stream until Ctrl+C? (y/n): ").lower() == 'y'
+            
             # Create a filename for this recording session
             filename = f"arduino_daq_data_{time.strftime('%Y%m%d_%H%M%S')}.csv"
             
             with open(filename, 'w', newline='') as file:
                 # Send start command
-                ser.write(b"START\n")
+                if streaming:
+                    ser.write(b"STREAM_BIN\n" if binary_mode else b"STREAM\n")
+                elif binary_mode:
+                    ser.write(b"START_BIN\n")
+                else:
+                    ser.write(b"START\n")
                 
                 print(f"Recording data to {filename}...")
+                if streaming:
+                    print("Press Ctrl+C to stop")
                 recording = True
+                stop_sent = False
                 data_lines = 0
+                data_rows = 0
+                link_lost = 0
+                buffer = bytearray()
+                decoder_state = {}
+                time_state = {}
                 
                 # Start time for timeout
                 start_time = time.time()
-                timeout_duration = recordingLength  # timeout to prevent loop #seconds 
+                if config:
+                    # A few seconds more than the recording, to drain the buffers
+                    timeout_duration = config['DURATION_MS'] / 1000.0 + 5
+                else:
+                    timeout_duration = recordingLength  # timeout to prevent loop #seconds 
+                if streaming:
+                    timeout_duration = float('inf')
                 
                 while recording and (time.time() - start_time) < timeout_duration:
-                    if ser.in_waiting:
-                        line = ser.readline().decode('utf-8', errors='ignore').strip()
-                        
-                        if "RECORDING_COMPLETE" in line:
-                            recording = False
-                            print("Recording complete!")
-                        elif "SAMPLES_COLLECTED" in line:
-                            try:
-                                samples = int(line.split(":")[1])
-                                print(f"Collected {samples} samples")
-                            except:
-                                print(f"Received sample info: {line}")
-                        elif "END_OF_DATA" in line:
-                            print("End of data received")
-                        elif line:
-                            # Write the line to the file
-                            file.write(line + '\n')
-                            data_lines += 1
+                    try:
+                        if ser.in_waiting:
+                            if binary_mode:
+                                buffer += ser.read(ser.in_waiting)
+                                lines = decode_binary_stream(buffer, decoder_state)
+                            else:
+                                lines = [ser.readline().decode('utf-8', errors='ignore').strip()]
                             
-                            # Show progress periodically
-                            if data_lines % 100 == 0:
-                                print(f"Received {data_lines} data points...", end='\r')
+                            for line in lines:
+                                if "RECORDING_COMPLETE" in line:
+                                    recording = False
+                                    print("Recording complete!")
+                                elif "SAMPLES_COLLECTED" in line:
+                                    try:
+                                        samples = int(line.split(":")[1])
+                                        print(f"Collected {samples} samples")
+                                    except:
+                                        print(f"Received sample info: {line}")
+                                elif "SAMPLES_DROPPED" in line:
+                                    # The Arduino buffer overflowed, the Sample column has gaps
+                                    print(f"Arduino dropped {line.split(':')[1]} samples")
+                                elif line.startswith("SEQ:"):
+                                    # Stream marker: every sample up to SEQ was either sent
+                                    # or counted in DROPPED, anything else went missing on
+                                    # the serial link
+                                    try:
+                                        seq, dropped = (int(field.split(':')[1]) for field in line.split(','))
+                                        lost = seq - dropped - data_rows
+                                        if lost > link_lost:
+                                            print(f"\nWarning: {lost - link_lost} samples lost on the serial link")
+                                            link_lost = lost
+                                    except ValueError:
+                                        print(f"Received bad marker: {line}")
+                                elif "END_OF_DATA" in line:
+                                    print("End of data received")
+                                elif line:
+                                    if line[0].isdigit():
+                                        line = unwrap_time(line, time_state)
+                                        data_rows += 1
+                                    
+                                    # Write the line to the file
+                                    file.write(line + '\n')
+                                    data_lines += 1
+                                    
+                                    # Show progress periodically
+                                    if data_lines % 100 == 0:
+                                        print(f"Received {data_lines} data points...", end='\r')
+                    except KeyboardInterrupt:
+                        if not streaming or stop_sent:
+                            raise
+                        # Ask the Arduino to stop, then keep reading what it
+                        # still has buffered until RECORDING_COMPLETE
+                        ser.write(b"STOP\n")
+                        stop_sent = True
+                        print("\nStopping...")
+                        start_time = time.time()
+                        timeout_duration = 5
                 
                 print(f"\nSaved {data_lines} data points to {filename}")
+                if link_lost:
+                    print(f"{link_lost} samples were lost on the serial link")
             
-            # Try to clean the data file
-            clean_filename = clean_data_file(filename)
+            # Try to clean the data file (the native parser skips invalid
+            # lines itself)
+            clean_filename = filename if daq_host.available() else clean_data_file(filename)
             
             # Apply low-pass filter to the data
             filtered_filename = filter_and_save_data(clean_filename, 
                                                    cutoff_freq=cutoff_freq, 
-                                                   filter_order=filter_order)
+                                                   filter_order=filter_order,
+                                                   period_us=config['PERIOD_US'] if config else None)
                 
             # Ask if user wants to plot the data
             plot_choice = input("Plot the data? (y/n): ")
@@ -427,8 +905,11 @@ def filter_existing_file():
         print(f"File not found: {filename}")
         return
     
-    # Clean the file if needed
-    clean_filename = clean_data_file(filename)
+    # Clean the file if needed (.daqc files have nothing to clean)
+    if filename.endswith('.daqc') or daq_host.available():
+        clean_filename = filename
+    else:
+        clean_filename = clean_data_file(filename)
     
     # Ask for filter settings
     print("\nLow-pass filter settings:")
@@ -447,17 +928,98 @@ def filter_existing_file():
         overlapping = plot_style == 'o'
         plot_data(filtered_filename, show_original=True, show_filtered=True, overlapping_plots=overlapping)
 
+def plot_spectrum():
+    """
+    Plot the power spectrum (Welch) and spectrogram of each channel of an
+    existing data file, measured from the data rather than the filter design
+    """
+    filename = input("Enter the path to the data file: ")
+    if not os.path.exists(filename):
+        print(f"File not found: {filename}")
+        return
+    if not os.path.exists(daq_host.SPECTRUM_PATH):
+        print("The spectrum needs the native tools, build them with: make -C host")
+        return
+    
+    nperseg = int(input("Segment length, a power of two (1024): ") or "1024")
+    average = int(input("Segments averaged per spectrogram row (1): ") or "1")
+    try:
+        psd, times, spectrogram = daq_host.spectrum(filename, nperseg=nperseg, average=average)
+    except Exception as e:
+        print(f"Error computing the spectrum: {e}")
+        return
+    
+    freqs = psd['Frequency(Hz)'].values
+    channels = [c for c in psd.columns if c != 'Frequency(Hz)']
+    fig, axes = plt.subplots(len(channels), 2, figsize=(14, 3 * len(channels)), squeeze=False)
+    eps = 1e-20  # keep log10 away from zero
+    for i, channel in enumerate(channels):
+        # Skip DC, it's mostly the signal's offset
+        axes[i, 0].semilogy(freqs[1:], psd[channel].values[1:])
+        axes[i, 0].set_ylabel('PSD (V²/Hz)')
+        axes[i, 0].set_title(f'Channel {channel}')
+        axes[i, 0].grid(True)
+        
+        if len(times):
+            image = 10 * np.log10(np.asarray(spectrogram[:, i, :]).T + eps)
+            half = (times[1] - times[0]) / 2 if len(times) > 1 else 0
+            mesh = axes[i, 1].imshow(image, aspect='auto', origin='lower', cmap='viridis',
+                                     extent=[times[0] - half, times[-1] + half, freqs[0], freqs[-1]])
+            fig.colorbar(mesh, ax=axes[i, 1], label='dB V²/Hz')
+        axes[i, 1].set_ylabel('Frequency (Hz)')
+    axes[-1, 0].set_xlabel('Frequency (Hz)')
+    axes[-1, 1].set_xlabel('Time (s)')
+    
+    plot_filename = f"{os.path.splitext(filename)[0]}_spectrum_plot.png"
+    plt.tight_layout()
+    plt.savefig(plot_filename, dpi=PLOT_DPI, bbox_inches='tight')
+    print(f"Plot saved as {plot_filename}")
+    plt.show()
+
+def reprocess_directory():
+    """
+    Filter every capture in a directory at once (all cores, native), skipping
+    the ones already filtered with the same settings, and print a summary
+    """
+    directory = input("Directory with the captures (.): ") or "."
+    if not os.path.isdir(directory):
+        print(f"Not a directory: {directory}")
+        return
+    if not os.path.exists(daq_host.BATCH_PATH):
+        print("Batch reprocessing needs the native tools, build them with: make -C host")
+        return
+    
+    print("\nLow-pass filter settings:")
+    cutoff_freq = float(input("Enter cutoff frequency in Hz (recommended: 1.0-2.0 for 0.5Hz signals): ") or "1.5")
+    filter_order = int(input("Enter filter order (4=24dB/octave, 5=30dB/octave, 6=36dB/octave): ") or "4")
+    force = input("Reprocess files that are already up to date? (y/n): ").lower() == 'y'
+    
+    summary = daq_host.batch(directory, cutoff_freq=cutoff_freq, filter_order=filter_order, force=force)
+    if summary is not None and not summary.empty:
+        # One line per file: its noise floor and what the filter took out,
+        # averaged over the channels
+        per_file = summary.groupby('File').agg({'Rows': 'first', 'Fs(Hz)': 'first',
+                                                'Noise(V)': 'mean', 'Residual(V)': 'mean'})
+        with pd.option_context('display.max_rows', None, 'display.width', 200):
+            print(per_file)
+
 if __name__ == "__main__":
     print("Arduino DAQ with Low-Pass Filter")
     print("--------------------------------")
     print("1. Record new data from Arduino")
     print("2. Filter existing data file")
+    print("3. Spectrum of existing data file")
+    print("4. Filter every capture in a directory")
     
-    choice = input("Enter your choice (1/2): ")
+    choice = input("Enter your choice (1/2/3/4): ")
     
     if choice == "1":
         main()
     elif choice == "2":
         filter_existing_file()
+    elif choice == "3":
+        plot_spectrum()
+    elif choice == "4":
+        reprocess_directory()
     else:
         print("Invalid choice")
\ No newline at end of file
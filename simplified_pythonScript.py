@@ -33,13 +33,20 @@ def filter_and_save_data(filename):
     # remove rows with NaN (not a number)
     df = df.dropna()
     
-    # Samples not at exact distance from each other
-    # Calculate the sampling frequency (median of differences)
-    # numpy.diff to get the difference between samples
-    time_diffs = np.diff(df['Time(ms)'])
-    # numpy.median to get the median
-    median_time_diff = np.median(time_diffs)  # in milliseconds
-    fs = 1000.0 / median_time_diff  # Convert to Hz
+    if 'Time(us)' in df.columns:
+        # Timestamps come from the Arduino's hardware sample clock, so the
+        # smallest step is exactly one sample period (bigger steps are drops)
+        fs = 1e6 / np.min(np.diff(df['Time(us)']))
+        # keep a ms column for plotting
+        df['Time(ms)'] = df['Time(us)'] / 1000.0
+    else:
+        # Older files: samples not at exact distance from each other
+        # Calculate the sampling frequency (median of differences)
+        # numpy.diff to get the difference between samples
+        time_diffs = np.diff(df['Time(ms)'])
+        # numpy.median to get the median
+        median_time_diff = np.median(time_diffs)  # in milliseconds
+        fs = 1000.0 / median_time_diff  # Convert to Hz
     
     # Filter each analog channel:
     # ID column head for each channel 
@@ -66,6 +73,10 @@ def plot_data(filename):
     # Read the CSV data with pandas
     df = pd.read_csv(filename)
     
+    # Newer firmware timestamps in microseconds, plot in ms
+    if 'Time(ms)' not in df.columns and 'Time(us)' in df.columns:
+        df['Time(ms)'] = df['Time(us)'] / 1000.0
+    
     # Initialize an empty list to store our analog channel names
     analog_channels = []
 